@@ -0,0 +1,110 @@
+#include "AdaptiveStepper.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+AdaptiveStepper::AdaptiveStepper(ClothScene &scene) : m_scene(scene)
+{
+  m_states.resize(m_scene.instances().size());
+  m_energies.resize(m_scene.instances().size());
+}
+
+void AdaptiveStepper::step(ThreadPool &pool)
+{
+  auto &instances = m_scene.instances();
+  if (instances.empty()) {
+    return;
+  }
+  const float h = m_scene.stepParams().front().h;
+
+  const auto stages = m_scene.preparedStages();
+  if (m_substep.size() == 0 || stages != m_stages) {
+    m_substep.clear();
+    const auto start = m_substep.addNode("substep", []() {});
+    m_scene.addStepTasks(m_substep, start, stages, false);
+    m_stages = stages;
+  }
+
+  m_stats.stableStep = m_scene.stableStep();
+  const float substepCount = std::ceil(h / (safety * m_stats.stableStep));
+  uint32_t substeps = substepCount < float(maxSubsteps)
+                          ? std::max(uint32_t(substepCount), 1u)
+                          : maxSubsteps;
+  m_stats.rollbacks = 0;
+
+  for (size_t n = 0; n < instances.size(); ++n) {
+    instances[n].cloth.saveState(m_states[n]);
+  }
+  while (!advance(pool, h, substeps)) {
+    for (size_t n = 0; n < instances.size(); ++n) {
+      instances[n].cloth.restoreState(m_states[n]);
+    }
+    ++m_stats.rollbacks;
+    if (substeps >= maxSubsteps) {
+      // Unstable at any step we can afford, the motion goes instead
+      for (auto &instance : instances) {
+        instance.cloth.stop();
+      }
+      ++m_stats.stops;
+      break;
+    }
+    substeps = std::min(2 * substeps, maxSubsteps);
+  }
+
+  m_stats.substeps = substeps;
+  m_scene.setSubstep(h);
+}
+
+bool AdaptiveStepper::advance(ThreadPool &pool, float h, uint32_t substeps)
+{
+  auto &instances = m_scene.instances();
+  for (size_t n = 0; n < instances.size(); ++n) {
+    m_energies[n] = instances[n].cloth.kineticEnergy();
+  }
+
+  const float substep = h / substeps;
+  m_scene.setSubstep(substep);
+  for (uint32_t s = 0; s < substeps; ++s) {
+    m_substep.run(pool);
+
+    for (size_t n = 0; n < instances.size(); ++n) {
+      const Cloth &cloth = instances[n].cloth;
+      const float energy = cloth.kineticEnergy();
+      // Gaining less than every particle crossing half its spacing in a
+      // substep is ordinary motion, whatever the growth
+      const float speed = 0.5f * cloth.spacing() / substep;
+      const float ordinary =
+          0.5f * cloth.mass() * cloth.particleCount() * speed * speed;
+      if (!std::isfinite(energy) ||
+          energy > energyGrowth * m_energies[n] + ordinary) {
+        return false;
+      }
+      m_energies[n] = energy;
+    }
+  }
+  return true;
+}
+
+std::vector<std::vector<TaskGraph::NodeId>> AdaptiveStepper::addStepTasks(
+    TaskGraph &graph, TaskGraph::NodeId prepare, ThreadPool &pool)
+{
+  // The substeps run their own graph from this node, helped by the pool
+  const auto stepped =
+      graph.addNode("adaptive", [this, &pool]() { step(pool); });
+  graph.addDependency(prepare, stepped);
+
+  auto &instances = m_scene.instances();
+  std::vector<std::vector<TaskGraph::NodeId>> finished(instances.size());
+  for (size_t n = 0; n < instances.size(); ++n) {
+    Cloth &cloth = instances[n].cloth;
+    const std::string name = "cloth" + std::to_string(n) + "/normals";
+    for (uint32_t tile = 0; tile < cloth.tiles().size(); ++tile) {
+      finished[n].push_back(graph.addNode(name, [this, &cloth, n, tile]() {
+        cloth.computeNormals(m_scene.stepParams()[n], tile);
+      }));
+      graph.addDependency(stepped, finished[n].back());
+    }
+  }
+  return finished;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ClothScene.hpp"
+#include "utils/TaskGraph.hpp"
+#include "utils/ThreadPool.hpp"
+
+// Advances a scene by the step prepared with ClothScene::prepareStep() in as
+// many substeps as its stiffest particle needs to stay stable. When a substep
+// diverges anyway, its energy not finite or jumping, the whole step is rolled
+// back and replayed with twice as many substeps.
+class AdaptiveStepper
+{
+public:
+  struct Stats
+  {
+    float stableStep = 0.f; // estimated largest substep of the last step
+    uint32_t substeps = 0; // of the last step
+    uint32_t rollbacks = 0; // of the last step
+    uint32_t stops = 0; // steps that still diverged with maxSubsteps
+  };
+
+  explicit AdaptiveStepper(ClothScene &scene);
+
+  void step(ThreadPool &pool);
+
+  // The same step as a node of graph after prepare, followed by the normals.
+  // Returns for each cloth the node finishing each of its tiles, like
+  // ClothScene::addStepTasks().
+  std::vector<std::vector<TaskGraph::NodeId>> addStepTasks(
+      TaskGraph &graph, TaskGraph::NodeId prepare, ThreadPool &pool);
+
+  inline const Stats &stats() const { return m_stats; }
+
+  float safety = 0.9f; // fraction of the estimated stable step taken
+  uint32_t maxSubsteps = 64;
+  // A substep multiplying the kinetic energy by more than that diverged
+  float energyGrowth = 2.f;
+
+private:
+  // Advance every cloth by substeps of h, false when one diverged
+  bool advance(ThreadPool &pool, float h, uint32_t substeps);
+
+  ClothScene &m_scene;
+  // Every cloth, without the normals, built for the stages of the steps
+  TaskGraph m_substep;
+  ClothScene::StepStages m_stages;
+  std::vector<Cloth::State> m_states;
+  std::vector<float> m_energies;
+  Stats m_stats;
+};
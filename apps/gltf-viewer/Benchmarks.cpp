@@ -0,0 +1,914 @@
+#include "Benchmarks.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+
+#include <glm/gtc/constants.hpp>
+
+#include "AdaptiveStepper.hpp"
+#include "ClothBvh.hpp"
+#include "ClothKernel.hpp"
+#include "ClothScene.hpp"
+#include "PLink.hpp"
+#include "utils/ThreadPool.hpp"
+#include "utils/WindField.hpp"
+#include "utils/perf_counters.hpp"
+
+namespace {
+
+// Same defaults as the viewer, at 60 steps per second
+const float STEP = 0.5f;
+const float MASS = 1.f;
+const float GRAVITY = 0.5f;
+const float H = 1.f / 60.f;
+
+struct OrderingResult
+{
+  double msPerStep;
+  double missesPerStep;
+};
+
+OrderingResult benchmarkOrdering(const glm::uvec2 &size,
+    ParticleOrdering ordering, SpringModel springModel, uint32_t steps)
+{
+  Cloth cloth(size.x, size.y, STEP, MASS, ordering, springModel);
+
+  const StepParams params =
+      makeStepParams(ClothMaterial(), H, glm::vec3(0.f, -GRAVITY / H, 0.f));
+
+  const auto step = [&]() {
+    cloth.step(params);
+    cloth.computeNormals(params);
+  };
+
+  // Warm up caches and let the cloth start moving
+  for (uint32_t s = 0; s < 4; ++s) {
+    step();
+  }
+
+  CacheMissCounter misses;
+  const auto start = std::chrono::steady_clock::now();
+  misses.start();
+  for (uint32_t s = 0; s < steps; ++s) {
+    step();
+  }
+  const uint64_t missCount = misses.stop();
+  const auto end = std::chrono::steady_clock::now();
+
+  OrderingResult result;
+  result.msPerStep =
+      std::chrono::duration<double, std::milli>(end - start).count() / steps;
+  result.missesPerStep =
+      misses.available() ? double(missCount) / steps : -1.;
+  return result;
+}
+
+struct PrecisionResult
+{
+  double msPerStep;
+  std::vector<glm::dvec3> positions; // offset removed
+};
+
+template <typename Real, typename Force, uint32_t Width>
+PrecisionResult benchmarkPrecision(const Cloth &cloth,
+    const StepParams &params, uint32_t steps, double offset)
+{
+  ClothCopy<Real, Force, Width> copy(cloth);
+  copy.translate(glm::vec<3, Real>(Real(offset)));
+
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t s = 0; s < steps; ++s) {
+    copy.step(params);
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  PrecisionResult result;
+  result.msPerStep =
+      std::chrono::duration<double, std::milli>(end - start).count() / steps;
+  for (const auto &position : copy.positions()) {
+    result.positions.push_back(glm::dvec3(position) - glm::dvec3(offset));
+  }
+  return result;
+}
+
+// What ended a sweep run early, the first found of a step
+enum class SweepFailure
+{
+  None,
+  Stops, // more than maxSubsteps
+  NonFinite, // energy
+  Strain, // past SweepGrid::maxStrain
+};
+
+const char *sweepFailureName(SweepFailure failure)
+{
+  switch (failure) {
+  case SweepFailure::None:
+    return "none";
+  case SweepFailure::Stops:
+    return "stops";
+  case SweepFailure::NonFinite:
+    return "non_finite";
+  case SweepFailure::Strain:
+    return "strain";
+  }
+  return "";
+}
+
+struct SweepRun
+{
+  float mass, rigidity, viscosity, gravity, wind;
+  // Why a step diverged if one did, the steps lasted before it
+  SweepFailure failure = SweepFailure::None;
+  uint32_t steps = 0;
+  double meanSubsteps = 0.;
+  float kineticEnergy = 0.f, potentialEnergy = 0.f; // after the last step
+  float maxStrain = 0.f; // of any spring over the run
+  double wallMs = 0.;
+};
+
+// Steps adapted like those of the viewer. Everything a run touches is its
+// own, down to its pool of one thread.
+void simulateSweepRun(
+    SweepRun &run, const SweepGrid &grid, uint32_t side, uint32_t steps)
+{
+  const float PHYSICS_SCALE = 1e-5f; // of the rigidity and viscosity sliders
+
+  ClothMaterial material;
+  material.thickness = 0.2f * STEP;
+  material.drag = 0.05f;
+  material.lift = 0.03f;
+  for (auto &spring : material.springs) {
+    spring.rigidity = run.rigidity * PHYSICS_SCALE;
+    spring.viscosity = run.viscosity * PHYSICS_SCALE;
+  }
+  Wind wind{glm::vec3(0.05f, 0.f, run.wind),
+      glm::vec3(glm::pi<float>(), 0.f, glm::pi<float>())};
+  wind.turbulence = 1.f;
+  wind.gustRate = 0.25f;
+  wind.gustStrength = 3.f;
+
+  const auto start = std::chrono::steady_clock::now();
+  ThreadPool pool(1);
+  ClothScene scene(1, side, side, STEP, run.mass,
+      ParticleOrdering::ColumnMajor, SpringModel::RestOffset, grid.precision);
+  scene.setTelemetryEnabled(true);
+  AdaptiveStepper stepper(scene);
+  uint64_t substeps = 0;
+  for (; run.steps < steps; ++run.steps) {
+    scene.prepareStep(
+        material, H, run.steps * H, run.gravity / 10.f, wind);
+    stepper.step(pool);
+    for (size_t n = 0; n < scene.instances().size(); ++n) {
+      scene.instances()[n].cloth.computeNormals(scene.stepParams()[n]);
+    }
+    substeps += stepper.stats().substeps;
+
+    const Cloth::Telemetry telemetry = scene.telemetry();
+    run.kineticEnergy = telemetry.kineticEnergy;
+    run.potentialEnergy = telemetry.potentialEnergy;
+    for (const float strain : telemetry.maxStrain) {
+      run.maxStrain = std::max(run.maxStrain, strain);
+    }
+    if (stepper.stats().stops > 0) {
+      run.failure = SweepFailure::Stops;
+    } else if (!std::isfinite(run.kineticEnergy) ||
+               !std::isfinite(run.potentialEnergy)) {
+      run.failure = SweepFailure::NonFinite;
+    } else if (!(run.maxStrain <= grid.maxStrain)) {
+      run.failure = SweepFailure::Strain;
+    }
+    if (run.failure != SweepFailure::None) {
+      break;
+    }
+  }
+  const bool stopped = run.failure != SweepFailure::None;
+  run.meanSubsteps = double(substeps) / std::max(run.steps + stopped, 1u);
+  run.wallMs = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start)
+                   .count();
+}
+
+// The step as it was first written, an object per particle and per spring,
+// which the flat arrays of Cloth must keep reproducing
+class ReferenceCloth
+{
+public:
+  ReferenceCloth(uint32_t width, uint32_t height, float step, float mass) :
+      m_height(height)
+  {
+    for (uint32_t i = 0; i < width; ++i) {
+      for (uint32_t j = 0; j < height; ++j) {
+        const glm::vec3 position =
+            glm::vec3(i - float(width) / 2., j - float(height) / 2., 0.) *
+            step;
+        if (i == 0) {
+          m_points.push_back(std::make_shared<PFixedPoint>(position, mass));
+        } else {
+          m_points.push_back(std::make_shared<PPoint>(
+              position, i == width - 1 ? mass * 0.9f : mass));
+        }
+      }
+    }
+
+    // The meshes of the Cloth constructor
+    for (uint32_t j = 0; j < height - 1; ++j) {
+      link(0, j, 1, j, SpringFamily::Structural);
+      link(0, j, 1, j + 1, SpringFamily::Shear);
+    }
+    for (uint32_t i = 1; i < width - 1; ++i) {
+      for (uint32_t j = 0; j < height - 1; ++j) {
+        link(i, j, i + 1, j, SpringFamily::Structural);
+        link(i, j, i, j + 1, SpringFamily::Structural);
+        link(i - 1, j + 1, i, j, SpringFamily::Shear);
+        link(i, j, i + 1, j + 1, SpringFamily::Shear);
+      }
+    }
+    for (uint32_t i = 0; i < width - 1; ++i) {
+      link(i, height - 1, i + 1, height - 1, SpringFamily::Structural);
+    }
+    for (uint32_t j = 0; j < height - 1; ++j) {
+      link(width - 1, j, width - 1, j + 1, SpringFamily::Structural);
+      link(width - 2, j + 1, width - 1, j, SpringFamily::Shear);
+    }
+    for (uint32_t i = 0; i < width - 2; ++i) {
+      for (uint32_t j = 0; j < height - 2; ++j) {
+        if (i > 0) {
+          link(i, j, i, j + 2, SpringFamily::Bend);
+        }
+        link(i, j, i + 2, j, SpringFamily::Bend);
+      }
+    }
+  }
+
+  void step(const StepParams &params)
+  {
+    for (auto &link : m_links) {
+      link.execute(params);
+    }
+    for (auto &point : m_points) {
+      point->applyForce(params.force);
+      point->execute(params.h);
+      point->clearForce();
+    }
+  }
+
+  inline size_t linkCount() const { return m_links.size(); }
+  inline glm::vec3 position(uint32_t i, uint32_t j) const
+  {
+    return m_points[i * m_height + j]->position();
+  }
+
+private:
+  void link(uint32_t i1, uint32_t j1, uint32_t i2, uint32_t j2,
+      SpringFamily family)
+  {
+    m_links.emplace_back(
+        m_points[i1 * m_height + j1], m_points[i2 * m_height + j2], family);
+  }
+
+  uint32_t m_height;
+  std::vector<std::shared_ptr<PPoint>> m_points;
+  std::vector<PLink> m_links;
+};
+
+// A step checked against ReferenceCloth, with the same particles and springs
+class VerifiedBackend
+{
+public:
+  virtual ~VerifiedBackend() = default;
+  virtual void step(const StepParams &params) = 0;
+  virtual glm::dvec3 position(uint32_t i, uint32_t j) const = 0;
+};
+
+// Cloth::step, or its phases spread over a pool as the frame graph does
+class ClothBackend : public VerifiedBackend
+{
+public:
+  ClothBackend(uint32_t width, uint32_t height, float mass,
+      ParticleOrdering ordering, ThreadPool *pool,
+      ClothPrecision precision = ClothPrecision::Float) :
+      m_cloth(width, height, STEP, mass, ordering, SpringModel::RestOffset,
+          precision),
+      m_pool(pool)
+  {
+  }
+
+  void step(const StepParams &params) override
+  {
+    if (!m_pool) {
+      m_cloth.step(params);
+      return;
+    }
+    m_cloth.tear();
+    m_cloth.updateSleep(params);
+    m_pool->parallelFor(m_cloth.springChunkCount(), [&](size_t chunk) {
+      m_cloth.computeSpringForces(params, uint32_t(chunk));
+    });
+    m_pool->parallelFor(m_cloth.tiles().size(),
+        [&](size_t tile) { m_cloth.integrate(params, uint32_t(tile)); });
+  }
+
+  glm::dvec3 position(uint32_t i, uint32_t j) const override
+  {
+    return m_cloth.positions()[m_cloth.layout().index(i, j)];
+  }
+
+private:
+  Cloth m_cloth;
+  ThreadPool *m_pool;
+};
+
+template <typename Real, typename Force, uint32_t Width>
+class KernelBackend : public VerifiedBackend
+{
+public:
+  KernelBackend(uint32_t width, uint32_t height, float mass) :
+      m_cloth(width, height, STEP, mass), m_copy(m_cloth)
+  {
+  }
+
+  void step(const StepParams &params) override { m_copy.step(params); }
+
+  glm::dvec3 position(uint32_t i, uint32_t j) const override
+  {
+    return m_copy.positions()[m_cloth.layout().index(i, j)];
+  }
+
+private:
+  Cloth m_cloth; // only for its layout once copied
+  ClothCopy<Real, Force, Width> m_copy;
+};
+
+// Cloth::step with springs slightly stiffer than asked, a mistake the bounds
+// have to catch
+class PerturbedBackend : public VerifiedBackend
+{
+public:
+  static constexpr float STIFFER = 1e-3f;
+
+  PerturbedBackend(uint32_t width, uint32_t height, float mass) :
+      m_cloth(width, height, STEP, mass)
+  {
+  }
+
+  void step(const StepParams &params) override
+  {
+    StepParams perturbed = params;
+    for (auto &springs : perturbed.springs) {
+      springs.rigidity *= 1.f + STIFFER;
+    }
+    m_cloth.step(perturbed);
+  }
+
+  glm::dvec3 position(uint32_t i, uint32_t j) const override
+  {
+    return m_cloth.positions()[m_cloth.layout().index(i, j)];
+  }
+
+private:
+  Cloth m_cloth;
+};
+
+struct Backend
+{
+  const char *name;
+  std::unique_ptr<VerifiedBackend> step;
+  bool mustFail = false;
+};
+
+std::vector<Backend> makeBackends(
+    uint32_t width, uint32_t height, float mass, ThreadPool &pool)
+{
+  std::vector<Backend> backends;
+  for (const auto ordering : {ParticleOrdering::ColumnMajor,
+           ParticleOrdering::Morton, ParticleOrdering::Tiled}) {
+    backends.push_back({toString(ordering),
+        std::make_unique<ClothBackend>(
+            width, height, mass, ordering, nullptr)});
+  }
+  backends.push_back({"threaded",
+      std::make_unique<ClothBackend>(
+          width, height, mass, ParticleOrdering::Tiled, &pool)});
+  backends.push_back({"float",
+      std::make_unique<KernelBackend<float, float, 1>>(width, height, mass)});
+  for (const auto precision : {ClothPrecision::Double, ClothPrecision::Mixed}) {
+    backends.push_back({toString(precision),
+        std::make_unique<ClothBackend>(width, height, mass,
+            ParticleOrdering::ColumnMajor, nullptr, precision)});
+  }
+  backends.push_back({"perturbed",
+      std::make_unique<PerturbedBackend>(width, height, mass), true});
+  return backends;
+}
+
+// Distance from a to b in floats at the magnitude of a, never finer than
+// those at the spacing: counting the floats between them would find billions
+// around 0. The most for a NaN.
+uint64_t ulpDistance(double a, double b)
+{
+  const float scale = float(std::max(std::abs(a), double(STEP)));
+  const double ulp =
+      std::nextafter(scale, std::numeric_limits<float>::infinity()) - scale;
+  const double distance = std::abs(double(float(a)) - double(float(b))) / ulp;
+  if (!(distance < double(std::numeric_limits<uint32_t>::max()))) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return uint64_t(std::ceil(distance));
+}
+
+} // namespace
+
+int runOrderingBenchmark(const std::vector<glm::uvec2> &sizes, uint32_t steps,
+    SpringModel springModel)
+{
+  const ParticleOrdering orderings[] = {ParticleOrdering::ColumnMajor,
+      ParticleOrdering::Morton, ParticleOrdering::Tiled};
+
+  std::printf("%s springs\n", toString(springModel));
+  std::printf("%-12s %-8s %12s %16s %10s\n", "size", "ordering", "ms/step",
+      "cache-miss/step", "vs column");
+  for (const auto &size : sizes) {
+    double reference = 0.;
+    for (const auto ordering : orderings) {
+      const auto result =
+          benchmarkOrdering(size, ordering, springModel, steps);
+      if (ordering == ParticleOrdering::ColumnMajor) {
+        reference = result.missesPerStep;
+      }
+
+      char sizeName[32];
+      std::snprintf(sizeName, sizeof(sizeName), "%ux%u", size.x, size.y);
+      if (result.missesPerStep < 0.) {
+        std::printf("%-12s %-8s %12.3f %16s %10s\n", sizeName,
+            toString(ordering), result.msPerStep, "n/a", "n/a");
+      } else {
+        std::printf("%-12s %-8s %12.3f %16.0f %9.2fx\n", sizeName,
+            toString(ordering), result.msPerStep, result.missesPerStep,
+            reference > 0. ? result.missesPerStep / reference : 1.);
+      }
+    }
+  }
+  return 0;
+}
+
+int runPrecisionBenchmark(const std::vector<uint32_t> &sides, uint32_t steps,
+    SpringModel springModel, double offset)
+{
+  struct Variant
+  {
+    const char *name;
+    PrecisionResult (*run)(const Cloth &, const StepParams &, uint32_t, double);
+  };
+  // The first one is the reference the others drift from
+  const Variant variants[] = {
+      {"double", benchmarkPrecision<double, double, 1>},
+      {"mixed x4", benchmarkPrecision<double, float, 4>},
+      {"float x4", benchmarkPrecision<float, float, 4>},
+      {"float", benchmarkPrecision<float, float, 1>},
+  };
+
+  std::printf("%s springs, %u steps, %g from the origin\n",
+      toString(springModel), steps, offset);
+  std::printf("%-12s %-10s %12s %12s %16s\n", "size", "precision", "ms/step",
+      "ns/particle", "drift/spacing");
+  for (const uint32_t side : sides) {
+    const Cloth cloth(
+        side, side, STEP, MASS, ParticleOrdering::ColumnMajor, springModel);
+    const StepParams params = makeStepParams(
+        ClothMaterial(), H, glm::vec3(0.f, -GRAVITY / H, 0.f));
+
+    std::vector<glm::dvec3> reference;
+    for (const auto &variant : variants) {
+      const auto result = variant.run(cloth, params, steps, offset);
+      if (reference.empty()) {
+        reference = result.positions;
+      }
+      // RMS distance to the reference
+      double drift = 0.;
+      for (size_t p = 0; p < reference.size(); ++p) {
+        const glm::dvec3 d = result.positions[p] - reference[p];
+        drift += glm::dot(d, d);
+      }
+      drift = std::sqrt(drift / reference.size()) / STEP;
+
+      char sizeName[32];
+      std::snprintf(sizeName, sizeof(sizeName), "%ux%u", side, side);
+      std::printf("%-12s %-10s %12.3f %12.2f %16.3g\n", sizeName,
+          variant.name, result.msPerStep,
+          result.msPerStep * 1e6 / cloth.particleCount(), drift);
+    }
+  }
+  return 0;
+}
+
+int runMultigridBenchmark(const std::vector<uint32_t> &sides, float rigidity,
+    const SolverSettings &settings, uint32_t threadCount)
+{
+  const SolverMethod methods[] = {SolverMethod::Jacobi, SolverMethod::VCycle,
+      SolverMethod::MultigridCG};
+
+  ClothMaterial material;
+  for (auto &springs : material.springs) {
+    springs.rigidity = rigidity;
+  }
+  ThreadPool pool(threadCount);
+
+  std::printf("rigidity %g, tolerance %g, at most %u iterations, %u threads\n",
+      rigidity, settings.tolerance, settings.maxIterations, pool.size());
+  std::printf("%-12s %-8s %10s %12s %12s\n", "size", "solver", "iterations",
+      "ms/step", "residual");
+  for (const uint32_t side : sides) {
+    for (const auto method : methods) {
+      Cloth cloth(side, side, STEP, MASS);
+      StepParams params =
+          makeStepParams(material, H, glm::vec3(0.f, -GRAVITY / H, 0.f));
+      params.solver = settings;
+      params.solver.implicit = true;
+      params.solver.method = method;
+
+      // Hierarchy built by the first step, the second starts from rest
+      cloth.step(params, &pool);
+      cloth.stop();
+      const auto start = std::chrono::steady_clock::now();
+      cloth.step(params, &pool);
+      const auto end = std::chrono::steady_clock::now();
+
+      char sizeName[32];
+      std::snprintf(sizeName, sizeof(sizeName), "%ux%u", side, side);
+      std::printf("%-12s %-8s %10u %12.3f %12.3g\n", sizeName,
+          toString(method), cloth.lastSolve().iterations,
+          std::chrono::duration<double, std::milli>(end - start).count(),
+          cloth.lastSolve().residual);
+    }
+  }
+  return 0;
+}
+
+int runWindBenchmark(const std::vector<uint32_t> &sides, uint32_t passes)
+{
+  const uint32_t FALL_STEPS = 30;
+  const WindField field;
+  const Wind wind{glm::vec3(0.f), glm::vec3(0.f)};
+
+  std::printf("%-12s %16s %16s\n", "size", "sample ns/point",
+      "sample4 ns/point");
+  for (const uint32_t side : sides) {
+    // Positions of a cloth that fell for a while, in grid cells
+    Cloth cloth(side, side, STEP, MASS);
+    const StepParams params =
+        makeStepParams(ClothMaterial(), H, glm::vec3(0.f, -GRAVITY / H, 0.f));
+    for (uint32_t s = 0; s < FALL_STEPS; ++s) {
+      cloth.step(params);
+    }
+    const size_t count = cloth.particleCount();
+    const size_t padded = (count + 3) & ~size_t(3);
+    std::vector<float> cells[3];
+    for (auto &coordinates : cells) {
+      coordinates.resize(padded);
+    }
+    for (size_t p = 0; p < padded; ++p) {
+      const glm::vec3 cell =
+          cloth.positions()[std::min(p, count - 1)] / wind.scale;
+      for (int c = 0; c < 3; ++c) {
+        cells[c][p] = cell[c];
+      }
+    }
+
+    const auto nsPerPoint = [&](std::chrono::steady_clock::time_point start) {
+      return std::chrono::duration<double, std::nano>(
+                 std::chrono::steady_clock::now() - start)
+                 .count() /
+             (double(passes) * padded);
+    };
+
+    // Summed so that the lookups are not optimized away
+    glm::vec3 sum(0.f);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t pass = 0; pass < passes; ++pass) {
+      for (size_t p = 0; p < padded; ++p) {
+        sum += field.sample(glm::vec3(cells[0][p], cells[1][p], cells[2][p]));
+      }
+    }
+    const double sampleNs = nsPerPoint(start);
+
+    float4 sum4[3] = {float4(0.f), float4(0.f), float4(0.f)};
+    start = std::chrono::steady_clock::now();
+    for (uint32_t pass = 0; pass < passes; ++pass) {
+      for (size_t p = 0; p < padded; p += 4) {
+        float4 v[3];
+        field.sample4(float4::load(&cells[0][p]), float4::load(&cells[1][p]),
+            float4::load(&cells[2][p]), v[0], v[1], v[2]);
+        for (int c = 0; c < 3; ++c) {
+          sum4[c] = sum4[c] + v[c];
+        }
+      }
+    }
+    const double sample4Ns = nsPerPoint(start);
+
+    float lanes[4];
+    (sum4[0] + sum4[1] + sum4[2]).store(lanes);
+    char sizeName[32];
+    std::snprintf(sizeName, sizeof(sizeName), "%ux%u", side, side);
+    std::printf("%-12s %16.2f %16.2f\n", sizeName, sampleNs, sample4Ns);
+    if (!std::isfinite(sum.x + sum.y + sum.z + lanes[0])) {
+      std::cerr << "The field sampled a non finite velocity" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int runPickingBenchmark(
+    const std::vector<uint32_t> &sides, uint32_t rays, uint32_t threadCount)
+{
+  const uint32_t FALL_STEPS = 30;
+  const uint32_t REFITS = 20;
+  ThreadPool pool(threadCount);
+  std::mt19937 random(42);
+
+  std::printf("%u threads\n", pool.size());
+  std::printf("%-12s %12s %12s %12s %8s\n", "size", "build ms", "refit ms",
+      "us/ray", "hits");
+  for (const uint32_t side : sides) {
+    Cloth cloth(side, side, STEP, MASS);
+    const StepParams params =
+        makeStepParams(ClothMaterial(), H, glm::vec3(0.f, -GRAVITY / H, 0.f));
+    for (uint32_t s = 0; s < FALL_STEPS; ++s) {
+      cloth.step(params, &pool);
+    }
+
+    const auto elapsedMs = [](std::chrono::steady_clock::time_point start) {
+      return std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    ClothBvh bvh(cloth);
+    const double buildMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < REFITS; ++r) {
+      bvh.refit(cloth, &pool);
+    }
+    const double refitMs = elapsedMs(start) / REFITS;
+
+    // From in front of the cloth towards its particles, some hidden by folds
+    const glm::vec3 eye =
+        0.5f * (bvh.boundsMin() + bvh.boundsMax()) +
+        glm::vec3(0.f, 0.f, side * STEP);
+    std::uniform_int_distribution<uint32_t> particle(
+        0, uint32_t(cloth.particleCount() - 1));
+    std::vector<glm::vec3> directions;
+    for (uint32_t r = 0; r < rays; ++r) {
+      directions.push_back(
+          glm::normalize(cloth.positions()[particle(random)] - eye));
+    }
+    uint32_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto &direction : directions) {
+      ClothBvh::Hit hit;
+      hits += bvh.intersect(cloth, eye, direction,
+          std::numeric_limits<float>::max(), hit);
+    }
+    const double rayUs = 1e3 * elapsedMs(start) / std::max(rays, 1u);
+
+    char sizeName[32];
+    std::snprintf(sizeName, sizeof(sizeName), "%ux%u", side, side);
+    std::printf("%-12s %12.3f %12.3f %12.2f %7.0f%%\n", sizeName, buildMs,
+        refitMs, rayUs, 100. * hits / std::max(rays, 1u));
+  }
+  return 0;
+}
+
+int runSweep(const SweepGrid &grid, uint32_t side, uint32_t steps,
+    const std::string &output, uint32_t threadCount)
+{
+  // Wind varies fastest, mass slowest
+  std::vector<SweepRun> runs;
+  for (const float mass : grid.masses) {
+    for (const float rigidity : grid.rigidities) {
+      for (const float viscosity : grid.viscosities) {
+        for (const float gravity : grid.gravities) {
+          for (const float wind : grid.winds) {
+            runs.push_back({mass, rigidity, viscosity, gravity, wind});
+          }
+        }
+      }
+    }
+  }
+
+  std::ofstream file;
+  if (!output.empty()) {
+    file.open(output);
+    if (!file) {
+      std::cerr << output << ": unable to write" << std::endl;
+      return 1;
+    }
+  }
+
+  ThreadPool pool(threadCount);
+  const auto start = std::chrono::steady_clock::now();
+  pool.parallelFor(runs.size(), [&](size_t run) {
+    simulateSweepRun(runs[run], grid, side, steps);
+  });
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start)
+                             .count();
+
+  std::ostream &csv = output.empty() ? std::cout : file;
+  csv << "run,mass,rigidity,viscosity,gravity,wind,stable,failure,steps,"
+         "substeps,kinetic_energy,potential_energy,max_strain,wall_ms\n";
+  uint32_t unstable = 0;
+  for (size_t r = 0; r < runs.size(); ++r) {
+    const SweepRun &run = runs[r];
+    const bool stable = run.failure == SweepFailure::None;
+    unstable += !stable;
+    csv << r << "," << run.mass << "," << run.rigidity << ","
+        << run.viscosity << "," << run.gravity << "," << run.wind << ","
+        << stable << "," << sweepFailureName(run.failure) << ","
+        << run.steps << "," << run.meanSubsteps << "," << run.kineticEnergy
+        << "," << run.potentialEnergy << "," << run.maxStrain << ","
+        << run.wallMs << "\n";
+  }
+
+  if (!output.empty()) {
+    std::printf("%zu runs of %u steps on %u threads in %.2f s, %u unstable\n",
+        runs.size(), steps, pool.size(), seconds, unstable);
+  }
+  return 0;
+}
+
+int runVerification(const VerifySettings &settings, const std::string &output)
+{
+  std::ofstream csv;
+  if (!output.empty()) {
+    csv.open(output);
+    if (!csv) {
+      std::cerr << output << ": unable to write" << std::endl;
+      return 1;
+    }
+    csv << "case,backend,step,divergence,ulps,within\n";
+  }
+
+  struct Summary
+  {
+    double divergence = 0.; // in spacings
+    uint64_t ulps = 0;
+    uint32_t failedCases = 0;
+    // Where the bounds were first left
+    uint32_t failedCase = 0, failedStep = 0;
+  };
+  std::vector<Summary> summaries;
+  std::vector<const char *> names;
+  std::vector<bool> mustFail;
+
+  // Never a single thread, which would not run the phases concurrently
+  const uint32_t threadCount = settings.threadCount
+                                   ? settings.threadCount
+                                   : std::thread::hardware_concurrency();
+  ThreadPool pool(std::max(threadCount, 2u));
+  std::mt19937 random(settings.seed);
+  std::uniform_int_distribution<uint32_t> side(3, settings.maxSide);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  const float epsilon = settings.epsilon * STEP;
+
+  std::printf("%u cases of %u steps, within %u ulps or %g spacings, "
+              "%u threads\n",
+      settings.cases, settings.steps, settings.ulps, settings.epsilon,
+      pool.size());
+  for (uint32_t c = 0; c < settings.cases; ++c) {
+    const uint32_t width = side(random);
+    const uint32_t height = side(random);
+    const float mass = 0.5f + 1.5f * unit(random);
+    const float h = H * (0.5f + 1.5f * unit(random));
+    ClothMaterial material;
+    for (auto &springs : material.springs) {
+      springs.rigidity = 0.002f + 0.03f * unit(random);
+      springs.viscosity = 0.005f * unit(random);
+    }
+    glm::vec3 force;
+    force.x = unit(random) - 0.5f;
+    force.y = -unit(random);
+    force.z = unit(random) - 0.5f;
+    StepParams params =
+        makeStepParams(material, h, 2.f * GRAVITY / H * force);
+
+    // Away from the stability limit, where any rounding grows unbounded
+    const Cloth shape(width, height, STEP, mass);
+    while (shape.stableStep(params) < 2.f * h) {
+      for (auto &springs : params.springs) {
+        springs.rigidity *= 0.5f;
+        springs.viscosity *= 0.5f;
+      }
+    }
+
+    ReferenceCloth reference(width, height, STEP, mass);
+    auto backends = makeBackends(width, height, mass, pool);
+    if (reference.linkCount() != shape.springCount()) {
+      std::cerr << "The reference has " << reference.linkCount()
+                << " springs, the cloth " << shape.springCount()
+                << std::endl;
+      return 1;
+    }
+    if (summaries.empty()) {
+      summaries.resize(backends.size());
+      std::printf("%-5s %-8s", "case", "size");
+      for (const auto &backend : backends) {
+        names.push_back(backend.name);
+        mustFail.push_back(backend.mustFail);
+        std::printf(" %10s", backend.name);
+      }
+      std::printf("\n");
+    }
+
+    std::vector<double> caseDivergence(backends.size(), 0.);
+    std::vector<bool> caseFailed(backends.size(), false);
+    for (uint32_t s = 1; s <= settings.steps; ++s) {
+      reference.step(params);
+      for (size_t b = 0; b < backends.size(); ++b) {
+        backends[b].step->step(params);
+
+        double divergence = 0.;
+        uint64_t ulps = 0;
+        bool within = true;
+        for (uint32_t i = 0; i < width; ++i) {
+          for (uint32_t j = 0; j < height; ++j) {
+            const glm::dvec3 expected(reference.position(i, j));
+            const glm::dvec3 actual = backends[b].step->position(i, j);
+            const double distance = glm::distance(expected, actual);
+            divergence = std::isnan(distance)
+                             ? std::numeric_limits<double>::infinity()
+                             : std::max(divergence, distance);
+            for (int k = 0; k < 3; ++k) {
+              const uint64_t distance = ulpDistance(expected[k], actual[k]);
+              ulps = std::max(ulps, distance);
+              within &= distance <= settings.ulps &&
+                        std::abs(expected[k] - actual[k]) <= epsilon;
+            }
+          }
+        }
+        divergence /= STEP;
+
+        Summary &summary = summaries[b];
+        summary.divergence = std::max(summary.divergence, divergence);
+        summary.ulps = std::max(summary.ulps, ulps);
+        if (!within && !caseFailed[b]) {
+          caseFailed[b] = true;
+          if (summary.failedCases++ == 0) {
+            summary.failedCase = c;
+            summary.failedStep = s;
+          }
+        }
+        caseDivergence[b] = std::max(caseDivergence[b], divergence);
+        if (csv) {
+          csv << c << "," << backends[b].name << "," << s << ","
+              << divergence << "," << ulps << "," << within << "\n";
+        }
+      }
+    }
+
+    char sizeName[32];
+    std::snprintf(sizeName, sizeof(sizeName), "%ux%u", width, height);
+    std::printf("%-5u %-8s", c, sizeName);
+    for (size_t b = 0; b < backends.size(); ++b) {
+      std::printf(" %9.2g%c", caseDivergence[b], caseFailed[b] ? '*' : ' ');
+    }
+    std::printf("\n");
+  }
+
+  std::printf("\n%-10s %14s %12s %s\n", "backend", "max/spacing",
+      "max ulps", "first past the bounds");
+  int returnCode = 0;
+  for (size_t b = 0; b < summaries.size(); ++b) {
+    const Summary &summary = summaries[b];
+    std::printf("%-10s %14.3g %12llu ", names[b], summary.divergence,
+        (unsigned long long)summary.ulps);
+    if (summary.failedCases) {
+      std::printf("case %u step %u, %u cases failed\n", summary.failedCase,
+          summary.failedStep, summary.failedCases);
+    } else {
+      std::printf("-\n");
+    }
+    // The bounds are useless unless they catch the perturbed cloth everywhere
+    if (mustFail[b] ? summary.failedCases < settings.cases
+                    : summary.failedCases > 0) {
+      returnCode = 1;
+    }
+  }
+  if (returnCode) {
+    std::cerr << "verify failed: a backend left the bounds or the perturbed "
+                 "one stayed within them"
+              << std::endl;
+  }
+  return returnCode;
+}
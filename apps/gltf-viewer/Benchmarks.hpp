@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Cloth.hpp"
+
+// Headless benchmarks, they do not need an OpenGL context.
+
+// Simulate cloths of each size (width, height) with every ParticleOrdering and
+// print time and cache misses per step. Returns a process exit code.
+int runOrderingBenchmark(const std::vector<glm::uvec2> &sizes, uint32_t steps,
+    SpringModel springModel);
+
+// Solve the first implicit step of square cloths of each side with every
+// SolverMethod, all springs of the given rigidity, and print iterations,
+// time and residual. settings.method is ignored. Returns a process exit
+// code.
+int runMultigridBenchmark(const std::vector<uint32_t> &sides, float rigidity,
+    const SolverSettings &settings, uint32_t threadCount);
+
+// Sample the turbulence at the particles of a square cloth of each side,
+// passes times, one point at a time and then four, and print the cost per
+// point. Returns a process exit code.
+int runWindBenchmark(const std::vector<uint32_t> &sides, uint32_t passes);
+
+// Step a square cloth of each side, moved offset away from the origin along
+// every axis, copied at every ClothKernel precision, and print the time per
+// step and how far the particles end from the double ones. Returns a process
+// exit code.
+int runPrecisionBenchmark(const std::vector<uint32_t> &sides, uint32_t steps,
+    SpringModel springModel, double offset);
+
+// Let a square cloth of each side fall for a while, then print the time to
+// build its ClothBvh, to refit it on the pool and to cast rays from the front
+// at random particles. Returns a process exit code.
+int runPickingBenchmark(
+    const std::vector<uint32_t> &sides, uint32_t rays, uint32_t threadCount);
+
+// Values of each parameter of a sweep, in the units of the sliders of the
+// viewer: rigidity and viscosity of every spring family, gravity, and the
+// amplitude of the wind along z, its other terms those of the viewer
+struct SweepGrid
+{
+  std::vector<float> masses;
+  std::vector<float> rigidities;
+  std::vector<float> viscosities;
+  std::vector<float> gravities;
+  std::vector<float> winds;
+  // A run diverged once a spring stretched past 1 + maxStrain times its
+  // rest length, or an adaptive step stopped or an energy was not finite
+  float maxStrain = 1.f;
+  ClothPrecision precision = ClothPrecision::Float; // of every run
+
+  inline size_t runCount() const
+  {
+    return masses.size() * rigidities.size() * viscosities.size() *
+           gravities.size() * winds.size();
+  }
+};
+
+// Simulate a square cloth of the given side for steps fixed steps with every
+// combination of the grid, each run a scene of its own and the runs shared by
+// the threads, then write one CSV row of measures per run to output, the
+// standard output if empty. Returns a process exit code.
+int runSweep(const SweepGrid &grid, uint32_t side, uint32_t steps,
+    const std::string &output, uint32_t threadCount);
+
+// Random cloths checked by verify against the object-based PPoint and PLink
+// step, the reference the flat arrays came from
+struct VerifySettings
+{
+  uint32_t cases = 20;
+  uint32_t steps = 200;
+  uint32_t maxSide = 96; // of either side, both random
+  uint32_t seed = 1;
+  // A coordinate agrees within ulps floats of the reference, at its
+  // magnitude or the spacing if larger, and within epsilon spacings of it
+  uint32_t ulps = 1024;
+  float epsilon = 2e-3f;
+  uint32_t threadCount = 0; // of the threaded backend, at least 2
+};
+
+// Step random cloths, materials and forces with the reference and with
+// every backend (orderings, phases on a pool, precisions) side by side,
+// comparing the positions after every step. Prints the largest divergence
+// of each backend and the first step past the bounds, and writes the
+// divergence at every step to output as CSV unless empty. A cloth with
+// slightly stiffer springs runs alongside and has to leave the bounds in
+// every case. Returns 1 if a backend left the bounds or that one did not, a
+// process exit code.
+int runVerification(const VerifySettings &settings, const std::string &output);
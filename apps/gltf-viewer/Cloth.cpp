@@ -0,0 +1,1275 @@
+#include "Cloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Colliders.hpp"
+#include "utils/WindField.hpp"
+#include "utils/simd.hpp"
+
+namespace {
+
+uint32_t tileParticlesOf(size_t particleCount)
+{
+  const size_t BLOCK = ClothLayout::TILE_SIZE * ClothLayout::TILE_SIZE;
+  const size_t share =
+      (particleCount / Cloth::MIN_TILES + BLOCK - 1) / BLOCK * BLOCK;
+  return uint32_t(std::clamp<size_t>(
+      share, Cloth::MIN_TILE_PARTICLES, Cloth::TILE_PARTICLES));
+}
+
+// Forces of a varying wind on count <= 4 particles at positions, in the
+// cloth space, sampling the field once for all of them. Only the listed
+// gusts are evaluated.
+void windForces(const WindParams &wind, const glm::vec3 *positions,
+    uint32_t count, const uint8_t *gusts, uint32_t gustCount,
+    glm::vec3 *forces)
+{
+  // Missing lanes repeat the last particle
+  alignas(16) float coordinates[3][4];
+  for (uint32_t lane = 0; lane < 4; ++lane) {
+    const glm::vec3 &position = positions[std::min(lane, count - 1)];
+    for (int c = 0; c < 3; ++c) {
+      coordinates[c][lane] = position[c];
+    }
+  }
+  const float4 x = float4::load(coordinates[0]);
+  const float4 y = float4::load(coordinates[1]);
+  const float4 z = float4::load(coordinates[2]);
+
+  const glm::mat4 &m = wind.toField;
+  float4 cell[3];
+  for (int c = 0; c < 3; ++c) {
+    cell[c] = float4(m[0][c]) * x + float4(m[1][c]) * y +
+              float4(m[2][c]) * z + float4(m[3][c]);
+  }
+  float4 v[3];
+  wind.field->sample4(cell[0], cell[1], cell[2], v[0], v[1], v[2]);
+
+  const glm::mat3 &f = wind.toForce;
+  float4 force[3];
+  for (int c = 0; c < 3; ++c) {
+    force[c] = float4(f[0][c]) * v[0] + float4(f[1][c]) * v[1] +
+               float4(f[2][c]) * v[2];
+  }
+  const float4 zero(0.f), one(1.f);
+  for (uint32_t i = 0; i < gustCount; ++i) {
+    const glm::vec4 &gust = wind.gusts[gusts[i]];
+    const float4 dx = cell[0] - float4(gust.x);
+    const float4 dy = cell[1] - float4(gust.y);
+    const float4 dz = cell[2] - float4(gust.z);
+    const float4 falloff = max(
+        one - (dx * dx + dy * dy + dz * dz) * float4(wind.gustInvRadius2),
+        zero);
+    const float4 weight = float4(gust.w) * falloff * falloff;
+    for (int c = 0; c < 3; ++c) {
+      force[c] = force[c] + weight * float4(wind.gustForce[c]);
+    }
+  }
+
+  alignas(16) float out[3][4];
+  for (int c = 0; c < 3; ++c) {
+    force[c].store(out[c]);
+  }
+  for (uint32_t lane = 0; lane < count; ++lane) {
+    forces[lane] = glm::vec3(out[0][lane], out[1][lane], out[2][lane]);
+  }
+}
+
+const uint8_t ALL_GUSTS[] = {0, 1, 2, 3};
+static_assert(sizeof(ALL_GUSTS) == WindParams::MAX_GUSTS,
+    "ALL_GUSTS lists every gust");
+
+// Force of a varying wind on the particle at position, in the cloth space
+inline glm::vec3 windForce(const WindParams &wind, const glm::vec3 &position)
+{
+  glm::vec3 force;
+  windForces(wind, &position, 1, ALL_GUSTS, wind.gustCount, &force);
+  return force;
+}
+
+// Lists in gusts the ones that may reach into the box from low to high,
+// bounding both by spheres in grid cells, and returns their count
+uint32_t reachingGusts(const WindParams &wind, const glm::vec3 &low,
+    const glm::vec3 &high, uint8_t *gusts)
+{
+  if (wind.gustInvRadius2 <= 0.f) {
+    std::copy(ALL_GUSTS, ALL_GUSTS + wind.gustCount, gusts);
+    return wind.gustCount;
+  }
+  const glm::vec3 center(wind.toField * glm::vec4(0.5f * (low + high), 1.f));
+  const float scale = std::max({glm::length(glm::vec3(wind.toField[0])),
+      glm::length(glm::vec3(wind.toField[1])),
+      glm::length(glm::vec3(wind.toField[2]))});
+  const float reach = 0.5f * glm::distance(low, high) * scale +
+                      1.f / std::sqrt(wind.gustInvRadius2);
+  uint32_t count = 0;
+  for (uint32_t g = 0; g < wind.gustCount; ++g) {
+    const glm::vec3 offset = center - glm::vec3(wind.gusts[g]);
+    if (glm::dot(offset, offset) < reach * reach) {
+      gusts[count++] = uint8_t(g);
+    }
+  }
+  return count;
+}
+
+// Drag and lift on a triangle of normal c, c being twice its area long, in
+// air flowing past it at u. The pressure pushes along the side of the normal
+// facing away from the air: its share along u is the drag, the rest the lift.
+inline glm::vec3 aerodynamicForce(
+    const AeroParams &aero, const glm::vec3 &c, const glm::vec3 &u)
+{
+  const float c2 = glm::dot(c, c);
+  const float u2 = glm::dot(u, u);
+  if (c2 <= 0.f || u2 <= 0.f) {
+    return glm::vec3(0.f);
+  }
+  // area * |u|^2 * cos(attack) = |un| * |u| / 2
+  const float un = glm::dot(u, c);
+  const float uLength = std::sqrt(u2);
+  const float invC = 1.f / std::sqrt(c2);
+  const float pressure = 0.5f * std::abs(un);
+  const float cosine = std::abs(un) * invC / uLength;
+  const glm::vec3 side = (un < 0.f ? -invC : invC) * c;
+  return pressure *
+         (aero.drag * u + aero.lift * (uLength * side - cosine * u));
+}
+
+// Link of the multigrid stencil tying a particle to its neighbour at offset
+inline uint32_t linkOf(const glm::ivec2 &offset)
+{
+  uint32_t l = 0;
+  while (Multigrid::LINK_OFFSETS[l] != offset) {
+    ++l;
+  }
+  return l;
+}
+
+} // namespace
+
+SpringModel parseSpringModel(const std::string &name)
+{
+  if (name == "offset") {
+    return SpringModel::RestOffset;
+  }
+  if (name == "length") {
+    return SpringModel::RestLength;
+  }
+  throw std::invalid_argument(
+      "Unknown spring model " + name + " (expected offset or length)");
+}
+
+const char *toString(SpringModel model)
+{
+  switch (model) {
+  case SpringModel::RestOffset:
+    return "offset";
+  case SpringModel::RestLength:
+    return "length";
+  }
+  return "unknown";
+}
+
+ClothPrecision parseClothPrecision(const std::string &name)
+{
+  if (name == "float") {
+    return ClothPrecision::Float;
+  }
+  if (name == "mixed") {
+    return ClothPrecision::Mixed;
+  }
+  if (name == "double") {
+    return ClothPrecision::Double;
+  }
+  throw std::invalid_argument("Unknown precision " + name +
+                              " (expected float, mixed or double)");
+}
+
+const char *toString(ClothPrecision precision)
+{
+  switch (precision) {
+  case ClothPrecision::Float:
+    return "float";
+  case ClothPrecision::Mixed:
+    return "mixed";
+  case ClothPrecision::Double:
+    return "double";
+  }
+  return "unknown";
+}
+
+Cloth::Cloth(uint32_t width, uint32_t height, float step, float mass,
+    ParticleOrdering ordering, SpringModel springModel,
+    ClothPrecision precision) :
+    m_layout(width, height, ordering),
+    m_springModel(springModel),
+    m_precision(precision),
+    m_mass(mass),
+    m_spacing(step),
+    m_tileParticles(tileParticlesOf(m_layout.size())),
+    m_springChunk(m_tileParticles * (SPRING_CHUNK / TILE_PARTICLES))
+{
+  if (width < 3 || height < 3) {
+    throw std::invalid_argument("Cloth must be at least 3x3 particles");
+  }
+
+  const size_t count = m_layout.size();
+  m_positions.resize(count);
+  m_speeds.assign(count, glm::vec3(0.f));
+  m_aeroForces.assign(count, glm::vec3(0.f));
+  m_invMasses.resize(count);
+  m_vertices.resize(count);
+
+  for (uint32_t i = 0; i < width; ++i) {
+    for (uint32_t j = 0; j < height; ++j) {
+      const uint32_t slot = m_layout.index(i, j);
+      ShapeVertex &vertex = m_vertices[slot];
+
+      vertex.texCoords.x = float(i) / float(width);
+      vertex.texCoords.y = float(j) / float(height);
+
+      vertex.normal = glm::vec3(0, 0, 1); // perpendicular with cloth
+
+      vertex.position =
+          glm::vec3(i - float(width) / 2., j - float(height) / 2., 0.) * step;
+
+      m_positions[slot] = vertex.position;
+
+      setPinned(i, j, i == 0); // Immovible extremity
+    }
+  }
+  if (m_precision != ClothPrecision::Float) {
+    m_precisePositions.assign(m_positions.begin(), m_positions.end());
+    m_preciseSpeeds.assign(count, glm::dvec3(0.));
+    m_preciseInvMasses.assign(m_invMasses.begin(), m_invMasses.end());
+  }
+
+  // Store the indexes
+  for (uint32_t i = 0; i < width - 1; ++i) {
+    for (uint32_t j = 0; j < height - 1; ++j) {
+      m_indexes.push_back(m_layout.index(i, j));
+      m_indexes.push_back(m_layout.index(i, j + 1));
+      m_indexes.push_back(m_layout.index(i + 1, j + 1));
+      m_indexes.push_back(m_layout.index(i, j));
+      m_indexes.push_back(m_layout.index(i + 1, j));
+      m_indexes.push_back(m_layout.index(i + 1, j + 1));
+    }
+  }
+  m_quadTriangles.assign(m_indexes.size() / 6, 3);
+
+  /// Structural Mesh + Diagonal Mesh
+  // For fixed Point
+  for (uint32_t j = 0; j < height - 1; ++j) {
+    // Horizontal
+    addSpring(0, j, 1, j, SpringFamily::Structural);
+    // Diagonal left-top corner to right-bottom corner
+    addSpring(0, j, 1, j + 1, SpringFamily::Shear);
+  }
+
+  // For internal
+  for (uint32_t i = 1; i < width - 1; ++i) {
+    for (uint32_t j = 0; j < height - 1; ++j) {
+      // Horizontal
+      addSpring(i, j, i + 1, j, SpringFamily::Structural);
+      // Verical
+      addSpring(i, j, i, j + 1, SpringFamily::Structural);
+      // Diagonal left-bottom corner to right-top corner
+      addSpring(i - 1, j + 1, i, j, SpringFamily::Shear);
+      // Diagonal left-top corner to right-bottom corner
+      addSpring(i, j, i + 1, j + 1, SpringFamily::Shear);
+    }
+  }
+
+  // For extrema
+  for (uint32_t i = 0; i < width - 1; ++i) {
+    // Horizontal
+    addSpring(i, height - 1, i + 1, height - 1, SpringFamily::Structural);
+  }
+
+  for (uint32_t j = 0; j < height - 1; ++j) {
+    // Vertical
+    addSpring(width - 1, j, width - 1, j + 1, SpringFamily::Structural);
+    // Diagonal left-bottom corner to right-top corner
+    addSpring(width - 2, j + 1, width - 1, j, SpringFamily::Shear);
+  }
+
+  /// Bridge Mesh
+  for (uint32_t i = 0; i < width - 2; ++i) {
+    for (uint32_t j = 0; j < height - 2; ++j) {
+      if (i > 0) { // no need for fixed points
+        // Vertical Bridge
+        addSpring(i, j, i, j + 2, SpringFamily::Bend);
+      }
+      // Horizontal Bridge
+      addSpring(i, j, i + 2, j, SpringFamily::Bend);
+    }
+  }
+
+  sortSprings();
+  buildTiles();
+  buildMeshlets();
+
+  m_triangleRadius = 0.f;
+  for (size_t t = 0; t < m_indexes.size(); t += 3) {
+    const glm::vec3 centroid = (m_positions[m_indexes[t]] +
+                                   m_positions[m_indexes[t + 1]] +
+                                   m_positions[m_indexes[t + 2]]) /
+                               3.f;
+    for (size_t k = 0; k < 3; ++k) {
+      m_triangleRadius = std::max(m_triangleRadius,
+          glm::distance(centroid, m_positions[m_indexes[t + k]]));
+    }
+  }
+  // A quad overlaps about four cells
+  m_triangleHash.reset(2 * triangleCount());
+  m_collisionOffsets.assign(count, glm::vec3(0.f));
+
+  // Distinct masses and spring counts, pinned particles counted as free
+  for (uint32_t i = 0; i < width; ++i) {
+    for (uint32_t j = 0; j < height; ++j) {
+      const uint32_t slot = m_layout.index(i, j);
+      StiffnessRate rate{
+          i == width - 1 ? 1.f / (m_mass * 0.9f) : 1.f / m_mass, {}};
+      for (uint32_t e = m_incidenceOffsets[slot];
+           e < m_incidenceEnds[slot]; ++e) {
+        ++rate.springs[m_springFamily[m_incidence[e] >> 1]];
+      }
+      if (std::find(m_stiffnessRates.begin(), m_stiffnessRates.end(), rate) ==
+          m_stiffnessRates.end()) {
+        m_stiffnessRates.push_back(rate);
+      }
+    }
+  }
+}
+
+float Cloth::stableStep(const StepParams &params) const
+{
+  // Gershgorin: no mode of a particle oscillates faster than the sum of the
+  // stiffness of its springs, counted twice, over its mass. Symplectic Euler
+  // stays stable while h^2 w^2 + 2 h c <= 4, c the damping rate.
+  float step = std::numeric_limits<float>::max();
+  for (const auto &rate : m_stiffnessRates) {
+    float w2 = 0.f, c = 0.f;
+    for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+      w2 += 2.f * rate.invMass * rate.springs[f] * params.springs[f].rigidity;
+      c += 2.f * rate.invMass * rate.springs[f] * params.springs[f].viscosity;
+    }
+    if (w2 > 0.f) {
+      step = std::min(step, (std::sqrt(c * c + 4.f * w2) - c) / w2);
+    } else if (c > 0.f) {
+      step = std::min(step, 2.f / c);
+    }
+  }
+  return step;
+}
+
+float Cloth::kineticEnergy() const
+{
+  float energy = 0.f;
+  for (const auto &bounds : m_tileBounds) {
+    energy += bounds.energy;
+  }
+  return energy;
+}
+
+Cloth::Telemetry Cloth::telemetry() const
+{
+  Telemetry telemetry{};
+  for (const auto &bounds : m_tileBounds) {
+    telemetry.kineticEnergy += bounds.energy;
+    telemetry.maxSpeed = std::max(telemetry.maxSpeed, bounds.speed);
+  }
+
+  float strainSum[SPRING_FAMILY_COUNT] = {};
+  std::fill(std::begin(telemetry.maxStrain), std::end(telemetry.maxStrain),
+      std::numeric_limits<float>::lowest());
+  for (const auto &stats : m_springStats) {
+    telemetry.potentialEnergy += stats.potential;
+    for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+      telemetry.maxStrain[f] =
+          std::max(telemetry.maxStrain[f], stats.maxStrain[f]);
+      strainSum[f] += stats.strainSum[f];
+    }
+  }
+  for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+    if (m_familySprings[f] == 0) {
+      telemetry.maxStrain[f] = 0.f;
+    }
+    telemetry.meanStrain[f] =
+        m_familySprings[f] > 0 ? strainSum[f] / m_familySprings[f] : 0.f;
+  }
+  return telemetry;
+}
+
+void Cloth::saveState(State &state) const
+{
+  state.positions = m_positions;
+  state.speeds = m_speeds;
+  state.precisePositions = m_precisePositions;
+  state.preciseSpeeds = m_preciseSpeeds;
+  state.tileBounds = m_tileBounds;
+}
+
+void Cloth::restoreState(const State &state)
+{
+  m_positions = state.positions;
+  m_speeds = state.speeds;
+  m_precisePositions = state.precisePositions;
+  m_preciseSpeeds = state.preciseSpeeds;
+  m_tileBounds = state.tileBounds;
+  for (auto &springs : m_tears) {
+    springs.clear(); // found by the steps rolled back
+  }
+  for (size_t p = 0; p < m_positions.size(); ++p) {
+    m_vertices[p].position = m_positions[p];
+  }
+}
+
+void Cloth::stop()
+{
+  std::fill(m_speeds.begin(), m_speeds.end(), glm::vec3(0.f));
+  std::fill(m_preciseSpeeds.begin(), m_preciseSpeeds.end(), glm::dvec3(0.));
+  std::fill(m_gridDeltas.begin(), m_gridDeltas.end(), glm::vec3(0.f));
+  for (auto &bounds : m_tileBounds) {
+    bounds.travel = 0.f;
+    bounds.speed = 0.f;
+    bounds.energy = 0.f;
+  }
+}
+
+void Cloth::setPinned(uint32_t i, uint32_t j, bool pinned)
+{
+  const uint32_t slot = m_layout.index(i, j);
+  if (pinned) {
+    m_invMasses[slot] = 0.f;
+    m_speeds[slot] = glm::vec3(0.f);
+  } else if (i == m_layout.width() - 1) { // Extremity
+    m_invMasses[slot] = 1.f / (m_mass * 0.9f);
+  } else { // Inside
+    m_invMasses[slot] = 1.f / m_mass;
+  }
+  if (!m_preciseInvMasses.empty()) {
+    m_preciseInvMasses[slot] = m_invMasses[slot];
+    m_preciseSpeeds[slot] = m_speeds[slot];
+  }
+  m_multigrid = Multigrid(); // rebuilt by the next implicit step
+  if (!m_tileSleep.empty()) {
+    wake(slot / m_tileParticles);
+  }
+}
+
+void Cloth::movePinned(uint32_t slot, const glm::vec3 &target, float h)
+{
+  m_speeds[slot] = (target - m_positions[slot]) / h;
+  takePreciseChanges(slot, slot + 1);
+  wake(slot / m_tileParticles);
+}
+
+void Cloth::tear()
+{
+  for (auto &springs : m_tears) {
+    if (springs.empty()) {
+      continue;
+    }
+    // Substeps find the same springs again. Removing the last ones first
+    // only ever moves springs already kept.
+    std::sort(springs.begin(), springs.end(), std::greater<uint32_t>());
+    springs.erase(std::unique(springs.begin(), springs.end()), springs.end());
+    for (const uint32_t s : springs) {
+      removeSpring(s);
+    }
+    springs.clear();
+  }
+}
+
+void Cloth::takeTornTriangles(std::vector<uint32_t> &triangles)
+{
+  triangles.clear();
+  triangles.swap(m_tornTriangles);
+  std::sort(triangles.begin(), triangles.end());
+}
+
+// The last spring of the chunk takes the place of s, so that every tile keeps
+// its springs in the chunks it was scheduled after
+void Cloth::removeSpring(uint32_t s)
+{
+  const uint32_t a = m_springA[s];
+  const uint32_t b = m_springB[s];
+  const glm::ivec2 cellA(m_layout.cell(a));
+  const glm::ivec2 cellB(m_layout.cell(b));
+
+  // Quad q has corner (i, j) with q = i * (height - 1) + j, its triangles
+  // 2q and 2q + 1 are (i, j), (i, j + 1), (i + 1, j + 1) and (i, j),
+  // (i + 1, j), (i + 1, j + 1)
+  const glm::ivec2 low = glm::min(cellA, cellB);
+  const glm::ivec2 offset = glm::abs(cellB - cellA);
+  const uint32_t quadRows = m_layout.height() - 1;
+  const uint32_t quadColumns = m_layout.width() - 1;
+  const auto quad = [&](int i, int j) { return uint32_t(i) * quadRows + j; };
+  if (offset == glm::ivec2(1, 0)) { // Horizontal, between two quads
+    if (uint32_t(low.y) < quadRows) {
+      dropTriangle(2 * quad(low.x, low.y) + 1);
+    }
+    if (low.y > 0) {
+      dropTriangle(2 * quad(low.x, low.y - 1));
+    }
+  } else if (offset == glm::ivec2(0, 1)) { // Vertical
+    if (uint32_t(low.x) < quadColumns) {
+      dropTriangle(2 * quad(low.x, low.y));
+    }
+    if (low.x > 0) {
+      dropTriangle(2 * quad(low.x - 1, low.y) + 1);
+    }
+  } else if (offset == glm::ivec2(1, 1)) { // Either diagonal of a quad
+    const uint32_t q = quad(low.x, low.y);
+    dropTriangle(2 * q);
+    dropTriangle(2 * q + 1);
+  }
+
+  if (!m_multigrid.empty()) {
+    m_multigrid.removeLink(
+        cellA.x + cellA.y * m_layout.width(), linkOf(cellB - cellA));
+  }
+
+  const auto find = [this](uint32_t p, uint32_t entry) {
+    return std::find(&m_incidence[m_incidenceOffsets[p]],
+        &m_incidence[0] + m_incidenceEnds[p], entry);
+  };
+  *find(a, s << 1) = m_incidence[--m_incidenceEnds[a]];
+  *find(b, (s << 1) | 1) = m_incidence[--m_incidenceEnds[b]];
+  --m_familySprings[m_springFamily[s]];
+
+  const uint32_t chunk = s / m_springChunk;
+  const uint32_t last = chunk * m_springChunk + --m_chunkSprings[chunk];
+  if (last == s) {
+    return;
+  }
+  *find(m_springA[last], last << 1) = s << 1;
+  *find(m_springB[last], (last << 1) | 1) = (s << 1) | 1;
+  std::swap(m_springA[s], m_springA[last]);
+  std::swap(m_springB[s], m_springB[last]);
+  std::swap(m_springFamily[s], m_springFamily[last]);
+  std::swap(m_springRestLength[s], m_springRestLength[last]);
+  if (m_springModel == SpringModel::RestOffset) {
+    std::swap(m_springRest[s], m_springRest[last]);
+  }
+}
+
+// A torn triangle collapses on its first corner, drawing nothing, so that the
+// index buffer is patched in place
+void Cloth::dropTriangle(uint32_t triangle)
+{
+  uint8_t &whole = m_quadTriangles[triangle / 2];
+  const uint8_t bit = uint8_t(1u << (triangle % 2));
+  if (!(whole & bit)) {
+    return;
+  }
+  whole &= uint8_t(~bit);
+  uint32_t *corners = &m_indexes[3 * triangle];
+  corners[1] = corners[2] = corners[0];
+  m_tornTriangles.push_back(triangle);
+}
+
+void Cloth::addSpring(uint32_t i1, uint32_t j1, uint32_t i2, uint32_t j2,
+    SpringFamily family)
+{
+  const uint32_t a = m_layout.index(i1, j1);
+  const uint32_t b = m_layout.index(i2, j2);
+  m_springA.push_back(a);
+  m_springB.push_back(b);
+  m_springFamily.push_back(uint8_t(family));
+  if (m_springModel == SpringModel::RestOffset) {
+    m_springRest.push_back(m_positions[b] - m_positions[a]);
+  }
+  m_springRestLength.push_back(glm::length(m_positions[b] - m_positions[a]));
+  ++m_familySprings[uint32_t(family)];
+}
+
+// Sweep the springs in the storage order of their endpoints so that the
+// spring pass walks the particle arrays the same way the layout does
+void Cloth::sortSprings()
+{
+  std::vector<uint32_t> order(m_springA.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+    const auto l = std::minmax(m_springA[lhs], m_springB[lhs]);
+    const auto r = std::minmax(m_springA[rhs], m_springB[rhs]);
+    return l < r;
+  });
+
+  const auto permute = [&](auto &values) {
+    if (values.empty()) {
+      return;
+    }
+    auto sorted = values;
+    for (size_t s = 0; s < order.size(); ++s) {
+      sorted[s] = values[order[s]];
+    }
+    values.swap(sorted);
+  };
+  permute(m_springA);
+  permute(m_springB);
+  permute(m_springFamily);
+  permute(m_springRest);
+  permute(m_springRestLength);
+}
+
+void Cloth::buildTiles()
+{
+  const size_t particleCount = m_positions.size();
+  const size_t springCount = m_springA.size();
+  m_springForces.assign(springCount, glm::vec3(0.f));
+  if (m_precision == ClothPrecision::Double) {
+    m_preciseForces.assign(springCount, glm::dvec3(0.));
+  }
+  m_springStats.assign(springChunkCount(), SpringStats{});
+
+  m_incidenceOffsets.assign(particleCount + 1, 0);
+  for (size_t s = 0; s < springCount; ++s) {
+    ++m_incidenceOffsets[m_springA[s] + 1];
+    ++m_incidenceOffsets[m_springB[s] + 1];
+  }
+  std::partial_sum(m_incidenceOffsets.begin(), m_incidenceOffsets.end(),
+      m_incidenceOffsets.begin());
+
+  m_incidence.resize(2 * springCount);
+  std::vector<uint32_t> fill(
+      m_incidenceOffsets.begin(), m_incidenceOffsets.end() - 1);
+  for (uint32_t s = 0; s < springCount; ++s) {
+    m_incidence[fill[m_springA[s]]++] = s << 1;
+    m_incidence[fill[m_springB[s]]++] = (s << 1) | 1;
+  }
+  m_incidenceEnds.assign(
+      m_incidenceOffsets.begin() + 1, m_incidenceOffsets.end());
+
+  m_chunkSprings.clear();
+  for (size_t begin = 0; begin < springCount; begin += m_springChunk) {
+    m_chunkSprings.push_back(
+        uint32_t(std::min<size_t>(m_springChunk, springCount - begin)));
+  }
+  m_tears.assign(springChunkCount(), {});
+
+  const uint32_t width = m_layout.width();
+  const uint32_t height = m_layout.height();
+  m_tiles.clear();
+  m_tileBounds.clear();
+  for (uint32_t begin = 0; begin < particleCount; begin += m_tileParticles) {
+    Tile tile;
+    tile.begin = begin;
+    tile.end =
+        uint32_t(std::min<size_t>(begin + m_tileParticles, particleCount));
+    tile.firstSpringChunk = springChunkCount();
+    tile.lastSpringChunk = 0;
+    const uint32_t index = uint32_t(m_tiles.size());
+
+    for (uint32_t p = tile.begin; p < tile.end; ++p) {
+      for (uint32_t e = m_incidenceOffsets[p]; e < m_incidenceEnds[p];
+           ++e) {
+        const uint32_t s = m_incidence[e] >> 1;
+        const uint32_t chunk = s / m_springChunk;
+        tile.firstSpringChunk = std::min(tile.firstSpringChunk, chunk);
+        tile.lastSpringChunk = std::max(tile.lastSpringChunk, chunk);
+        const uint32_t other =
+            ((m_incidence[e] & 1) ? m_springA[s] : m_springB[s]) /
+            m_tileParticles;
+        if (other != index) {
+          tile.coupled.push_back(other);
+        }
+      }
+
+      const glm::uvec2 cell = m_layout.cell(p);
+      for (int di = -1; di <= 1; ++di) {
+        for (int dj = -1; dj <= 1; ++dj) {
+          const int i = int(cell.x) + di;
+          const int j = int(cell.y) + dj;
+          if (i < 0 || j < 0 || i >= int(width) || j >= int(height)) {
+            continue;
+          }
+          const uint32_t neighbor = m_layout.index(i, j) / m_tileParticles;
+          if (neighbor != index &&
+              std::find(tile.neighbors.begin(), tile.neighbors.end(),
+                  neighbor) == tile.neighbors.end()) {
+            tile.neighbors.push_back(neighbor);
+          }
+        }
+      }
+    }
+    TileBounds bounds{glm::vec3(std::numeric_limits<float>::max()),
+        glm::vec3(std::numeric_limits<float>::lowest()), 0.f, 0.f, 0.f};
+    for (uint32_t p = tile.begin; p < tile.end; ++p) {
+      bounds.low = glm::min(bounds.low, m_positions[p]);
+      bounds.high = glm::max(bounds.high, m_positions[p]);
+    }
+    m_tileBounds.push_back(bounds);
+    std::sort(tile.coupled.begin(), tile.coupled.end());
+    tile.coupled.erase(std::unique(tile.coupled.begin(), tile.coupled.end()),
+        tile.coupled.end());
+    m_tiles.push_back(std::move(tile));
+  }
+
+  m_tileSleep.assign(m_tiles.size(), TileSleep{false, 0, glm::vec3(0.f)});
+  m_chunkTiles.assign(springChunkCount(), {});
+  for (uint32_t t = 0; t < m_tiles.size(); ++t) {
+    for (uint32_t chunk = m_tiles[t].firstSpringChunk;
+         chunk <= m_tiles[t].lastSpringChunk; ++chunk) {
+      m_chunkTiles[chunk].push_back(t);
+    }
+  }
+  m_chunkAsleep.assign(springChunkCount(), 0);
+}
+
+void Cloth::updateSleep(const StepParams &params)
+{
+  const float h = params.h;
+  const bool enabled = params.sleepSpeed > 0.f && !params.solver.implicit;
+
+  // Forces per step do not depend on h, nor does the material
+  const auto externalForce = [&](uint32_t tile) {
+    glm::vec3 force = params.force;
+    if (params.wind.field) {
+      const TileBounds &bounds = m_tileBounds[tile];
+      force += windForce(params.wind, 0.5f * (bounds.low + bounds.high));
+    }
+    return h * force;
+  };
+  const auto differs = [](float a, float b) {
+    return std::abs(a - b) > 1e-3f * std::max(std::abs(a), std::abs(b));
+  };
+  bool changed =
+      glm::distance(params.aero.air, m_sleepAir) > params.sleepSpeed;
+  for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+    changed |= differs(params.springs[f].rigidity * h * h,
+                   m_sleepSprings[f].rigidity) ||
+               differs(params.springs[f].viscosity * h,
+                   m_sleepSprings[f].viscosity);
+  }
+  if (changed) {
+    for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+      m_sleepSprings[f] = {params.springs[f].rigidity * h * h,
+          params.springs[f].viscosity * h};
+    }
+    m_sleepAir = params.aero.air;
+  }
+
+  for (uint32_t tile = 0; tile < m_tiles.size(); ++tile) {
+    TileSleep &sleep = m_tileSleep[tile];
+    if (!enabled || changed) {
+      sleep.asleep = false;
+      sleep.stillSteps = 0;
+    } else if (sleep.asleep) {
+      bool woken = glm::length(externalForce(tile) - sleep.force) / m_mass >
+                   params.sleepSpeed;
+      for (const uint32_t other : m_tiles[tile].coupled) {
+        woken |= !m_tileSleep[other].asleep &&
+                 m_tileBounds[other].speed >= params.sleepSpeed;
+      }
+      if (woken) {
+        sleep.asleep = false;
+        sleep.stillSteps = 0;
+      }
+    } else if (sleep.stillSteps >= SLEEP_STEPS) {
+      const Tile &range = m_tiles[tile];
+      std::fill(m_speeds.begin() + range.begin, m_speeds.begin() + range.end,
+          glm::vec3(0.f));
+      if (!m_preciseSpeeds.empty()) {
+        std::fill(m_preciseSpeeds.begin() + range.begin,
+            m_preciseSpeeds.begin() + range.end, glm::dvec3(0.));
+      }
+      TileBounds &bounds = m_tileBounds[tile];
+      bounds.travel = bounds.speed = bounds.energy = 0.f;
+      sleep.asleep = true;
+      sleep.force = externalForce(tile);
+    }
+  }
+
+  for (uint32_t chunk = 0; chunk < springChunkCount(); ++chunk) {
+    m_chunkAsleep[chunk] = std::all_of(m_chunkTiles[chunk].begin(),
+        m_chunkTiles[chunk].end(),
+        [&](uint32_t tile) { return m_tileSleep[tile].asleep; });
+  }
+}
+
+void Cloth::wake(uint32_t tile)
+{
+  m_tileSleep[tile].asleep = false;
+  m_tileSleep[tile].stillSteps = 0;
+  for (uint32_t chunk = m_tiles[tile].firstSpringChunk;
+       chunk <= m_tiles[tile].lastSpringChunk; ++chunk) {
+    m_chunkAsleep[chunk] = 0;
+  }
+}
+
+uint32_t Cloth::asleepCount() const
+{
+  return uint32_t(std::count_if(m_tileSleep.begin(), m_tileSleep.end(),
+      [](const TileSleep &sleep) { return sleep.asleep; }));
+}
+
+void Cloth::step(const StepParams &params, ThreadPool *pool)
+{
+  tear();
+  updateSleep(params);
+  for (uint32_t chunk = 0; chunk < springChunkCount(); ++chunk) {
+    computeSpringForces(params, chunk);
+  }
+  if (params.solver.implicit) {
+    solveImplicit(params, pool);
+  }
+  for (uint32_t tile = 0; tile < m_tiles.size(); ++tile) {
+    integrate(params, tile);
+  }
+  if (params.thickness > 0.f) {
+    selfCollide(params);
+  }
+}
+
+void Cloth::computeSpringForces(const StepParams &params, uint32_t chunk)
+{
+  if (m_chunkAsleep[chunk]) {
+    return;
+  }
+  const size_t begin = size_t(chunk) * m_springChunk;
+  const size_t end = begin + m_chunkSprings[chunk];
+  SpringStats &stats = m_springStats[chunk];
+
+  if (params.tearStrain > 0.f) {
+    // Compared squared, the spring passes need no length
+    const float limit = (1.f + params.tearStrain) * (1.f + params.tearStrain);
+    for (size_t s = begin; s < end; ++s) {
+      const glm::vec3 d = m_positions[m_springB[s]] - m_positions[m_springA[s]];
+      const float rest = m_springRestLength[s];
+      if (glm::dot(d, d) > limit * rest * rest) {
+        m_tears[chunk].push_back(uint32_t(s));
+      }
+    }
+  }
+  if (params.telemetry) {
+    stats = SpringStats{};
+    std::fill(std::begin(stats.maxStrain), std::end(stats.maxStrain),
+        std::numeric_limits<float>::lowest());
+  }
+
+  // Springs: raideur * allongement + viscosité
+  SpringStats *measured = params.telemetry ? &stats : nullptr;
+  switch (m_precision) {
+  case ClothPrecision::Float:
+    applySprings<FloatKernel>(
+        params, m_springForces.data(), begin, end, measured);
+    break;
+  case ClothPrecision::Mixed:
+    applySprings<MixedKernel>(
+        params, m_springForces.data(), begin, end, measured);
+    break;
+  case ClothPrecision::Double:
+    applySprings<DoubleKernel>(
+        params, m_preciseForces.data(), begin, end, measured);
+    break;
+  }
+}
+
+template <typename Kernel> typename Kernel::Particles Cloth::kernelParticles()
+{
+  if constexpr (std::is_same<typename Kernel::Vec, glm::vec3>::value) {
+    return {m_positions.data(), m_speeds.data(), m_invMasses.data(),
+        m_incidenceOffsets.data(), m_incidenceEnds.data(),
+        m_incidence.data()};
+  } else {
+    return {m_precisePositions.data(), m_preciseSpeeds.data(),
+        m_preciseInvMasses.data(), m_incidenceOffsets.data(),
+        m_incidenceEnds.data(), m_incidence.data()};
+  }
+}
+
+template <typename Kernel>
+void Cloth::applySprings(const StepParams &params,
+    typename Kernel::ForceVec *forces, size_t begin, size_t end,
+    SpringStats *stats)
+{
+  const typename Kernel::Springs springs{m_springA.data(), m_springB.data(),
+      m_springFamily.data(), m_springRest.data(), m_springRestLength.data(),
+      forces};
+  if (m_springModel == SpringModel::RestOffset) {
+    Kernel::applyRestOffsetSprings(
+        params, kernelParticles<Kernel>(), springs, begin, end, stats);
+  } else {
+    Kernel::applyRestLengthSprings(
+        params, kernelParticles<Kernel>(), springs, begin, end, stats);
+  }
+}
+
+// Rounds the particles stepped at a higher precision into m_positions and
+// m_speeds
+void Cloth::integrateBlock(const StepParams &params,
+    const glm::vec3 *external, uint32_t begin, uint32_t end)
+{
+  switch (m_precision) {
+  case ClothPrecision::Float:
+    FloatKernel::integrate(params, kernelParticles<FloatKernel>(),
+        m_springForces.data(), external, begin, end);
+    return;
+  case ClothPrecision::Mixed:
+    MixedKernel::integrate(params, kernelParticles<MixedKernel>(),
+        m_springForces.data(), external, begin, end);
+    break;
+  case ClothPrecision::Double:
+    DoubleKernel::integrate(params, kernelParticles<DoubleKernel>(),
+        m_preciseForces.data(), external, begin, end);
+    break;
+  }
+  for (uint32_t p = begin; p < end; ++p) {
+    m_positions[p] = m_precisePositions[p];
+    m_speeds[p] = m_preciseSpeeds[p];
+  }
+}
+
+void Cloth::takePreciseChanges(uint32_t begin, uint32_t end)
+{
+  if (m_precision == ClothPrecision::Float) {
+    return;
+  }
+  for (uint32_t p = begin; p < end; ++p) {
+    if (m_positions[p] != glm::vec3(m_precisePositions[p])) {
+      m_precisePositions[p] = m_positions[p];
+    }
+    if (m_speeds[p] != glm::vec3(m_preciseSpeeds[p])) {
+      m_preciseSpeeds[p] = m_speeds[p];
+    }
+  }
+}
+
+// Leapfrog, gathering the forces of the springs of each particle unless an
+// implicit solve already updated the speeds. Obstacles are resolved in the
+// same loop, four particles at a time, for tiles that may reach one.
+void Cloth::integrate(const StepParams &params, uint32_t tile)
+{
+  if (m_tileSleep[tile].asleep) {
+    return;
+  }
+  const float h = params.h;
+  const Tile &range = m_tiles[tile];
+  TileBounds &bounds = m_tileBounds[tile];
+
+  // A tile can't leave its last box by much more than it moved then
+  const ColliderSet *colliders = params.colliders;
+  const float reach = 2.f * bounds.travel;
+  const bool near =
+      colliders && colliders->overlaps(bounds.low - reach, bounds.high + reach);
+
+  glm::vec3 low(std::numeric_limits<float>::max());
+  glm::vec3 high(std::numeric_limits<float>::lowest());
+  float travel2 = 0.f;
+  float energy = 0.f;
+
+  // Gusts are culled once for the whole tile, which moved about as far as
+  // it did last step
+  const bool windy = params.wind.field && !params.solver.implicit;
+  uint8_t gusts[WindParams::MAX_GUSTS];
+  uint32_t gustCount = 0;
+  if (windy) {
+    const float margin = reach + params.thickness;
+    gustCount = reachingGusts(
+        params.wind, bounds.low - margin, bounds.high + margin, gusts);
+  }
+  glm::vec3 wind[4] = {};
+  glm::vec3 external[4];
+
+  for (uint32_t block = range.begin; block < range.end; block += 4) {
+    const uint32_t blockEnd = std::min(block + 4, range.end);
+    if (windy) {
+      windForces(params.wind, &m_positions[block], blockEnd - block, gusts,
+          gustCount, wind);
+    }
+    if (!params.solver.implicit) {
+      for (uint32_t p = block; p < blockEnd; ++p) {
+        external[p - block] = params.force + m_aeroForces[p] + wind[p - block];
+      }
+    }
+    integrateBlock(params, external, block, blockEnd);
+
+    if (near) {
+      colliders->resolve(&m_positions[block], &m_speeds[block],
+          &m_invMasses[block], blockEnd - block);
+      takePreciseChanges(block, blockEnd);
+    }
+
+    for (uint32_t p = block; p < blockEnd; ++p) {
+      m_vertices[p].position = m_positions[p];
+      low = glm::min(low, m_positions[p]);
+      high = glm::max(high, m_positions[p]);
+      const float speed2 = glm::dot(m_speeds[p], m_speeds[p]);
+      travel2 = std::max(travel2, speed2);
+      energy += m_invMasses[p] > 0.f ? speed2 / m_invMasses[p] : 0.f;
+    }
+  }
+
+  // Moved further than predicted, resolve after the fact
+  if (!near && colliders && colliders->overlaps(low, high)) {
+    for (uint32_t block = range.begin; block < range.end; block += 4) {
+      const uint32_t blockEnd = std::min(block + 4, range.end);
+      colliders->resolve(&m_positions[block], &m_speeds[block],
+          &m_invMasses[block], blockEnd - block);
+      takePreciseChanges(block, blockEnd);
+      for (uint32_t p = block; p < blockEnd; ++p) {
+        m_vertices[p].position = m_positions[p];
+        low = glm::min(low, m_positions[p]);
+        high = glm::max(high, m_positions[p]);
+      }
+    }
+  }
+
+  const float speed = std::sqrt(travel2);
+  bounds = TileBounds{low, high, h * speed, speed, 0.5f * energy};
+  TileSleep &sleep = m_tileSleep[tile];
+  sleep.stillSteps = speed < params.sleepSpeed ? sleep.stillSteps + 1 : 0;
+}
+
+void Cloth::buildMultigrid()
+{
+  const uint32_t width = m_layout.width();
+  const uint32_t height = m_layout.height();
+  const size_t count = size_t(width) * height;
+  m_gridSlots.resize(count);
+  std::vector<float> masses(count);
+  for (uint32_t j = 0; j < height; ++j) {
+    for (uint32_t i = 0; i < width; ++i) {
+      const uint32_t slot = m_layout.index(i, j);
+      m_gridSlots[i + size_t(j) * width] = slot;
+      masses[i + size_t(j) * width] =
+          isPinned(slot) ? 0.f : 1.f / m_invMasses[slot];
+    }
+  }
+
+  // Both ends of every spring see each other
+  std::vector<uint16_t> links(count, 0);
+  for (uint32_t chunk = 0; chunk < springChunkCount(); ++chunk) {
+    const size_t begin = size_t(chunk) * m_springChunk;
+    for (size_t s = begin; s < begin + m_chunkSprings[chunk]; ++s) {
+      const glm::ivec2 a(m_layout.cell(m_springA[s]));
+      const glm::ivec2 b(m_layout.cell(m_springB[s]));
+      const uint32_t l = linkOf(b - a);
+      links[a.x + size_t(a.y) * width] |= uint16_t(1u << l);
+      links[b.x + size_t(b.y) * width] |= uint16_t(1u << (l ^ 1));
+    }
+  }
+
+  m_multigrid.reset(width, height, links, masses);
+  m_gridSpeeds.assign(count, glm::vec3(0.f));
+  m_gridRhs.assign(count, glm::vec3(0.f));
+  m_gridDeltas.assign(count, glm::vec3(0.f));
+}
+
+void Cloth::solveImplicit(const StepParams &params, ThreadPool *pool)
+{
+  if (m_multigrid.empty()) {
+    buildMultigrid();
+  }
+
+  const float h = params.h;
+  float weights[SPRING_FAMILY_COUNT], stiffness[SPRING_FAMILY_COUNT];
+  for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+    stiffness[f] = h * h * params.springs[f].rigidity;
+    weights[f] = stiffness[f] + h * params.springs[f].viscosity;
+  }
+
+  for (size_t n = 0; n < m_gridSlots.size(); ++n) {
+    m_gridSpeeds[n] = m_speeds[m_gridSlots[n]];
+  }
+  m_multigrid.apply(stiffness, 0.f, m_gridSpeeds, m_gridRhs, pool);
+  glm::vec3 wind[4] = {};
+  for (size_t n = 0; n < m_gridSlots.size(); ++n) {
+    const uint32_t p = m_gridSlots[n];
+    // Four particles of the grid at a time, in no particular tile
+    const size_t lane = n & 3;
+    if (params.wind.field && lane == 0) {
+      const uint32_t count =
+          uint32_t(std::min<size_t>(4, m_gridSlots.size() - n));
+      glm::vec3 positions[4];
+      for (uint32_t i = 0; i < count; ++i) {
+        positions[i] = m_positions[m_gridSlots[n + i]];
+      }
+      windForces(params.wind, positions, count, ALL_GUSTS,
+          params.wind.gustCount, wind);
+    }
+    glm::vec3 force = params.force + m_aeroForces[p] + wind[lane];
+    for (uint32_t e = m_incidenceOffsets[p]; e < m_incidenceEnds[p];
+         ++e) {
+      const uint32_t s = m_incidence[e] >> 1;
+      const glm::vec3 f = m_preciseForces.empty()
+                              ? m_springForces[s]
+                              : glm::vec3(m_preciseForces[s]);
+      force += (m_incidence[e] & 1) ? -f : f;
+    }
+    m_gridRhs[n] = h * force - m_gridRhs[n];
+  }
+
+  // The last change of speed is a fair guess for the next one
+  m_lastSolve = m_multigrid.solve(
+      params.solver, weights, m_gridRhs, m_gridDeltas, pool);
+  for (size_t n = 0; n < m_gridSlots.size(); ++n) {
+    const uint32_t p = m_gridSlots[n];
+    if (isPinned(p)) {
+      continue;
+    }
+    if (m_precision == ClothPrecision::Float) {
+      m_speeds[p] += m_gridDeltas[n];
+    } else {
+      m_preciseSpeeds[p] += glm::dvec3(m_gridDeltas[n]);
+      m_speeds[p] = m_preciseSpeeds[p];
+    }
+  }
+}
+
+void Cloth::buildMeshlets()
+{
+  const uint32_t quadRows = m_layout.height() - 1;
+  const uint32_t quads = (m_layout.width() - 1) * quadRows;
+  m_meshlets.clear();
+  for (uint32_t first = 0; first < quads; first += MESHLET_QUADS) {
+    const uint32_t last = std::min(first + MESHLET_QUADS, quads);
+    Meshlet meshlet{2 * first, 2 * (last - first), {}, {}, {}};
+    for (uint32_t q = first; q < last; ++q) {
+      for (uint32_t corner = 0; corner < 4; ++corner) {
+        const uint32_t tile =
+            m_layout.index(q / quadRows + corner / 2,
+                q % quadRows + corner % 2) /
+            m_tileParticles;
+        if (std::find(meshlet.tiles.begin(), meshlet.tiles.end(), tile) ==
+            meshlet.tiles.end()) {
+          meshlet.tiles.push_back(tile);
+        }
+      }
+    }
+    refitMeshlet(meshlet);
+
+    Tile &owner = m_tiles[meshlet.tiles.front()];
+    owner.meshlets.push_back(uint32_t(m_meshlets.size()));
+    for (const uint32_t tile : meshlet.tiles) {
+      if (&m_tiles[tile] != &owner &&
+          std::find(owner.neighbors.begin(), owner.neighbors.end(), tile) ==
+              owner.neighbors.end()) {
+        owner.neighbors.push_back(tile);
+      }
+    }
+    m_meshlets.push_back(std::move(meshlet));
+  }
+}
+
+void Cloth::refitMeshlet(Meshlet &meshlet) const
+{
+  const uint32_t quadRows = m_layout.height() - 1;
+  glm::vec3 low(std::numeric_limits<float>::max());
+  glm::vec3 high(std::numeric_limits<float>::lowest());
+  const uint32_t first = meshlet.firstTriangle / 2;
+  const uint32_t last = first + meshlet.triangleCount / 2;
+  const auto add = [&](uint32_t i, uint32_t j) {
+    const glm::vec3 &p = m_positions[m_layout.index(i, j)];
+    low = glm::min(low, p);
+    high = glm::max(high, p);
+  };
+  // Corners at row j + 1 of a quad are those at row j of the next, but at
+  // the end of a column or of the meshlet
+  for (uint32_t q = first; q < last; ++q) {
+    const uint32_t i = q / quadRows;
+    const uint32_t j = q % quadRows;
+    add(i, j);
+    add(i + 1, j);
+    if (j + 1 == quadRows || q + 1 == last) {
+      add(i, j + 1);
+      add(i + 1, j + 1);
+    }
+  }
+  meshlet.low = low;
+  meshlet.high = high;
+}
+
+void Cloth::computeNormals(const StepParams &params)
+{
+  for (uint32_t tile = 0; tile < m_tiles.size(); ++tile) {
+    computeNormals(params, tile);
+  }
+}
+
+// The normal of a particle sums the normals of the triangles around it,
+// weighted by their area. Their aerodynamic forces come out of the same
+// crosses, a third of each gathered by every corner: writing the speeds here
+// would race with the neighbour tiles reading them. The next step starts
+// from the speeds read here, so the forces are not late.
+void Cloth::computeNormals(const StepParams &params, uint32_t tile)
+{
+  // Before anything sleeps: a meshlet may span an awake tile
+  for (const uint32_t meshlet : m_tiles[tile].meshlets) {
+    refitMeshlet(m_meshlets[meshlet]);
+  }
+  if (m_tileSleep[tile].asleep) {
+    return;
+  }
+  const uint32_t width = m_layout.width();
+  const uint32_t height = m_layout.height();
+  const bool aero = params.aero.drag > 0.f || params.aero.lift > 0.f;
+
+  for (uint32_t slot = m_tiles[tile].begin; slot < m_tiles[tile].end; ++slot) {
+    const glm::uvec2 cell = m_layout.cell(slot);
+    const uint32_t i = cell.x;
+    const uint32_t j = cell.y;
+    const glm::vec3 p = m_positions[slot];
+    const glm::vec3 v = m_speeds[slot];
+    glm::vec3 sum(0.);
+    glm::vec3 force(0.);
+
+    // Triangle t of the particle and the ones at (i1, j1) and (i2, j2)
+    const auto triangle = [&](uint32_t t, uint32_t i1, uint32_t j1,
+                              uint32_t i2, uint32_t j2) {
+      if (!isWhole(t)) {
+        return;
+      }
+      const uint32_t a = m_layout.index(i1, j1);
+      const uint32_t b = m_layout.index(i2, j2);
+      const glm::vec3 c = glm::cross(m_positions[a] - p, m_positions[b] - p);
+      sum += c;
+      if (aero) {
+        const glm::vec3 speed = (v + m_speeds[a] + m_speeds[b]) / 3.f;
+        force += aerodynamicForce(params.aero, c, params.aero.air - speed);
+      }
+    };
+
+    // Quad (i, j) holds triangles 2q and 2q + 1, see removeSpring()
+    const auto quad = [&](uint32_t qi, uint32_t qj) {
+      return 2 * (qi * (height - 1) + qj);
+    };
+
+    if (j > 0 && i > 0) { // Top - Left (2 triangles)
+      triangle(quad(i - 1, j - 1) + 1, i, j - 1, i - 1, j - 1);
+      triangle(quad(i - 1, j - 1), i - 1, j - 1, i - 1, j);
+    }
+
+    if (j < height - 1 && i < width - 1) { // Bottom - Right (2 triangles)
+      triangle(quad(i, j) + 1, i + 1, j + 1, i + 1, j);
+      triangle(quad(i, j), i, j + 1, i + 1, j + 1);
+    }
+
+    if (j > 0 && i < width - 1) { // Top - Right
+      triangle(quad(i, j - 1), i, j - 1, i + 1, j);
+    }
+
+    if (i > 0 && j < height - 1) { // Left - Bottom
+      triangle(quad(i - 1, j) + 1, i - 1, j, i, j + 1);
+    }
+
+    // A particle torn off every triangle keeps its last normal
+    if (glm::dot(sum, sum) > 0.f) {
+      m_vertices[slot].normal = glm::normalize(sum);
+    }
+
+    // The next step applies the force to these speeds: never past the air
+    // speed, which the quadratic drag of an explicit step would overshoot
+    force /= 3.f;
+    const float push = params.h * m_invMasses[slot] * glm::length(force);
+    const float reach = glm::length(params.aero.air - v);
+    m_aeroForces[slot] = push > reach ? force * (reach / push) : force;
+  }
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ClothKernel.hpp"
+#include "ClothLayout.hpp"
+#include "ClothMaterial.hpp"
+#include "Multigrid.hpp"
+#include "utils/SpatialHash.hpp"
+
+struct ShapeVertex
+{
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 texCoords;
+};
+
+// How a spring measures its elongation
+enum class SpringModel
+{
+  // k * (d - l), l the rest vector: linear but not rotation invariant
+  RestOffset,
+  // k * (|d| - l) * d / |d|, l the scalar rest length
+  RestLength
+};
+
+SpringModel parseSpringModel(const std::string &name);
+const char *toString(SpringModel model);
+
+// Precision of the spring and integration passes, see ClothKernel. Every
+// other phase reads the positions and speeds rounded to floats by the last
+// integration, and the particles it moves there continue from their floats.
+enum class ClothPrecision
+{
+  Float, // at the SSE width, for real time
+  Mixed, // double positions and speeds, float forces at the SSE width
+  Double // for long offline runs
+};
+
+ClothPrecision parseClothPrecision(const std::string &name);
+const char *toString(ClothPrecision precision);
+
+// Mass-spring cloth stored as flat arrays.
+// The grid particle (i, j) lives in slot layout().index(i, j) of every array,
+// vertices() and indexes() included, so rendering does not depend on the
+// ordering.
+class Cloth
+{
+public:
+  // Contiguous range of tileParticles() slots, the unit of work of the
+  // phases below and of sleeping
+  struct Tile
+  {
+    uint32_t begin, end;
+    // Spring chunks holding every spring attached to the tile, inclusive
+    uint32_t firstSpringChunk, lastSpringChunk;
+    // Other tiles read when computing the normals of this one
+    std::vector<uint32_t> neighbors;
+    // Other tiles sharing a spring with this one
+    std::vector<uint32_t> coupled;
+    // Meshlets whose box the normal pass of the tile refits
+    std::vector<uint32_t> meshlets;
+  };
+
+  // Run of MESHLET_QUADS consecutive grid quads, so of consecutive triangles
+  // of indexes(), culled as a whole when drawn. Its box is refit by the
+  // normal pass of the tile holding its first quad, which also waits for the
+  // tiles of its other corners.
+  struct Meshlet
+  {
+    uint32_t firstTriangle, triangleCount;
+    std::vector<uint32_t> tiles; // holding its corners
+    glm::vec3 low, high;
+  };
+
+  // A tile holds a MIN_TILES-th of the cloth in whole ClothLayout blocks,
+  // from MIN_TILE_PARTICLES up to TILE_PARTICLES, so that a small cloth still
+  // sleeps in parts. Its spring chunks scale along, SPRING_CHUNK at most.
+  static const uint32_t MIN_TILES = 16;
+  static const uint32_t MIN_TILE_PARTICLES = 256;
+  static const uint32_t TILE_PARTICLES = 4096;
+  static const uint32_t SPRING_CHUNK = 16384;
+  static const uint32_t QUAD_CHUNK = 8192;
+  static const uint32_t MESHLET_QUADS = 64;
+
+  // The first column is pinned, the last one is slightly lighter
+  Cloth(uint32_t width, uint32_t height, float step, float mass,
+      ParticleOrdering ordering = ParticleOrdering::ColumnMajor,
+      SpringModel springModel = SpringModel::RestOffset,
+      ClothPrecision precision = ClothPrecision::Float);
+
+  // Advance by params.h, see makeStepParams. The pool, if any, shares the
+  // solve of implicit steps.
+  void step(const StepParams &params, ThreadPool *pool = nullptr);
+
+  // Recompute the vertex normals from the current positions, and the
+  // aerodynamic forces of params.aero that the next step applies
+  void computeNormals(const StepParams &params);
+
+  // step() and computeNormals() split in phases for concurrent scheduling.
+  // Spring chunks are independent, integrating a tile needs its spring chunks
+  // and the normals of a tile need the tile and its neighbours integrated.
+  void computeSpringForces(const StepParams &params, uint32_t chunk);
+  void integrate(const StepParams &params, uint32_t tile);
+  void computeNormals(const StepParams &params, uint32_t tile);
+
+  // Implicit steps (params.solver.implicit) solve for every speed between
+  // the spring pass and integrate(), which then only moves the particles.
+  // Backward Euler linearized at the start of the step:
+  //   (M + h^2 K + h Z) dv = h F(x, v) - h^2 K v
+  // with K and Z the spring and damping Laplacians, exact for RestOffset
+  // springs and their isotropic part for RestLength ones.
+  void solveImplicit(const StepParams &params, ThreadPool *pool = nullptr);
+  inline const Multigrid::Result &lastSolve() const { return m_lastSolve; }
+
+  // Self-collision phases, run between integrate() and computeNormals() when
+  // params.thickness > 0. Triangles are hashed by chunks of grid quads in a
+  // counting sort, then every tile pushes its particles out of the triangles
+  // around them and resolves once no tile reads the positions anymore.
+  void countTriangles(const StepParams &params, uint32_t chunk);
+  void prefixTriangles();
+  void insertTriangles(const StepParams &params, uint32_t chunk);
+  void collide(const StepParams &params, uint32_t tile);
+  void resolveCollisions(uint32_t tile);
+
+  inline const std::vector<Tile> &tiles() const { return m_tiles; }
+  inline const std::vector<Meshlet> &meshlets() const { return m_meshlets; }
+  inline uint32_t tileParticles() const { return m_tileParticles; }
+  inline uint32_t springChunk() const { return m_springChunk; }
+  inline uint32_t springChunkCount() const
+  {
+    return uint32_t((m_springA.size() + m_springChunk - 1) / m_springChunk);
+  }
+  inline uint32_t triangleCount() const
+  {
+    return uint32_t(m_indexes.size() / 3);
+  }
+  inline uint32_t quadChunkCount() const
+  {
+    return (triangleCount() / 2 + QUAD_CHUNK - 1) / QUAD_CHUNK;
+  }
+
+  // Tearing. Spring passes with params.tearStrain > 0 record the springs
+  // stretched further, removed by the next tear() along with the triangles
+  // across them. A spring is swap-removed within its chunk, so that the
+  // chunks of every tile stay valid, and a torn triangle collapses on its
+  // first corner in indexes(), patched in place. Called by step(), and
+  // between steps when the phases are scheduled separately.
+  void tear();
+  // Triangles torn since the last call, sorted
+  void takeTornTriangles(std::vector<uint32_t> &triangles);
+  inline bool isWhole(uint32_t triangle) const
+  {
+    return (m_quadTriangles[triangle / 2] >> (triangle % 2)) & 1;
+  }
+
+  // Sleeping. A tile whose particles all stayed slower than
+  // params.sleepSpeed for SLEEP_STEPS steps falls asleep, zeroing their
+  // speeds: its integration, collisions and normals are skipped, and so are
+  // the spring chunks no awake tile reads. It wakes up once a coupled tile
+  // moves, the forces at its center or the material change, or one of its
+  // particles is pinned or moved. Called by step(), and before the phases
+  // when they are scheduled separately. Implicit steps, coupling every
+  // particle, keep every tile awake.
+  static const uint32_t SLEEP_STEPS = 30;
+  void updateSleep(const StepParams &params);
+  inline bool isAsleep(uint32_t tile) const { return m_tileSleep[tile].asleep; }
+  uint32_t asleepCount() const;
+
+  // Largest h integrating params without diverging, whatever the state:
+  // the material and forces stay those of params, only h changes
+  float stableStep(const StepParams &params) const;
+
+  // Kinetic energy at the last integration, non finite once the cloth
+  // diverged
+  float kineticEnergy() const;
+
+  // Measures reduced by the step passes themselves. The energies and the
+  // speed come from every integration, the spring terms from the last spring
+  // pass with params.telemetry set. Strain is the relative elongation
+  // |d| / l - 1 of a spring, its mean taken over absolute values.
+  struct Telemetry
+  {
+    float kineticEnergy;
+    float potentialEnergy; // of the springs, damping aside
+    float maxSpeed;
+    float maxStrain[SPRING_FAMILY_COUNT];
+    float meanStrain[SPRING_FAMILY_COUNT];
+  };
+  Telemetry telemetry() const;
+
+  // Box of a tile, the longest move, the fastest particle and the energy of
+  // its particles at the last step
+  struct TileBounds
+  {
+    glm::vec3 low, high;
+    float travel;
+    float speed;
+    float energy;
+  };
+
+  // Everything a step changes, to roll back one that diverged
+  struct State
+  {
+    std::vector<glm::vec3> positions, speeds;
+    std::vector<glm::dvec3> precisePositions, preciseSpeeds;
+    std::vector<TileBounds> tileBounds;
+  };
+  void saveState(State &state) const;
+  void restoreState(const State &state);
+
+  // Drop every speed, the last resort against divergence
+  void stop();
+
+  // A pinned particle keeps its position whatever the forces
+  void setPinned(uint32_t i, uint32_t j, bool pinned);
+  inline bool isPinned(uint32_t slot) const { return m_invMasses[slot] == 0.f; }
+  // Lead a pinned particle to target over the next h, its speed seen by the
+  // damping of its springs
+  void movePinned(uint32_t slot, const glm::vec3 &target, float h);
+
+  inline const ClothLayout &layout() const { return m_layout; }
+  inline SpringModel springModel() const { return m_springModel; }
+  inline ClothPrecision precision() const { return m_precision; }
+  inline size_t particleCount() const { return m_positions.size(); }
+  inline size_t springCount() const
+  {
+    return std::accumulate(std::begin(m_familySprings),
+        std::end(m_familySprings), size_t(0));
+  }
+  inline float spacing() const { return m_spacing; } // between neighbours
+  inline float mass() const { return m_mass; } // of an inner particle
+
+  inline const std::vector<glm::vec3> &positions() const { return m_positions; }
+  inline const std::vector<ShapeVertex> &vertices() const { return m_vertices; }
+  inline const std::vector<uint32_t> &indexes() const { return m_indexes; }
+
+private:
+  // Copies the particles and springs at other precisions
+  template <typename Real, typename Force, uint32_t Width>
+  friend class ClothCopy;
+
+  void addSpring(uint32_t i1, uint32_t j1, uint32_t i2, uint32_t j2,
+      SpringFamily family);
+  void sortSprings();
+  void buildTiles();
+  void buildMeshlets();
+  void refitMeshlet(Meshlet &meshlet) const;
+  void removeSpring(uint32_t s);
+  void dropTriangle(uint32_t triangle);
+  void wake(uint32_t tile);
+
+  // The spring and integration passes of each precision, on the arrays below
+  using FloatKernel = ClothKernel<float, float, 4>;
+  using MixedKernel = ClothKernel<double, float, 4>;
+  using DoubleKernel = ClothKernel<double, double, 1>;
+  template <typename Kernel> typename Kernel::Particles kernelParticles();
+  template <typename Kernel>
+  void applySprings(const StepParams &params, typename Kernel::ForceVec *forces,
+      size_t begin, size_t end, SpringStats *stats);
+  void integrateBlock(const StepParams &params, const glm::vec3 *external,
+      uint32_t begin, uint32_t end);
+  // Take back at full precision the particles [begin, end) changed in
+  // m_positions and m_speeds since the last integration
+  void takePreciseChanges(uint32_t begin, uint32_t end);
+
+  void selfCollide(const StepParams &params);
+  float collisionCellSize(const StepParams &params) const;
+  glm::ivec3 collisionCell(const glm::vec3 &position, float cellSize) const;
+  template <typename F>
+  void forEachTriangleCell(const StepParams &params, uint32_t chunk, F f) const;
+  glm::vec3 triangleCollision(const glm::vec3 &position,
+      const glm::vec3 &previous, float thickness,
+      const std::vector<uint32_t> &triangles) const;
+
+  ClothLayout m_layout;
+  SpringModel m_springModel;
+  ClothPrecision m_precision;
+  float m_mass;
+  float m_spacing;
+  uint32_t m_tileParticles, m_springChunk;
+
+  // Particles
+  std::vector<glm::vec3> m_positions, m_speeds;
+  // Share of the drag and lift of the triangles around each particle, from
+  // the last normal pass
+  std::vector<glm::vec3> m_aeroForces;
+  std::vector<float> m_invMasses; // 0 for pinned particles
+  // Stepped instead of the above unless ClothPrecision::Float, which then
+  // hold them rounded
+  std::vector<glm::dvec3> m_precisePositions, m_preciseSpeeds;
+  std::vector<double> m_preciseInvMasses;
+
+  // Springs
+  std::vector<uint32_t> m_springA, m_springB;
+  std::vector<uint8_t> m_springFamily; // SpringFamily
+  // l, longueur à vide: the rest vectors are only kept for RestOffset, the
+  // lengths always for the strain
+  std::vector<glm::vec3> m_springRest;
+  std::vector<float> m_springRestLength;
+  std::vector<glm::vec3> m_springForces; // applied to a, minus to b
+  std::vector<glm::dvec3> m_preciseForces; // instead, ClothPrecision::Double
+  std::vector<SpringStats> m_springStats; // per chunk
+  // Chunk c holds springs [c * m_springChunk, c * m_springChunk + count)
+  std::vector<uint32_t> m_chunkSprings;
+  std::vector<std::vector<uint32_t>> m_tears; // per chunk, for tear()
+  uint32_t m_familySprings[SPRING_FAMILY_COUNT] = {};
+
+  // Springs of each particle in CSR form, entries are spring << 1 | (p == b).
+  // Particle p has entries [offsets[p], ends[p]), fewer as springs tear.
+  std::vector<uint32_t> m_incidenceOffsets, m_incidenceEnds, m_incidence;
+
+  std::vector<Tile> m_tiles;
+  std::vector<TileBounds> m_tileBounds;
+  std::vector<Meshlet> m_meshlets;
+
+  struct TileSleep
+  {
+    bool asleep;
+    uint32_t stillSteps; // integrated slower than params.sleepSpeed
+    glm::vec3 force; // at the center, when it fell asleep
+  };
+  std::vector<TileSleep> m_tileSleep;
+  std::vector<std::vector<uint32_t>> m_chunkTiles; // tiles reading each chunk
+  std::vector<uint8_t> m_chunkAsleep; // every tile reading it asleep
+  // Material of the last steps, the sleeping tiles settled under it
+  SpringMaterial m_sleepSprings[SPRING_FAMILY_COUNT] = {};
+  glm::vec3 m_sleepAir = glm::vec3(0.f);
+
+  // Inverse mass and springs of each family shared by a group of particles
+  struct StiffnessRate
+  {
+    float invMass;
+    uint32_t springs[SPRING_FAMILY_COUNT];
+
+    inline bool operator==(const StiffnessRate &other) const
+    {
+      return invMass == other.invMass &&
+             std::equal(springs, springs + SPRING_FAMILY_COUNT, other.springs);
+    }
+  };
+  std::vector<StiffnessRate> m_stiffnessRates;
+
+  // Implicit steps, on the particle grid in row major order
+  void buildMultigrid();
+  Multigrid m_multigrid; // emptied when the pins change
+  std::vector<uint32_t> m_gridSlots;
+  std::vector<glm::vec3> m_gridSpeeds, m_gridRhs, m_gridDeltas;
+  Multigrid::Result m_lastSolve{0, 0.f};
+
+  float m_triangleRadius; // largest centroid to corner distance at rest
+  SpatialHash m_triangleHash;
+  std::vector<glm::vec3> m_collisionOffsets;
+
+  // Render data
+  std::vector<ShapeVertex> m_vertices;
+  std::vector<uint32_t> m_indexes;
+  std::vector<uint8_t> m_quadTriangles; // bit t while triangle 2q + t is whole
+  std::vector<uint32_t> m_tornTriangles;
+};
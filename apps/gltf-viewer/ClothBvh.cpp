@@ -0,0 +1,237 @@
+#include "ClothBvh.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+const uint32_t MAX_DEPTH = 64;
+
+// Distance at which the ray enters the box, infinite when it misses it
+// before maxDistance
+float boxEntry(const glm::vec3 &origin, const glm::vec3 &invDirection,
+    const glm::vec3 &low, const glm::vec3 &high, float maxDistance)
+{
+  const glm::vec3 t0 = (low - origin) * invDirection;
+  const glm::vec3 t1 = (high - origin) * invDirection;
+  const glm::vec3 near = glm::min(t0, t1);
+  const glm::vec3 far = glm::max(t0, t1);
+  const float entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.f));
+  const float exit = std::min(std::min(far.x, far.y), far.z);
+  return entry <= exit && entry < maxDistance
+             ? entry
+             : std::numeric_limits<float>::infinity();
+}
+
+// Moller and Trumbore, 1997. Distance along the ray and barycentric
+// coordinates of b and c, false when the ray misses abc.
+bool rayTriangle(const glm::vec3 &origin, const glm::vec3 &direction,
+    const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+    float &distance, glm::vec2 &barycentric)
+{
+  const glm::vec3 ab = b - a;
+  const glm::vec3 ac = c - a;
+  const glm::vec3 p = glm::cross(direction, ac);
+  const float determinant = glm::dot(ab, p);
+  if (std::abs(determinant) < 1e-12f) {
+    return false; // parallel or degenerate, a torn triangle
+  }
+  const float invDeterminant = 1.f / determinant;
+  const glm::vec3 ao = origin - a;
+  const float u = glm::dot(ao, p) * invDeterminant;
+  if (u < 0.f || u > 1.f) {
+    return false;
+  }
+  const glm::vec3 q = glm::cross(ao, ab);
+  const float v = glm::dot(direction, q) * invDeterminant;
+  if (v < 0.f || u + v > 1.f) {
+    return false;
+  }
+  distance = glm::dot(ac, q) * invDeterminant;
+  barycentric = glm::vec2(u, v);
+  return distance >= 0.f;
+}
+
+} // namespace
+
+ClothBvh::ClothBvh(const Cloth &cloth)
+{
+  const glm::uvec2 quads(cloth.layout().width() - 1,
+      cloth.layout().height() - 1);
+  build(glm::uvec2(0), quads, true);
+  refit(cloth);
+}
+
+uint32_t ClothBvh::build(
+    const glm::uvec2 &low, const glm::uvec2 &high, bool top)
+{
+  const uint32_t index = uint32_t(m_nodes.size());
+  m_nodes.push_back({glm::vec3(0), 0, glm::vec3(0), 0});
+  const glm::uvec2 size = high - low;
+  const uint32_t quads = size.x * size.y;
+
+  size_t subtree = m_subtrees.size();
+  if (top && quads <= SUBTREE_QUADS) {
+    m_subtrees.emplace_back(index, 0);
+    top = false;
+  }
+
+  if (quads <= LEAF_QUADS) {
+    m_nodes[index].offset = uint32_t(m_leaves.size());
+    m_nodes[index].count = quads;
+    m_leaves.emplace_back(low, high);
+  } else {
+    if (top) {
+      m_topNodes.push_back(index);
+    }
+    const int axis = size.x >= size.y ? 0 : 1;
+    glm::uvec2 middleHigh = high, middleLow = low;
+    middleHigh[axis] = middleLow[axis] = low[axis] + size[axis] / 2;
+    build(low, middleHigh, top);
+    const uint32_t second = build(middleLow, high, top);
+    m_nodes[index].offset = second;
+  }
+
+  if (subtree < m_subtrees.size() && m_subtrees[subtree].x == index) {
+    m_subtrees[subtree].y = uint32_t(m_nodes.size());
+  }
+  return index;
+}
+
+void ClothBvh::refitInner(uint32_t index)
+{
+  Node &node = m_nodes[index];
+  const Node &first = m_nodes[index + 1];
+  const Node &second = m_nodes[node.offset];
+  node.low = glm::min(first.low, second.low);
+  node.high = glm::max(first.high, second.high);
+}
+
+// Every particle around the quads, torn triangles only ever shrink
+void ClothBvh::refitLeaf(const Cloth &cloth, Node &node) const
+{
+  const glm::uvec4 &quads = m_leaves[node.offset];
+  const auto &positions = cloth.positions();
+  glm::vec3 low(std::numeric_limits<float>::max());
+  glm::vec3 high(std::numeric_limits<float>::lowest());
+  for (uint32_t i = quads.x; i <= quads.z; ++i) {
+    for (uint32_t j = quads.y; j <= quads.w; ++j) {
+      const glm::vec3 &p = positions[cloth.layout().index(i, j)];
+      low = glm::min(low, p);
+      high = glm::max(high, p);
+    }
+  }
+  node.low = low;
+  node.high = high;
+}
+
+// Leaves first, in the order of the tree, which walks the grid block by block
+// and lets the prefetcher follow. Children follow their parent in depth first
+// order, a reverse pass over the range then refits them before it.
+void ClothBvh::refitSubtree(const Cloth &cloth, uint32_t subtree)
+{
+  const glm::uvec2 &range = m_subtrees[subtree];
+  for (uint32_t node = range.x; node < range.y; ++node) {
+    if (m_nodes[node].count > 0) {
+      refitLeaf(cloth, m_nodes[node]);
+    }
+  }
+  for (uint32_t node = range.y; node-- > range.x;) {
+    if (m_nodes[node].count == 0) {
+      refitInner(node);
+    }
+  }
+}
+
+void ClothBvh::refitTop()
+{
+  for (auto node = m_topNodes.rbegin(); node != m_topNodes.rend(); ++node) {
+    refitInner(*node);
+  }
+}
+
+void ClothBvh::refit(const Cloth &cloth, ThreadPool *pool)
+{
+  if (pool && m_subtrees.size() > 1) {
+    pool->parallelFor(m_subtrees.size(),
+        [&](size_t subtree) { refitSubtree(cloth, uint32_t(subtree)); });
+  } else {
+    for (uint32_t subtree = 0; subtree < subtreeCount(); ++subtree) {
+      refitSubtree(cloth, subtree);
+    }
+  }
+  refitTop();
+}
+
+bool ClothBvh::intersect(const Cloth &cloth, const glm::vec3 &origin,
+    const glm::vec3 &direction, float maxDistance, Hit &hit) const
+{
+  const glm::vec3 invDirection = 1.f / direction;
+  const uint32_t quadRows = cloth.layout().height() - 1;
+  const auto &indexes = cloth.indexes();
+  const auto &positions = cloth.positions();
+  bool found = false;
+  glm::vec2 barycentric(0.f);
+
+  // Nearest child first, so that the hit bounds the rest early
+  uint32_t stack[MAX_DEPTH];
+  uint32_t size = 0;
+  if (boxEntry(origin, invDirection, boundsMin(), boundsMax(), maxDistance) <
+      maxDistance) {
+    stack[size++] = 0;
+  }
+  while (size > 0) {
+    const uint32_t index = stack[--size];
+    const Node &node = m_nodes[index];
+    if (node.count == 0) {
+      const uint32_t first = index + 1;
+      const uint32_t second = node.offset;
+      const float d0 = boxEntry(origin, invDirection, m_nodes[first].low,
+          m_nodes[first].high, maxDistance);
+      const float d1 = boxEntry(origin, invDirection, m_nodes[second].low,
+          m_nodes[second].high, maxDistance);
+      const bool firstNearer = d0 <= d1;
+      if (std::max(d0, d1) < maxDistance) {
+        stack[size++] = firstNearer ? second : first;
+      }
+      if (std::min(d0, d1) < maxDistance) {
+        stack[size++] = firstNearer ? first : second;
+      }
+      continue;
+    }
+
+    const glm::uvec4 &quads = m_leaves[node.offset];
+    for (uint32_t i = quads.x; i < quads.z; ++i) {
+      for (uint32_t j = quads.y; j < quads.w; ++j) {
+        const uint32_t q = i * quadRows + j;
+        for (uint32_t t = 2 * q; t < 2 * q + 2; ++t) {
+          if (!cloth.isWhole(t)) {
+            continue;
+          }
+          const uint32_t *corners = &indexes[3 * t];
+          float distance;
+          glm::vec2 uv;
+          if (rayTriangle(origin, direction, positions[corners[0]],
+                  positions[corners[1]], positions[corners[2]], distance,
+                  uv) &&
+              distance < maxDistance) {
+            maxDistance = distance;
+            barycentric = uv;
+            hit.triangle = t;
+            found = true;
+          }
+        }
+      }
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  const uint32_t *corners = &indexes[3 * hit.triangle];
+  const float weights[] = {
+      1.f - barycentric.x - barycentric.y, barycentric.x, barycentric.y};
+  hit.distance = maxDistance;
+  hit.particle = corners[std::max_element(weights, weights + 3) - weights];
+  return true;
+}
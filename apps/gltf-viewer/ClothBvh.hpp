@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Cloth.hpp"
+#include "utils/ThreadPool.hpp"
+
+// Bounding volume hierarchy over the triangles of a cloth, for ray casts.
+// The grid quads are split once in halves of the longer side, down to a few
+// quads per leaf, and only the boxes follow the particles afterwards: a refit
+// is one pass over the positions instead of a build, and the topology of the
+// grid keeps the boxes of neighbouring quads tight however the cloth folds.
+class ClothBvh
+{
+public:
+  static const uint32_t LEAF_QUADS = 16;
+  // Quads under a subtree refit by a single task
+  static const uint32_t SUBTREE_QUADS = 8192;
+
+  struct Hit
+  {
+    float distance; // along the ray
+    uint32_t triangle;
+    uint32_t particle; // corner of the triangle closest to the hit
+  };
+
+  explicit ClothBvh(const Cloth &cloth);
+
+  // Boxes around the current positions of the cloth. The pool, if any,
+  // shares the subtrees.
+  void refit(const Cloth &cloth, ThreadPool *pool = nullptr);
+
+  // refit() split in phases for concurrent scheduling: subtrees are
+  // independent, the top nodes above them need every one refit
+  inline uint32_t subtreeCount() const { return uint32_t(m_subtrees.size()); }
+  void refitSubtree(const Cloth &cloth, uint32_t subtree);
+  void refitTop();
+
+  // Closest whole triangle the ray crosses before maxDistance, direction
+  // normalized, both in the space of the cloth as of the last refit
+  bool intersect(const Cloth &cloth, const glm::vec3 &origin,
+      const glm::vec3 &direction, float maxDistance, Hit &hit) const;
+
+  inline glm::vec3 boundsMin() const { return m_nodes[0].low; }
+  inline glm::vec3 boundsMax() const { return m_nodes[0].high; }
+
+private:
+  // Children of an inner node are the next node and the node at offset, a
+  // leaf covers the count quads of m_leaves[offset]
+  struct Node
+  {
+    glm::vec3 low;
+    uint32_t offset;
+    glm::vec3 high;
+    uint32_t count;
+  };
+
+  uint32_t build(const glm::uvec2 &low, const glm::uvec2 &high, bool top);
+  void refitLeaf(const Cloth &cloth, Node &node) const;
+  void refitInner(uint32_t node);
+
+  std::vector<Node> m_nodes; // depth first, a subtree is a range
+  std::vector<glm::uvec4> m_leaves; // quads [x, z) x [y, w) of the grid
+  std::vector<glm::uvec2> m_subtrees; // node ranges
+  std::vector<uint32_t> m_topNodes; // inner nodes above the subtrees
+};
@@ -0,0 +1,304 @@
+#include "Cloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "utils/simd.hpp"
+
+// Self-collision between particles and triangles.
+// The two triangles of each grid quad are entered together in every cell the
+// box of the quad, grown by the thickness, overlaps. Each particle then only
+// tests the triangles of its own cell and is pushed back to the side it came
+// from.
+
+float Cloth::collisionCellSize(const StepParams &params) const
+{
+  // About the size of a triangle at rest
+  return 2.f * m_triangleRadius + params.thickness;
+}
+
+glm::ivec3 Cloth::collisionCell(
+    const glm::vec3 &position, float cellSize) const
+{
+  // Centred on the origin, so a cloth flat at rest is in a single layer
+  return glm::ivec3(glm::floor(position / cellSize + 0.5f));
+}
+
+template <typename F>
+void Cloth::forEachTriangleCell(
+    const StepParams &params, uint32_t chunk, F f) const
+{
+  const float cellSize = collisionCellSize(params);
+  const uint32_t begin = chunk * QUAD_CHUNK;
+  const uint32_t end = std::min(begin + QUAD_CHUNK, triangleCount() / 2);
+  const uint32_t quadRows = m_layout.height() - 1;
+  for (uint32_t q = begin; q < end; ++q) {
+    if (!isWhole(2 * q) && !isWhole(2 * q + 1)) {
+      continue;
+    }
+    // Corners (i, j), (i, j + 1), (i + 1, j + 1) and (i + 1, j), from the
+    // layout as torn triangles lose theirs in m_indexes
+    const uint32_t i = q / quadRows;
+    const uint32_t j = q % quadRows;
+    const glm::vec3 &a = m_positions[m_layout.index(i, j)];
+    const glm::vec3 &b = m_positions[m_layout.index(i, j + 1)];
+    const glm::vec3 &c = m_positions[m_layout.index(i + 1, j + 1)];
+    const glm::vec3 &d = m_positions[m_layout.index(i + 1, j)];
+    const glm::ivec3 low = collisionCell(
+        glm::min(glm::min(a, b), glm::min(c, d)) - params.thickness,
+        cellSize);
+    const glm::ivec3 high = collisionCell(
+        glm::max(glm::max(a, b), glm::max(c, d)) + params.thickness,
+        cellSize);
+
+    for (int x = low.x; x <= high.x; ++x) {
+      for (int y = low.y; y <= high.y; ++y) {
+        for (int z = low.z; z <= high.z; ++z) {
+          f(q, m_triangleHash.bucket(glm::ivec3(x, y, z)));
+        }
+      }
+    }
+  }
+}
+
+void Cloth::countTriangles(const StepParams &params, uint32_t chunk)
+{
+  forEachTriangleCell(params, chunk,
+      [this](uint32_t, uint32_t bucket) { m_triangleHash.count(bucket); });
+}
+
+void Cloth::prefixTriangles() { m_triangleHash.prefixSum(); }
+
+void Cloth::insertTriangles(const StepParams &params, uint32_t chunk)
+{
+  forEachTriangleCell(params, chunk, [this](uint32_t q, uint32_t bucket) {
+    m_triangleHash.insert(bucket, q);
+  });
+}
+
+void Cloth::collide(const StepParams &params, uint32_t tile)
+{
+  if (m_tileSleep[tile].asleep) {
+    return;
+  }
+  const float cellSize = collisionCellSize(params);
+  thread_local std::vector<uint32_t> quads, triangles;
+  const uint32_t quadRows = m_layout.height() - 1;
+  glm::ivec3 lastCell;
+  bool hasCell = false;
+
+  for (uint32_t p = m_tiles[tile].begin; p < m_tiles[tile].end; ++p) {
+    m_collisionOffsets[p] = glm::vec3(0.f);
+    if (m_invMasses[p] == 0.f) {
+      continue;
+    }
+
+    const glm::vec3 &position = m_positions[p];
+    const glm::ivec3 cell = collisionCell(position, cellSize);
+
+    // Neighbouring slots often share a cell
+    if (!hasCell || cell != lastCell) {
+      const uint32_t bucket = m_triangleHash.bucket(cell);
+      // Cells sharing the bucket can hold the same quad, and a sorted list
+      // keeps the result independent of the insertion order
+      quads.assign(m_triangleHash.begin(bucket), m_triangleHash.end(bucket));
+      std::sort(quads.begin(), quads.end());
+      quads.erase(std::unique(quads.begin(), quads.end()), quads.end());
+      lastCell = cell;
+      hasCell = true;
+    }
+
+    // The quads two rings around the particle can't fold onto it, and they
+    // are the only candidates of a flat cloth. Quad q has corner (i, j) with
+    // q = i * (height - 1) + j.
+    const glm::ivec2 grid = glm::ivec2(m_layout.cell(p));
+    triangles.clear();
+    for (const uint32_t q : quads) {
+      const int i = int(q / quadRows);
+      const int j = int(q % quadRows);
+      if (i >= grid.x - 2 && i <= grid.x + 1 && j >= grid.y - 2 &&
+          j <= grid.y + 1) {
+        continue;
+      }
+      for (const uint32_t t : {2 * q, 2 * q + 1}) {
+        if (isWhole(t)) {
+          triangles.push_back(t);
+        }
+      }
+    }
+    if (triangles.empty()) {
+      continue;
+    }
+
+    m_collisionOffsets[p] = triangleCollision(position,
+        position - params.h * m_speeds[p], params.thickness, triangles);
+  }
+}
+
+void Cloth::resolveCollisions(uint32_t tile)
+{
+  if (m_tileSleep[tile].asleep) {
+    return;
+  }
+  for (uint32_t p = m_tiles[tile].begin; p < m_tiles[tile].end; ++p) {
+    const glm::vec3 offset = m_collisionOffsets[p];
+    const float length2 = glm::dot(offset, offset);
+    if (length2 == 0.f) {
+      continue;
+    }
+
+    m_positions[p] += offset;
+    m_vertices[p].position = m_positions[p];
+
+    // Drop the speed going into the cloth, never add any
+    const glm::vec3 normal = offset / std::sqrt(length2);
+    const float speed = glm::dot(m_speeds[p], normal);
+    if (speed < 0.f) {
+      m_speeds[p] -= speed * normal;
+    }
+    takePreciseChanges(p, p + 1);
+  }
+}
+
+void Cloth::selfCollide(const StepParams &params)
+{
+  for (uint32_t chunk = 0; chunk < quadChunkCount(); ++chunk) {
+    countTriangles(params, chunk);
+  }
+  prefixTriangles();
+  for (uint32_t chunk = 0; chunk < quadChunkCount(); ++chunk) {
+    insertTriangles(params, chunk);
+  }
+  for (uint32_t tile = 0; tile < m_tiles.size(); ++tile) {
+    collide(params, tile);
+  }
+  for (uint32_t tile = 0; tile < m_tiles.size(); ++tile) {
+    resolveCollisions(tile);
+  }
+}
+
+// Average push out of the triangles closer than thickness, towards the side
+// of each triangle where the particle was at the previous step.
+// Candidates are tested four at a time: signed distances to the planes and
+// barycentric coordinates of the projections.
+glm::vec3 Cloth::triangleCollision(const glm::vec3 &position,
+    const glm::vec3 &previous, float thickness,
+    const std::vector<uint32_t> &triangles) const
+{
+  const float travel = glm::distance(position, previous);
+  const size_t count = triangles.size();
+
+  glm::vec3 offset(0.f);
+  uint32_t contacts = 0;
+
+  for (size_t c = 0; c < count; c += 4) {
+    alignas(16) float distance[4], previousDistance[4], u[4], v[4];
+    alignas(16) float nx[4], ny[4], nz[4];
+
+    glm::vec3 a[4], e0[4], e1[4];
+    for (size_t lane = 0; lane < 4; ++lane) {
+      // The last group repeats its final candidate, the extra lanes are
+      // ignored below
+      const uint32_t *corners =
+          &m_indexes[3 * triangles[std::min(c + lane, count - 1)]];
+      a[lane] = m_positions[corners[0]];
+      e0[lane] = m_positions[corners[1]] - a[lane];
+      e1[lane] = m_positions[corners[2]] - a[lane];
+    }
+
+#ifdef CLOTH_USE_SSE
+    const auto load = [](const glm::vec3 *v, int axis) {
+      return _mm_set_ps(v[3][axis], v[2][axis], v[1][axis], v[0][axis]);
+    };
+    const auto dot = [](__m128 x0, __m128 y0, __m128 z0, __m128 x1,
+                         __m128 y1, __m128 z1) {
+      return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, x1), _mm_mul_ps(y0, y1)),
+          _mm_mul_ps(z0, z1));
+    };
+
+    const __m128 ax = load(a, 0), ay = load(a, 1), az = load(a, 2);
+    const __m128 e0x = load(e0, 0), e0y = load(e0, 1), e0z = load(e0, 2);
+    const __m128 e1x = load(e1, 0), e1y = load(e1, 1), e1z = load(e1, 2);
+
+    const __m128 wx = _mm_sub_ps(_mm_set1_ps(position.x), ax);
+    const __m128 wy = _mm_sub_ps(_mm_set1_ps(position.y), ay);
+    const __m128 wz = _mm_sub_ps(_mm_set1_ps(position.z), az);
+    const __m128 qx = _mm_sub_ps(_mm_set1_ps(previous.x), ax);
+    const __m128 qy = _mm_sub_ps(_mm_set1_ps(previous.y), ay);
+    const __m128 qz = _mm_sub_ps(_mm_set1_ps(previous.z), az);
+
+    __m128 x = _mm_sub_ps(_mm_mul_ps(e0y, e1z), _mm_mul_ps(e0z, e1y));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(e0z, e1x), _mm_mul_ps(e0x, e1z));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(e0x, e1y), _mm_mul_ps(e0y, e1x));
+    const __m128 invLength = _mm_div_ps(_mm_set1_ps(1.f),
+        _mm_sqrt_ps(_mm_max_ps(dot(x, y, z, x, y, z), _mm_set1_ps(1e-12f))));
+    x = _mm_mul_ps(x, invLength);
+    y = _mm_mul_ps(y, invLength);
+    z = _mm_mul_ps(z, invLength);
+    _mm_store_ps(nx, x);
+    _mm_store_ps(ny, y);
+    _mm_store_ps(nz, z);
+    _mm_store_ps(distance, dot(wx, wy, wz, x, y, z));
+    _mm_store_ps(previousDistance, dot(qx, qy, qz, x, y, z));
+
+    const __m128 d00 = dot(e0x, e0y, e0z, e0x, e0y, e0z);
+    const __m128 d01 = dot(e0x, e0y, e0z, e1x, e1y, e1z);
+    const __m128 d11 = dot(e1x, e1y, e1z, e1x, e1y, e1z);
+    const __m128 d20 = dot(wx, wy, wz, e0x, e0y, e0z);
+    const __m128 d21 = dot(wx, wy, wz, e1x, e1y, e1z);
+    const __m128 invDenom = _mm_div_ps(_mm_set1_ps(1.f),
+        _mm_max_ps(_mm_sub_ps(_mm_mul_ps(d00, d11), _mm_mul_ps(d01, d01)),
+            _mm_set1_ps(1e-12f)));
+    const __m128 baryU = _mm_mul_ps(
+        invDenom, _mm_sub_ps(_mm_mul_ps(d11, d20), _mm_mul_ps(d01, d21)));
+    const __m128 baryV = _mm_mul_ps(
+        invDenom, _mm_sub_ps(_mm_mul_ps(d00, d21), _mm_mul_ps(d01, d20)));
+
+    // Most candidates miss, skip the scalar pass when all four do
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inside = _mm_and_ps(
+        _mm_and_ps(_mm_cmpge_ps(baryU, zero), _mm_cmpge_ps(baryV, zero)),
+        _mm_cmple_ps(_mm_add_ps(baryU, baryV), _mm_set1_ps(1.f)));
+    if (_mm_movemask_ps(inside) == 0) {
+      continue;
+    }
+    _mm_store_ps(u, baryU);
+    _mm_store_ps(v, baryV);
+#else
+    for (size_t lane = 0; lane < 4; ++lane) {
+      const glm::vec3 w = position - a[lane];
+      const glm::vec3 normal = glm::normalize(glm::cross(e0[lane], e1[lane]));
+      nx[lane] = normal.x;
+      ny[lane] = normal.y;
+      nz[lane] = normal.z;
+      distance[lane] = glm::dot(w, normal);
+      previousDistance[lane] = glm::dot(previous - a[lane], normal);
+
+      const float d00 = glm::dot(e0[lane], e0[lane]);
+      const float d01 = glm::dot(e0[lane], e1[lane]);
+      const float d11 = glm::dot(e1[lane], e1[lane]);
+      const float d20 = glm::dot(w, e0[lane]);
+      const float d21 = glm::dot(w, e1[lane]);
+      const float invDenom = 1.f / std::max(d00 * d11 - d01 * d01, 1e-12f);
+      u[lane] = (d11 * d20 - d01 * d21) * invDenom;
+      v[lane] = (d00 * d21 - d01 * d20) * invDenom;
+    }
+#endif
+
+    for (size_t lane = 0; lane < 4 && c + lane < count; ++lane) {
+      if (u[lane] < 0.f || v[lane] < 0.f || u[lane] + v[lane] > 1.f) {
+        continue;
+      }
+      const float side = previousDistance[lane] >= 0.f ? 1.f : -1.f;
+      const float depth = side * distance[lane];
+      if (depth >= thickness || depth < -(thickness + travel)) {
+        continue;
+      }
+      offset += glm::vec3(nx[lane], ny[lane], nz[lane]) * side *
+                (thickness - depth);
+      ++contacts;
+    }
+  }
+
+  return contacts ? offset / float(contacts) : glm::vec3(0.f);
+}
@@ -0,0 +1,290 @@
+#include "ClothKernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "Cloth.hpp"
+#include "utils/simd.hpp"
+
+namespace {
+
+// k (1 - l / |d|) of Width RestLength springs and |d|, one lane per spring.
+// The lanes are gathered from scalars: storing them to load them whole would
+// stall on store forwarding.
+template <typename T, uint32_t Width> struct SpringLanes
+{
+  static inline void scale(const glm::vec<3, T> *d, const T *rest,
+      const T *rigidity, T *scale, T *length)
+  {
+    for (uint32_t lane = 0; lane < Width; ++lane) {
+      length[lane] = std::sqrt(std::max(glm::dot(d[lane], d[lane]), T(1e-12)));
+      const T invLength = T(1) / length[lane];
+      scale[lane] = rigidity[lane] * (T(1) - rest[lane] * invLength);
+    }
+  }
+};
+
+#ifdef CLOTH_USE_SSE
+// 1 / |d| from the hardware reciprocal square root refined by one Newton
+// step (~22 bits, against ~12 for rsqrtps alone)
+template <> struct SpringLanes<float, 4>
+{
+  static inline void scale(const glm::vec3 *d, const float *rest,
+      const float *rigidity, float *scale, float *length)
+  {
+    const float4 x(d[0].x, d[1].x, d[2].x, d[3].x);
+    const float4 y(d[0].y, d[1].y, d[2].y, d[3].y);
+    const float4 z(d[0].z, d[1].z, d[2].z, d[3].z);
+    const float4 length2 = max(x * x + y * y + z * z, float4(1e-12f));
+    const float4 estimate = _mm_rsqrt_ps(length2.v);
+    const float4 invLength =
+        estimate * (float4(1.5f) -
+                       (float4(0.5f) * length2) * (estimate * estimate));
+    const float4 k(rigidity[0], rigidity[1], rigidity[2], rigidity[3]);
+    (k * (float4(1.f) - float4::load(rest) * invLength)).store(scale);
+    (length2 * invLength).store(length);
+  }
+};
+#endif
+
+// Leapfrog of the particles, one at a time
+template <typename Real, typename Force, uint32_t Width> struct ParticleLanes
+{
+  using Kernel = ClothKernel<Real, Force, Width>;
+
+  static inline void integrate(const StepParams &params,
+      const typename Kernel::Particles &particles,
+      const typename Kernel::ForceVec *springForces,
+      const glm::vec3 *external, size_t begin, size_t end)
+  {
+    using ForceVec = typename Kernel::ForceVec;
+    const Real h = Real(params.h);
+    for (size_t p = begin; p < end; ++p) {
+      if (!params.solver.implicit) {
+        ForceVec force(external ? external[p - begin] : params.force);
+        for (uint32_t e = particles.incidenceOffsets[p];
+             e < particles.incidenceEnds[p]; ++e) {
+          const uint32_t entry = particles.incidence[e];
+          const ForceVec &f = springForces[entry >> 1];
+          force += (entry & 1) ? -f : f;
+        }
+        particles.speeds[p] +=
+            h * typename Kernel::Vec(force) * particles.invMasses[p];
+      }
+      particles.positions[p] += h * particles.speeds[p];
+    }
+  }
+};
+
+#ifdef CLOTH_USE_SSE
+// A particle in a register, x, y and z in its first lanes: the spring forces
+// are gathered whole, their sign applied by a multiply
+template <> struct ParticleLanes<float, float, 4>
+{
+  using Kernel = ClothKernel<float, float, 4>;
+
+  static inline void integrate(const StepParams &params,
+      const Kernel::Particles &particles, const glm::vec3 *springForces,
+      const glm::vec3 *external, size_t begin, size_t end)
+  {
+    const float4 h(params.h);
+    const float4 uniform = float4::load3(&params.force.x);
+    const float4 signs[2] = {float4(1.f), float4(-1.f)};
+    for (size_t p = begin; p < end; ++p) {
+      float4 speed = float4::load3(&particles.speeds[p].x);
+      if (!params.solver.implicit) {
+        float4 force =
+            external ? float4::load3(&external[p - begin].x) : uniform;
+        for (uint32_t e = particles.incidenceOffsets[p];
+             e < particles.incidenceEnds[p]; ++e) {
+          const uint32_t entry = particles.incidence[e];
+          force = force + signs[entry & 1] *
+                              float4::load3(&springForces[entry >> 1].x);
+        }
+        speed = speed + h * force * float4(particles.invMasses[p]);
+        speed.store3(&particles.speeds[p].x);
+      }
+      (float4::load3(&particles.positions[p].x) + h * speed)
+          .store3(&particles.positions[p].x);
+    }
+  }
+};
+#endif
+
+template <typename Real, typename Force, uint32_t Width, bool Telemetry>
+void restOffsetSprings(const StepParams &params,
+    const typename ClothKernel<Real, Force, Width>::Particles &particles,
+    const typename ClothKernel<Real, Force, Width>::Springs &springs,
+    size_t begin, size_t end, SpringStats *stats)
+{
+  using ForceVec = typename ClothKernel<Real, Force, Width>::ForceVec;
+  for (size_t s = begin; s < end; ++s) {
+    const uint32_t a = springs.a[s];
+    const uint32_t b = springs.b[s];
+    const SpringMaterial &m = params.springs[springs.family[s]];
+    const ForceVec d =
+        ForceVec(particles.positions[b] - particles.positions[a]);
+    const ForceVec elongation = d - ForceVec(springs.rest[s]);
+    springs.forces[s] =
+        Force(m.rigidity) * elongation +
+        Force(m.viscosity) *
+            ForceVec(particles.speeds[b] - particles.speeds[a]);
+    if (Telemetry) {
+      stats->add(springs.family[s],
+          float(glm::length(d) / springs.restLength[s] - Force(1)),
+          float(Force(0.5) * Force(m.rigidity) *
+                glm::dot(elongation, elongation)));
+    }
+  }
+}
+
+// k * (|d| - l) * d / |d| is evaluated as k * (1 - l / |d|) * d, the lengths
+// of Width springs at a time
+template <typename Real, typename Force, uint32_t Width, bool Telemetry>
+void restLengthSprings(const StepParams &params,
+    const typename ClothKernel<Real, Force, Width>::Particles &particles,
+    const typename ClothKernel<Real, Force, Width>::Springs &springs,
+    size_t begin, size_t end, SpringStats *stats)
+{
+  using ForceVec = typename ClothKernel<Real, Force, Width>::ForceVec;
+  const auto apply = [&](size_t s, auto lanes) {
+    constexpr uint32_t LANES = decltype(lanes)::value;
+    ForceVec d[LANES];
+    Force rigidity[LANES], scale[LANES], length[LANES], widened[LANES];
+    for (uint32_t lane = 0; lane < LANES; ++lane) {
+      const uint32_t a = springs.a[s + lane];
+      const uint32_t b = springs.b[s + lane];
+      d[lane] = ForceVec(particles.positions[b] - particles.positions[a]);
+      rigidity[lane] = Force(params.springs[springs.family[s + lane]].rigidity);
+      widened[lane] = Force(springs.restLength[s + lane]);
+    }
+    // Float rest lengths are read in place
+    const Force *rest = widened;
+    if constexpr (std::is_same<Force, float>::value) {
+      rest = &springs.restLength[s];
+    }
+    SpringLanes<Force, LANES>::scale(d, rest, rigidity, scale, length);
+    for (uint32_t lane = 0; lane < LANES; ++lane) {
+      const uint32_t a = springs.a[s + lane];
+      const uint32_t b = springs.b[s + lane];
+      const Force viscosity =
+          Force(params.springs[springs.family[s + lane]].viscosity);
+      springs.forces[s + lane] =
+          scale[lane] * d[lane] +
+          viscosity * ForceVec(particles.speeds[b] - particles.speeds[a]);
+      if (Telemetry) {
+        const Force elongation = length[lane] - rest[lane];
+        stats->add(springs.family[s + lane], float(elongation / rest[lane]),
+            float(Force(0.5) * rigidity[lane] * elongation * elongation));
+      }
+    }
+  };
+
+  size_t s = begin;
+  for (; s + Width <= end; s += Width) {
+    apply(s, std::integral_constant<uint32_t, Width>());
+  }
+  for (; s < end; ++s) {
+    apply(s, std::integral_constant<uint32_t, 1>());
+  }
+}
+
+} // namespace
+
+template <typename Real, typename Force, uint32_t Width>
+void ClothKernel<Real, Force, Width>::applyRestOffsetSprings(
+    const StepParams &params, const Particles &particles,
+    const Springs &springs, size_t begin, size_t end, SpringStats *stats)
+{
+  if (stats) {
+    restOffsetSprings<Real, Force, Width, true>(
+        params, particles, springs, begin, end, stats);
+  } else {
+    restOffsetSprings<Real, Force, Width, false>(
+        params, particles, springs, begin, end, stats);
+  }
+}
+
+template <typename Real, typename Force, uint32_t Width>
+void ClothKernel<Real, Force, Width>::applyRestLengthSprings(
+    const StepParams &params, const Particles &particles,
+    const Springs &springs, size_t begin, size_t end, SpringStats *stats)
+{
+  if (stats) {
+    restLengthSprings<Real, Force, Width, true>(
+        params, particles, springs, begin, end, stats);
+  } else {
+    restLengthSprings<Real, Force, Width, false>(
+        params, particles, springs, begin, end, stats);
+  }
+}
+
+template <typename Real, typename Force, uint32_t Width>
+void ClothKernel<Real, Force, Width>::integrate(const StepParams &params,
+    const Particles &particles, const ForceVec *springForces,
+    const glm::vec3 *external, size_t begin, size_t end)
+{
+  ParticleLanes<Real, Force, Width>::integrate(
+      params, particles, springForces, external, begin, end);
+}
+
+template struct ClothKernel<float, float, 1>;
+template struct ClothKernel<float, float, 4>;
+template struct ClothKernel<double, double, 1>;
+template struct ClothKernel<double, float, 4>;
+
+template <typename Real, typename Force, uint32_t Width>
+ClothCopy<Real, Force, Width>::ClothCopy(const Cloth &cloth) :
+    m_springA(cloth.m_springA),
+    m_springB(cloth.m_springB),
+    m_springFamily(cloth.m_springFamily),
+    m_springRest(cloth.m_springRest),
+    m_springRestLength(cloth.m_springRestLength),
+    m_springForces(cloth.m_springA.size()),
+    m_restLength(cloth.m_springModel == SpringModel::RestLength),
+    m_incidenceOffsets(cloth.m_incidenceOffsets),
+    m_incidenceEnds(cloth.m_incidenceEnds),
+    m_incidence(cloth.m_incidence)
+{
+  for (size_t p = 0; p < cloth.m_positions.size(); ++p) {
+    m_positions.push_back(Vec(cloth.m_positions[p]));
+    m_speeds.push_back(Vec(cloth.m_speeds[p]));
+    m_invMasses.push_back(Real(cloth.m_invMasses[p]));
+  }
+}
+
+template <typename Real, typename Force, uint32_t Width>
+void ClothCopy<Real, Force, Width>::step(const StepParams &params)
+{
+  StepParams explicitParams = params;
+  explicitParams.solver.implicit = false;
+  const typename Kernel::Particles particles{m_positions.data(),
+      m_speeds.data(), m_invMasses.data(), m_incidenceOffsets.data(),
+      m_incidenceEnds.data(), m_incidence.data()};
+  const typename Kernel::Springs springs{m_springA.data(), m_springB.data(),
+      m_springFamily.data(), m_springRest.data(), m_springRestLength.data(),
+      m_springForces.data()};
+  if (m_restLength) {
+    Kernel::applyRestLengthSprings(
+        explicitParams, particles, springs, 0, m_springA.size(), nullptr);
+  } else {
+    Kernel::applyRestOffsetSprings(
+        explicitParams, particles, springs, 0, m_springA.size(), nullptr);
+  }
+  Kernel::integrate(explicitParams, particles, m_springForces.data(), nullptr,
+      0, m_positions.size());
+}
+
+template <typename Real, typename Force, uint32_t Width>
+void ClothCopy<Real, Force, Width>::translate(const Vec &offset)
+{
+  for (auto &position : m_positions) {
+    position += offset;
+  }
+}
+
+template class ClothCopy<float, float, 1>;
+template class ClothCopy<float, float, 4>;
+template class ClothCopy<double, double, 1>;
+template class ClothCopy<double, float, 4>;
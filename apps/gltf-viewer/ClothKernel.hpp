@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ClothMaterial.hpp"
+
+class Cloth;
+
+// Spring terms of Cloth::Telemetry summed over a run of springs
+struct SpringStats
+{
+  float potential;
+  float maxStrain[SPRING_FAMILY_COUNT];
+  float strainSum[SPRING_FAMILY_COUNT];
+
+  inline void add(uint8_t family, float strain, float energy)
+  {
+    potential += energy;
+    maxStrain[family] = std::max(maxStrain[family], strain);
+    strainSum[family] += std::abs(strain);
+  }
+};
+
+// The spring and integration passes of a cloth over its flat arrays, at a
+// chosen precision: positions and speeds are kept in Real, the spring forces
+// computed in Force, Width springs or particles at a time. Float at the SSE
+// width is the real time one, where a spring or a particle fills a register
+// and the lengths of four springs are computed together. Double keeps long
+// offline runs from drifting, and float forces over double positions sits in
+// between: the offsets between the ends of a spring are small enough for
+// floats wherever the cloth goes. Cloth runs the three of them, see
+// ClothPrecision, and only the variants below are instantiated.
+template <typename Real, typename Force, uint32_t Width> struct ClothKernel
+{
+  using Vec = glm::vec<3, Real>;
+  using ForceVec = glm::vec<3, Force>;
+
+  struct Particles
+  {
+    Vec *positions, *speeds;
+    const Real *invMasses; // 0 for pinned particles
+    // Springs of each particle in CSR form, entries are spring << 1 | (p == b)
+    const uint32_t *incidenceOffsets, *incidenceEnds, *incidence;
+  };
+
+  struct Springs
+  {
+    const uint32_t *a, *b;
+    const uint8_t *family; // SpringFamily
+    // As the cloth was built, in float whatever the precision
+    const glm::vec3 *rest; // RestOffset springs only
+    const float *restLength;
+    ForceVec *forces; // applied to a, minus to b
+  };
+
+  // Forces of springs [begin, end), adding their strain and energy to stats
+  // unless it is null. The ends of a spring are subtracted in Real before
+  // rounding to Force, which is what keeps float forces accurate far from
+  // the origin.
+  static void applyRestOffsetSprings(const StepParams &params,
+      const Particles &particles, const Springs &springs, size_t begin,
+      size_t end, SpringStats *stats);
+  static void applyRestLengthSprings(const StepParams &params,
+      const Particles &particles, const Springs &springs, size_t begin,
+      size_t end, SpringStats *stats);
+
+  // Leapfrog of particles [begin, end), gathering the forces of their
+  // springs on top of external[p - begin], or params.force alone if null,
+  // unless an implicit solve already updated the speeds
+  static void integrate(const StepParams &params, const Particles &particles,
+      const ForceVec *springForces, const glm::vec3 *external, size_t begin,
+      size_t end);
+};
+
+extern template struct ClothKernel<float, float, 1>;
+extern template struct ClothKernel<float, float, 4>;
+extern template struct ClothKernel<double, double, 1>;
+extern template struct ClothKernel<double, float, 4>;
+
+// The particles of a cloth copied at any precision, stepped explicitly by the
+// kernel above under params.force alone: wind, obstacles and collisions
+// aside. The bare passes, scalar ones included, far from the origin if need
+// be.
+template <typename Real, typename Force, uint32_t Width> class ClothCopy
+{
+public:
+  using Kernel = ClothKernel<Real, Force, Width>;
+  using Vec = typename Kernel::Vec;
+  using ForceVec = typename Kernel::ForceVec;
+
+  explicit ClothCopy(const Cloth &cloth);
+
+  void step(const StepParams &params);
+
+  // Move every particle, to see how far from the origin a precision holds
+  void translate(const Vec &offset);
+
+  inline const std::vector<Vec> &positions() const { return m_positions; }
+
+private:
+  std::vector<Vec> m_positions, m_speeds;
+  std::vector<Real> m_invMasses;
+
+  std::vector<uint32_t> m_springA, m_springB;
+  std::vector<uint8_t> m_springFamily;
+  std::vector<glm::vec3> m_springRest;
+  std::vector<float> m_springRestLength;
+  std::vector<ForceVec> m_springForces;
+  bool m_restLength;
+
+  std::vector<uint32_t> m_incidenceOffsets, m_incidenceEnds, m_incidence;
+};
+
+extern template class ClothCopy<float, float, 1>;
+extern template class ClothCopy<float, float, 4>;
+extern template class ClothCopy<double, double, 1>;
+extern template class ClothCopy<double, float, 4>;
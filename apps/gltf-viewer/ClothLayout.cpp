@@ -0,0 +1,95 @@
+#include "ClothLayout.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Spread the 16 low bits of x so that there is a zero between each of them
+uint32_t spreadBits(uint32_t x)
+{
+  x &= 0x0000ffff;
+  x = (x | (x << 8)) & 0x00ff00ff;
+  x = (x | (x << 4)) & 0x0f0f0f0f;
+  x = (x | (x << 2)) & 0x33333333;
+  x = (x | (x << 1)) & 0x55555555;
+  return x;
+}
+
+uint64_t mortonKey(uint32_t i, uint32_t j)
+{
+  // Bits above 16 are kept as a column-major prefix so that huge grids still
+  // get a total order
+  const uint64_t high = (uint64_t(i >> 16) << 16) | (j >> 16);
+  return (high << 32) | (spreadBits(i) << 1) | spreadBits(j);
+}
+
+uint64_t tiledKey(uint32_t i, uint32_t j, uint32_t height)
+{
+  const uint32_t T = ClothLayout::TILE_SIZE;
+  const uint64_t tilesPerColumn = (height + T - 1) / T;
+  const uint64_t tile = (i / T) * tilesPerColumn + j / T;
+  return (tile << 32) | ((i % T) * T + j % T);
+}
+
+} // namespace
+
+ParticleOrdering parseParticleOrdering(const std::string &name)
+{
+  if (name == "column") {
+    return ParticleOrdering::ColumnMajor;
+  }
+  if (name == "morton") {
+    return ParticleOrdering::Morton;
+  }
+  if (name == "tiled") {
+    return ParticleOrdering::Tiled;
+  }
+  throw std::invalid_argument("Unknown particle ordering " + name +
+                              " (expected column, morton or tiled)");
+}
+
+const char *toString(ParticleOrdering ordering)
+{
+  switch (ordering) {
+  case ParticleOrdering::ColumnMajor:
+    return "column";
+  case ParticleOrdering::Morton:
+    return "morton";
+  case ParticleOrdering::Tiled:
+    return "tiled";
+  }
+  return "unknown";
+}
+
+ClothLayout::ClothLayout(
+    uint32_t width, uint32_t height, ParticleOrdering ordering) :
+    m_width(width),
+    m_height(height),
+    m_ordering(ordering),
+    m_slots(size_t(width) * height),
+    m_cells(size_t(width) * height)
+{
+  std::vector<std::pair<uint64_t, uint32_t>> keys;
+  keys.reserve(m_slots.size());
+  for (uint32_t i = 0; i < width; ++i) {
+    for (uint32_t j = 0; j < height; ++j) {
+      uint64_t key = uint64_t(i) * height + j;
+      if (ordering == ParticleOrdering::Morton) {
+        key = mortonKey(i, j);
+      } else if (ordering == ParticleOrdering::Tiled) {
+        key = tiledKey(i, j, height);
+      }
+      keys.emplace_back(key, i * height + j);
+    }
+  }
+  if (ordering != ParticleOrdering::ColumnMajor) {
+    std::sort(keys.begin(), keys.end());
+  }
+
+  for (uint32_t slot = 0; slot < keys.size(); ++slot) {
+    const uint32_t gridIndex = keys[slot].second;
+    m_slots[gridIndex] = slot;
+    m_cells[slot] = glm::uvec2(gridIndex / height, gridIndex % height);
+  }
+}
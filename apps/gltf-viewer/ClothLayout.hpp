@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Order in which the particles of a width x height grid are stored
+enum class ParticleOrdering
+{
+  ColumnMajor, // slot = i * height + j, the historical layout
+  Morton, // Z-order curve over (i, j)
+  Tiled // TILE_SIZE x TILE_SIZE blocks, column-major inside and across blocks
+};
+
+ParticleOrdering parseParticleOrdering(const std::string &name);
+const char *toString(ParticleOrdering ordering);
+
+// Bijection between grid coordinates (i, j) and storage slots
+class ClothLayout
+{
+public:
+  static const uint32_t TILE_SIZE = 8;
+
+  ClothLayout(uint32_t width, uint32_t height, ParticleOrdering ordering);
+
+  inline uint32_t index(uint32_t i, uint32_t j) const
+  {
+    return m_slots[i * m_height + j];
+  }
+  inline glm::uvec2 cell(uint32_t slot) const { return m_cells[slot]; }
+
+  inline uint32_t width() const { return m_width; }
+  inline uint32_t height() const { return m_height; }
+  inline uint32_t size() const { return m_width * m_height; }
+  inline ParticleOrdering ordering() const { return m_ordering; }
+
+private:
+  uint32_t m_width, m_height;
+  ParticleOrdering m_ordering;
+  std::vector<uint32_t> m_slots; // column-major (i, j) -> slot
+  std::vector<glm::uvec2> m_cells; // slot -> (i, j)
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <glm/glm.hpp>
+
+class ColliderSet;
+class WindField;
+
+// Springs are grouped by the role they play in the mesh
+enum class SpringFamily : uint8_t
+{
+  Structural, // horizontal and vertical neighbours
+  Shear, // diagonals
+  Bend, // bridges skipping one particle
+};
+
+const uint32_t SPRING_FAMILY_COUNT = 3;
+
+inline const char *toString(SpringFamily family)
+{
+  switch (family) {
+  case SpringFamily::Structural:
+    return "Structural";
+  case SpringFamily::Shear:
+    return "Shear";
+  case SpringFamily::Bend:
+    return "Bend";
+  }
+  return "Unknown";
+}
+
+struct SpringMaterial
+{
+  float rigidity; // k, raideur
+  float viscosity; // z, viscosité
+};
+
+// Per-cloth coefficients, independent of the time step
+struct ClothMaterial
+{
+  SpringMaterial springs[SPRING_FAMILY_COUNT] = {
+      {0.00965f, 0.0024f}, {0.00965f, 0.0024f}, {0.00965f, 0.0024f}};
+  // Distance kept between the cloth and itself, 0 lets it pass through
+  float thickness = 0.f;
+  // Aerodynamic coefficients of the triangles, the air density and the 1/2
+  // folded in, 0 for none
+  float drag = 0.f;
+  float lift = 0.f;
+  // Relative elongation breaking a spring, 0 for none
+  float tearStrain = 0.f;
+  // Speed under which a settled tile of particles sleeps, 0 for never
+  float sleepSpeed = 0.f;
+
+  inline SpringMaterial &operator[](SpringFamily family)
+  {
+    return springs[uint32_t(family)];
+  }
+  inline const SpringMaterial &operator[](SpringFamily family) const
+  {
+    return springs[uint32_t(family)];
+  }
+};
+
+// How an implicit step solves its linear system, see Multigrid
+enum class SolverMethod
+{
+  Jacobi, // damped Jacobi sweeps on the particle grid alone
+  VCycle, // multigrid V-cycles
+  MultigridCG, // conjugate gradient preconditioned by a V-cycle
+};
+
+inline const char *toString(SolverMethod method)
+{
+  switch (method) {
+  case SolverMethod::Jacobi:
+    return "jacobi";
+  case SolverMethod::VCycle:
+    return "vcycle";
+  case SolverMethod::MultigridCG:
+    return "mgcg";
+  }
+  return "unknown";
+}
+
+inline SolverMethod parseSolverMethod(const std::string &name)
+{
+  for (auto method : {SolverMethod::Jacobi, SolverMethod::VCycle,
+           SolverMethod::MultigridCG}) {
+    if (name == toString(method)) {
+      return method;
+    }
+  }
+  throw std::invalid_argument(
+      "Unknown solver " + name + " (expected jacobi, vcycle or mgcg)");
+}
+
+struct SolverSettings
+{
+  // Backward Euler, springs and damping taken at the end of the step,
+  // instead of symplectic Euler
+  bool implicit = false;
+  SolverMethod method = SolverMethod::MultigridCG;
+  float tolerance = 1e-4f; // relative residual
+  uint32_t maxIterations = 50;
+};
+
+// Wind varying over the cloth, added to StepParams::force per particle
+struct WindParams
+{
+  static const uint32_t MAX_GUSTS = 4;
+
+  const WindField *field; // null for a uniform wind
+  glm::mat4 toField; // cloth space to grid cells of the field
+  glm::mat3 toForce; // field velocity to force in the cloth space
+  // Gusts are still in the field: spheres of air carried by the turbulence,
+  // pushing along gustForce times their strength, fading to their border
+  glm::vec3 gustForce;
+  float gustInvRadius2; // in cells
+  uint32_t gustCount;
+  glm::vec4 gusts[MAX_GUSTS]; // center in cells, strength in [0, 1]
+};
+
+// Drag along the air flowing past each triangle and lift across it, both
+// growing with the square of the relative speed and the angle of attack
+struct AeroParams
+{
+  glm::vec3 air; // velocity of the air in the cloth space
+  float drag, lift; // scaled for h
+};
+
+// Everything a step reads, so that cloths never share mutable state
+struct StepParams
+{
+  float h;
+  glm::vec3 force; // applied to every particle
+  SpringMaterial springs[SPRING_FAMILY_COUNT]; // scaled for h
+  float thickness; // self-collision, disabled at 0
+  float tearStrain; // disabled at 0
+  float sleepSpeed; // disabled at 0
+  const ColliderSet *colliders; // in the cloth space, may be null
+  bool telemetry; // measure the spring energy and strain, see Cloth
+  SolverSettings solver;
+  WindParams wind;
+  AeroParams aero;
+};
+
+// Rigidity and viscosity are given per step: k = rigidity / h^2 and
+// z = viscosity / h
+inline StepParams makeStepParams(
+    const ClothMaterial &material, float h, const glm::vec3 &force)
+{
+  const float fe = 1.f / h;
+
+  StepParams params;
+  params.h = h;
+  params.force = force;
+  params.thickness = material.thickness;
+  params.tearStrain = material.tearStrain;
+  params.sleepSpeed = material.sleepSpeed;
+  params.colliders = nullptr;
+  params.telemetry = false;
+  params.solver = SolverSettings();
+  params.wind = WindParams();
+  params.wind.field = nullptr;
+  params.aero.air = glm::vec3(0.f);
+  params.aero.drag = material.drag * fe;
+  params.aero.lift = material.lift * fe;
+  for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+    params.springs[f].rigidity = material.springs[f].rigidity * fe * fe;
+    params.springs[f].viscosity = material.springs[f].viscosity * fe;
+  }
+  return params;
+}
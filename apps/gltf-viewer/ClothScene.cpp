@@ -0,0 +1,422 @@
+#include "ClothScene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+
+// A gust lasts that long, growing then fading
+const float GUST_SECONDS = 2.f;
+
+// Uniform in [0, 1) from two integers
+float hash01(uint32_t a, uint32_t b)
+{
+  uint32_t x = a * 0x9e3779b9u ^ (b + 0x7f4a7c15u);
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return float(x >> 8) / float(1u << 24);
+}
+
+} // namespace
+
+void applyPinSet(Cloth &cloth, PinSet pins)
+{
+  const uint32_t width = cloth.layout().width();
+  const uint32_t height = cloth.layout().height();
+  for (uint32_t i = 0; i < width; ++i) {
+    for (uint32_t j = 0; j < height; ++j) {
+      bool pinned = false;
+      switch (pins) {
+      case PinSet::Pole:
+        pinned = i == 0;
+        break;
+      case PinSet::Corners:
+        pinned = i == 0 && (j == 0 || j == height - 1);
+        break;
+      case PinSet::TopEdge:
+        pinned = j == height - 1;
+        break;
+      }
+      cloth.setPinned(i, j, pinned);
+    }
+  }
+}
+
+ClothScene::ClothScene(uint32_t instanceCount, uint32_t width,
+    uint32_t height, float step, float mass, ParticleOrdering ordering,
+    SpringModel springModel, ClothPrecision precision) :
+    m_boundsMin(std::numeric_limits<float>::max()),
+    m_boundsMax(std::numeric_limits<float>::lowest())
+{
+  const uint32_t columns =
+      uint32_t(std::ceil(std::sqrt(float(std::max(instanceCount, 1u)))));
+  const glm::vec2 extent(width * step, height * step);
+  const glm::vec3 spacing(1.5f * extent.x, 0.6f * extent.y, 1.2f * extent.x);
+
+  m_instances.reserve(instanceCount);
+  for (uint32_t n = 0; n < instanceCount; ++n) {
+    const uint32_t column = n % columns;
+    const uint32_t row = n / columns;
+
+    // Rows climb and move back like stadium tiers, flags alternate a small
+    // yaw so they don't all face the wind the same way
+    const glm::vec3 translation((column - (columns - 1) * 0.5f) * spacing.x,
+        row * spacing.y, -(row * spacing.z));
+    const float yaw = n == 0 ? 0.f : ((n % 2) ? 0.15f : -0.15f);
+    const glm::mat4 transform =
+        glm::rotate(glm::translate(glm::mat4(1), translation), yaw,
+            glm::vec3(0, 1, 0));
+
+    const PinSet pins = PinSet(n % 3);
+    // Golden angle, so neighbours never flap in phase
+    const float windPhase =
+        std::fmod(n * 2.39996323f, 2.f * glm::pi<float>());
+
+    m_instances.push_back(ClothInstance{
+        Cloth(width, height, step, mass, ordering, springModel, precision),
+        transform, pins, windPhase});
+    applyPinSet(m_instances.back().cloth, pins);
+
+    for (const float x : {-0.5f * extent.x, 0.5f * extent.x}) {
+      for (const float y : {-0.5f * extent.y, 0.5f * extent.y}) {
+        const glm::vec3 corner = glm::vec3(transform * glm::vec4(x, y, 0, 1));
+        m_boundsMin = glm::min(m_boundsMin, corner);
+        m_boundsMax = glm::max(m_boundsMax, corner);
+      }
+    }
+  }
+
+  // The ground below the lowest cloth, a pole along each pinned column or a
+  // bar along each pinned row, and a ball and a crate on both sides of the
+  // first cloth
+  ColliderSet colliders;
+  colliders.margin = 0.1f * step;
+  const float ground = m_boundsMin.y - 0.5f * extent.y;
+  colliders.planes.push_back({glm::vec3(0, 1, 0), ground});
+  m_clothExtent = extent;
+  m_ground = ground;
+
+  const float poleRadius = 0.5f * step;
+  const float poleOffset = poleRadius + colliders.margin;
+  const glm::vec3 firstColumn(-0.5f * width * step, 0, 0);
+  const glm::vec3 lastRow(0, (0.5f * height - 1) * step, 0);
+  for (const auto &instance : m_instances) {
+    const auto toWorld = [&](const glm::vec3 &p) {
+      return glm::vec3(instance.transform * glm::vec4(p, 1));
+    };
+    if (instance.pins == PinSet::TopEdge) {
+      const glm::vec3 bar = lastRow + glm::vec3(0, poleOffset, 0);
+      colliders.capsules.push_back(
+          {toWorld(bar - glm::vec3(0.5f * extent.x, 0, 0)),
+              toWorld(bar + glm::vec3(0.5f * extent.x, 0, 0)), poleRadius});
+    } else {
+      const glm::vec3 pole = firstColumn - glm::vec3(poleOffset, 0, 0);
+      const glm::vec3 foot = toWorld(pole);
+      colliders.capsules.push_back({glm::vec3(foot.x, ground, foot.z),
+          toWorld(pole + glm::vec3(0, 0.5f * extent.y + step, 0)),
+          poleRadius});
+    }
+  }
+
+  if (!m_instances.empty()) {
+    const glm::mat4 &first = m_instances.front().transform;
+    colliders.spheres.push_back(
+        {glm::vec3(first * glm::vec4(0.2f * extent.x, -0.1f * extent.y,
+                               0.3f * extent.x, 1)),
+            0.15f * extent.x});
+    colliders.boxes.push_back(
+        {glm::vec3(first * glm::vec4(0.25f * extent.x, -0.25f * extent.y,
+                               -0.3f * extent.x, 1)),
+            glm::mat3(glm::rotate(first, 0.4f, glm::vec3(0, 1, 0))),
+            glm::vec3(0.15f * extent.x)});
+  }
+  setColliders(colliders);
+}
+
+void ClothScene::setColliders(const ColliderSet &colliders)
+{
+  m_colliders = colliders;
+  m_localColliders.clear();
+  for (const auto &instance : m_instances) {
+    // Local to world is rigid, its inverse brings the obstacles to the cloth
+    m_localColliders.push_back(
+        colliders.transformed(glm::inverse(instance.transform)));
+  }
+}
+
+glm::mat4 ClothScene::groundPlacement(
+    const glm::vec3 &low, const glm::vec3 &high) const
+{
+  const glm::vec3 size = high - low;
+  const float largest = std::max(std::max(size.x, size.y), size.z);
+  const float scale = largest > 0.f ? 0.5f * m_clothExtent.y / largest : 1.f;
+
+  // Bottom center of the model on the ground, below the middle of the cloth
+  const glm::vec3 center = m_instances.empty()
+                               ? glm::vec3(0)
+                               : glm::vec3(m_instances.front().transform[3]);
+  const glm::vec3 anchor(
+      0.5f * (low.x + high.x), low.y, 0.5f * (low.z + high.z));
+  glm::mat4 placement = glm::translate(
+      glm::mat4(1), glm::vec3(center.x, m_ground, center.z));
+  placement = glm::scale(placement, glm::vec3(scale));
+  return glm::translate(placement, -anchor);
+}
+
+void ClothScene::step(ThreadPool &pool, const ClothMaterial &material,
+    float h, float time, float gravity, const Wind &wind)
+{
+  prepareStep(material, h, time, gravity, wind);
+  pool.parallelFor(m_instances.size(), [&](size_t n) {
+    m_instances[n].cloth.step(m_stepParams[n], &pool);
+    m_instances[n].cloth.computeNormals(m_stepParams[n]);
+  });
+}
+
+void ClothScene::prepareStep(const ClothMaterial &material, float h,
+    float time, float gravity, const Wind &wind)
+{
+  // Springs broken by the last step, no task touches them here
+  for (auto &instance : m_instances) {
+    instance.cloth.tear();
+  }
+
+  const float fe = 1.f / h;
+  const glm::vec3 g = glm::vec3(0, -gravity * fe, 0);
+
+  // World to field cells, the turbulence drifting with time
+  const glm::mat4 worldToField =
+      glm::translate(glm::scale(glm::mat4(1), glm::vec3(1.f / wind.scale)),
+          -wind.drift * time);
+  const glm::vec3 gustDirection = glm::length(wind.drift) > 0.f
+                                      ? glm::normalize(wind.drift)
+                                      : glm::vec3(0.f);
+
+  // One gust may start in every slot of 1 / gustRate seconds, at a random
+  // time. Halfway through it is over a random point of the scene, where the
+  // drift brought it from.
+  uint32_t gustCount = 0;
+  glm::vec4 gusts[WindParams::MAX_GUSTS];
+  if (wind.gustRate > 0.f && wind.gustStrength > 0.f) {
+    const float now = time * wind.gustRate;
+    const int64_t last = int64_t(std::floor(now));
+    const int64_t first =
+        last - int64_t(std::ceil(GUST_SECONDS * wind.gustRate));
+    for (int64_t slot = first;
+         slot <= last && gustCount < WindParams::MAX_GUSTS; ++slot) {
+      const uint32_t key = uint32_t(slot);
+      const float start = (float(slot) + hash01(key, 0)) / wind.gustRate;
+      const float age = (time - start) / GUST_SECONDS;
+      if (age < 0.f || age >= 1.f) {
+        continue;
+      }
+      const glm::vec3 center =
+          glm::mix(m_boundsMin, m_boundsMax,
+              glm::vec3(hash01(key, 1), hash01(key, 2), hash01(key, 3))) -
+          wind.drift * (start + 0.5f * GUST_SECONDS);
+      const float envelope = std::sin(glm::pi<float>() * age);
+      gusts[gustCount++] =
+          glm::vec4(center / wind.scale, envelope * envelope);
+    }
+  }
+  // A gust covers about one cloth
+  const float gustRadius = std::max(m_clothExtent.x, m_clothExtent.y);
+  const float gustInvRadius2 =
+      wind.scale * wind.scale / (gustRadius * gustRadius);
+
+  m_stepParams.resize(m_instances.size());
+  for (size_t n = 0; n < m_instances.size(); ++n) {
+    const ClothInstance &instance = m_instances[n];
+    const glm::vec3 windForce =
+        wind.amplitude *
+        glm::cos(wind.frequency * time + glm::vec3(instance.windPhase)) * fe;
+
+    // World to local is the transposed rotation
+    const glm::mat3 toLocal = glm::transpose(glm::mat3(instance.transform));
+
+    m_stepParams[n] = makeStepParams(material, h, toLocal * (g + windForce));
+    if (m_collidersEnabled && !m_localColliders[n].empty()) {
+      m_stepParams[n].colliders = &m_localColliders[n];
+    }
+    m_stepParams[n].telemetry = m_telemetryEnabled;
+    m_stepParams[n].solver = m_solver;
+    m_stepParams[n].aero.air = toLocal * wind.drift;
+    if (wind.turbulence > 0.f || gustCount > 0) {
+      WindParams &local = m_stepParams[n].wind;
+      local.field = &m_windField;
+      local.toField = worldToField * instance.transform;
+      local.toForce = toLocal * (wind.turbulence * fe);
+      local.gustForce = toLocal * gustDirection * (wind.gustStrength * fe);
+      local.gustInvRadius2 = gustInvRadius2;
+      local.gustCount = gustCount;
+      std::copy(gusts, gusts + gustCount, local.gusts);
+    }
+    m_instances[n].cloth.updateSleep(m_stepParams[n]);
+  }
+}
+
+Cloth::Telemetry ClothScene::telemetry() const
+{
+  // Every cloth has as many springs of each family
+  Cloth::Telemetry scene{};
+  std::fill(std::begin(scene.maxStrain), std::end(scene.maxStrain),
+      std::numeric_limits<float>::lowest());
+  for (const auto &instance : m_instances) {
+    const Cloth::Telemetry cloth = instance.cloth.telemetry();
+    scene.kineticEnergy += cloth.kineticEnergy;
+    scene.potentialEnergy += cloth.potentialEnergy;
+    scene.maxSpeed = std::max(scene.maxSpeed, cloth.maxSpeed);
+    for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+      scene.maxStrain[f] = std::max(scene.maxStrain[f], cloth.maxStrain[f]);
+      scene.meanStrain[f] += cloth.meanStrain[f] / m_instances.size();
+    }
+  }
+  return scene;
+}
+
+float ClothScene::stableStep() const
+{
+  float step = std::numeric_limits<float>::max();
+  for (size_t n = 0; n < m_instances.size(); ++n) {
+    step = std::min(step, m_instances[n].cloth.stableStep(m_stepParams[n]));
+  }
+  return step;
+}
+
+void ClothScene::setSubstep(float h)
+{
+  for (auto &params : m_stepParams) {
+    params.h = h;
+  }
+}
+
+ClothScene::StepStages ClothScene::preparedStages() const
+{
+  StepStages stages;
+  for (const auto &params : m_stepParams) {
+    stages.selfCollision |= params.thickness > 0.f;
+    stages.implicit |= params.solver.implicit;
+  }
+  return stages;
+}
+
+std::vector<std::vector<TaskGraph::NodeId>> ClothScene::addStepTasks(
+    TaskGraph &graph, TaskGraph::NodeId prepare, const StepStages &stages,
+    bool normals)
+{
+  std::vector<std::vector<TaskGraph::NodeId>> finished(m_instances.size());
+  for (uint32_t n = 0; n < m_instances.size(); ++n) {
+    Cloth &cloth = m_instances[n].cloth;
+    const std::string prefix = "cloth" + std::to_string(n);
+
+    std::vector<TaskGraph::NodeId> springs;
+    for (uint32_t chunk = 0; chunk < cloth.springChunkCount(); ++chunk) {
+      springs.push_back(graph.addNode(prefix + "/springs",
+          [this, &cloth, n, chunk]() {
+            cloth.computeSpringForces(m_stepParams[n], chunk);
+          }));
+      graph.addDependency(prepare, springs.back());
+    }
+
+    // An implicit step couples every particle, its solve waits for every
+    // spring chunk. Explicit steps integrate a tile once its own chunks are
+    // done.
+    TaskGraph::NodeId solve = 0;
+    if (stages.implicit) {
+      solve = graph.addNode(prefix + "/solve", [this, &cloth, n]() {
+        cloth.solveImplicit(m_stepParams[n], m_solverPool);
+      });
+      graph.addDependency(prepare, solve);
+      for (const auto node : springs) {
+        graph.addDependency(node, solve);
+      }
+    }
+
+    const auto &tiles = cloth.tiles();
+    std::vector<TaskGraph::NodeId> integrate;
+    for (uint32_t tile = 0; tile < tiles.size(); ++tile) {
+      integrate.push_back(graph.addNode(prefix + "/integrate",
+          [this, &cloth, n, tile]() {
+            cloth.integrate(m_stepParams[n], tile);
+          }));
+      if (stages.implicit) {
+        graph.addDependency(solve, integrate.back());
+        continue;
+      }
+      for (uint32_t chunk = tiles[tile].firstSpringChunk;
+           chunk <= tiles[tile].lastSpringChunk; ++chunk) {
+        graph.addDependency(springs[chunk], integrate.back());
+      }
+      if (tiles[tile].firstSpringChunk > tiles[tile].lastSpringChunk) {
+        graph.addDependency(prepare, integrate.back());
+      }
+    }
+
+    // Without self-collision the positions of a tile are final once it is
+    // integrated, its normals only wait for it and its neighbours
+    std::vector<TaskGraph::NodeId> settled = integrate;
+    if (stages.selfCollision) {
+      // Self-collision reads every position, each stage waits for the whole
+      // previous one
+      const auto integrated = graph.addNode(prefix + "/integrated", []() {});
+      for (const auto node : integrate) {
+        graph.addDependency(node, integrated);
+      }
+      const auto prefixed = graph.addNode(
+          prefix + "/prefix", [&cloth]() { cloth.prefixTriangles(); });
+      const auto hashed = graph.addNode(prefix + "/hashed", []() {});
+      for (uint32_t chunk = 0; chunk < cloth.quadChunkCount(); ++chunk) {
+        const auto count = graph.addNode(
+            prefix + "/count", [this, &cloth, n, chunk]() {
+              cloth.countTriangles(m_stepParams[n], chunk);
+            });
+        const auto insert = graph.addNode(
+            prefix + "/insert", [this, &cloth, n, chunk]() {
+              cloth.insertTriangles(m_stepParams[n], chunk);
+            });
+        graph.addDependency(integrated, count);
+        graph.addDependency(count, prefixed);
+        graph.addDependency(prefixed, insert);
+        graph.addDependency(insert, hashed);
+      }
+
+      const auto collided = graph.addNode(prefix + "/collided", []() {});
+      for (uint32_t tile = 0; tile < tiles.size(); ++tile) {
+        const auto collide = graph.addNode(
+            prefix + "/collide", [this, &cloth, n, tile]() {
+              cloth.collide(m_stepParams[n], tile);
+            });
+        graph.addDependency(hashed, collide);
+        graph.addDependency(collide, collided);
+
+        settled[tile] = graph.addNode(prefix + "/resolve",
+            [&cloth, tile]() { cloth.resolveCollisions(tile); });
+        graph.addDependency(collided, settled[tile]);
+      }
+    }
+
+    if (!normals) {
+      finished[n] = settled;
+      continue;
+    }
+    for (uint32_t tile = 0; tile < tiles.size(); ++tile) {
+      finished[n].push_back(graph.addNode(prefix + "/normals",
+          [this, &cloth, n, tile]() {
+            cloth.computeNormals(m_stepParams[n], tile);
+          }));
+      graph.addDependency(settled[tile], finished[n].back());
+      for (const uint32_t neighbor : tiles[tile].neighbors) {
+        graph.addDependency(settled[neighbor], finished[n].back());
+      }
+    }
+  }
+  return finished;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Cloth.hpp"
+#include "Colliders.hpp"
+#include "utils/TaskGraph.hpp"
+#include "utils/ThreadPool.hpp"
+#include "utils/WindField.hpp"
+
+// Which particles of a cloth are held in place
+enum class PinSet
+{
+  Pole, // the whole first column, a flag on its pole
+  Corners, // the two ends of the first column
+  TopEdge, // the last row, a hanging banner
+};
+
+void applyPinSet(Cloth &cloth, PinSet pins);
+
+// Uniform oscillation, plus turbulence and gusts varying over the cloths.
+// Forces are given like amplitude, the turbulence being its RMS.
+struct Wind
+{
+  glm::vec3 amplitude;
+  glm::vec3 frequency;
+  float turbulence = 0.f;
+  float scale = 4.f; // world units per cell of the turbulence
+  // Mean air velocity, carrying the turbulence and flowing past the
+  // triangles for their drag and lift
+  glm::vec3 drift = glm::vec3(0.f, 0.f, 4.f);
+  float gustRate = 0.f; // per second
+  float gustStrength = 0.f; // pushing along the drift
+};
+
+struct ClothInstance
+{
+  Cloth cloth;
+  glm::mat4 transform; // local to world, rotation and translation only
+  PinSet pins;
+  float windPhase; // added to the wind oscillation, in radians
+};
+
+// Many cloths of the same size sharing one material, laid out in rows like a
+// stadium crowd, above a ground with poles and a few obstacles. Every cloth is
+// simulated in its own local space.
+class ClothScene
+{
+public:
+  ClothScene(uint32_t instanceCount, uint32_t width, uint32_t height,
+      float step, float mass, ParticleOrdering ordering,
+      SpringModel springModel,
+      ClothPrecision precision = ClothPrecision::Float);
+
+  // Step and recompute the normals of every cloth, distributed over the pool.
+  // time drives the wind oscillation.
+  void step(ThreadPool &pool, const ClothMaterial &material, float h,
+      float time, float gravity, const Wind &wind);
+
+  // Optional passes of a step. The tasks of a pass are only in the graph
+  // while it is enabled, so that a graph has to be rebuilt once the stages of
+  // the prepared steps change.
+  struct StepStages
+  {
+    bool selfCollision = false; // thickness > 0
+    bool implicit = false; // solver.implicit
+
+    inline bool operator==(const StepStages &other) const
+    {
+      return selfCollision == other.selfCollision &&
+             implicit == other.implicit;
+    }
+    inline bool operator!=(const StepStages &other) const
+    {
+      return !(*this == other);
+    }
+  };
+
+  // Same step split in tasks: prepareStep() applies the tears of the last step,
+  // computes the parameters of every cloth and which of its tiles sleep, then
+  // the tasks added by addStepTasks() run after the node prepare, for steps
+  // prepared with the given stages.
+  // Returns for each cloth the node finishing each of its tiles, the normals
+  // or, without them, the last position update.
+  void prepareStep(const ClothMaterial &material, float h, float time,
+      float gravity, const Wind &wind);
+  StepStages preparedStages() const;
+  std::vector<std::vector<TaskGraph::NodeId>> addStepTasks(TaskGraph &graph,
+      TaskGraph::NodeId prepare, const StepStages &stages,
+      bool normals = true);
+
+  // Largest substep of the prepared step every cloth integrates stably
+  float stableStep() const;
+  // Shorten the prepared step to h, the stiffness and the forces staying
+  // those of the whole step, so that substeps add up to it
+  void setSubstep(float h);
+
+  // Integration of the next prepared steps. The pool, if any, shares the
+  // solve of each cloth in the task graph.
+  inline const SolverSettings &solver() const { return m_solver; }
+  inline void setSolver(const SolverSettings &solver, ThreadPool *pool)
+  {
+    m_solver = solver;
+    m_solverPool = pool;
+  }
+
+  // Measures of the last step over every cloth, the energies summed and the
+  // strains of every spring of a family together. Spring terms are only
+  // measured while enabled, from the next prepared step.
+  Cloth::Telemetry telemetry() const;
+  inline bool telemetryEnabled() const { return m_telemetryEnabled; }
+  inline void setTelemetryEnabled(bool enabled)
+  {
+    m_telemetryEnabled = enabled;
+  }
+
+  inline const std::vector<StepParams> &stepParams() const
+  {
+    return m_stepParams;
+  }
+
+  inline std::vector<ClothInstance> &instances() { return m_instances; }
+  inline const std::vector<ClothInstance> &instances() const
+  {
+    return m_instances;
+  }
+
+  // Obstacles in world space
+  inline const ColliderSet &colliders() const { return m_colliders; }
+  void setColliders(const ColliderSet &colliders);
+  inline bool collidersEnabled() const { return m_collidersEnabled; }
+  inline void setCollidersEnabled(bool enabled)
+  {
+    m_collidersEnabled = enabled;
+  }
+
+  // Uniform scale and translation setting a model of bounds [low, high] on
+  // the ground under the first cloth, its largest side half a cloth high
+  glm::mat4 groundPlacement(
+      const glm::vec3 &low, const glm::vec3 &high) const;
+
+  // Axis aligned box around the cloths at rest, in world space
+  inline glm::vec3 boundsMin() const { return m_boundsMin; }
+  inline glm::vec3 boundsMax() const { return m_boundsMax; }
+
+private:
+  std::vector<ClothInstance> m_instances;
+  std::vector<StepParams> m_stepParams;
+  ColliderSet m_colliders;
+  std::vector<ColliderSet> m_localColliders; // per instance
+  bool m_collidersEnabled = true;
+  bool m_telemetryEnabled = false;
+  SolverSettings m_solver;
+  ThreadPool *m_solverPool = nullptr;
+  WindField m_windField;
+  glm::vec3 m_boundsMin, m_boundsMax;
+  glm::vec2 m_clothExtent;
+  float m_ground;
+};
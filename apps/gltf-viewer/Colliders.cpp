@@ -0,0 +1,313 @@
+#include "Colliders.hpp"
+
+#include <algorithm>
+
+#include "utils/simd.hpp"
+
+namespace {
+
+// Four points, one per lane
+struct Points
+{
+  float4 x, y, z;
+};
+
+inline Points operator-(const Points &p, const glm::vec3 &v)
+{
+  return {p.x - float4(v.x), p.y - float4(v.y), p.z - float4(v.z)};
+}
+
+inline Points operator*(const Points &p, float4 s)
+{
+  return {p.x * s, p.y * s, p.z * s};
+}
+
+inline float4 dot(const Points &p, const Points &q)
+{
+  return p.x * q.x + p.y * q.y + p.z * q.z;
+}
+
+inline float4 dot(const Points &p, const glm::vec3 &v)
+{
+  return p.x * float4(v.x) + p.y * float4(v.y) + p.z * float4(v.z);
+}
+
+inline Points splat(const glm::vec3 &v)
+{
+  return {float4(v.x), float4(v.y), float4(v.z)};
+}
+
+// Distance to the surface and outward normal of the obstacles, per lane
+struct Contact
+{
+  float4 distance;
+  Points normal;
+};
+
+inline Contact pointContact(const Points &offset, float radius)
+{
+  const float4 length = sqrt(max(dot(offset, offset), float4(1e-12f)));
+  return {length - float4(radius), offset * (float4(1.f) / length)};
+}
+
+Contact contact(const Points &p, const PlaneCollider &plane)
+{
+  return {dot(p, plane.normal) - float4(plane.offset), splat(plane.normal)};
+}
+
+Contact contact(const Points &p, const SphereCollider &sphere)
+{
+  return pointContact(p - sphere.center, sphere.radius);
+}
+
+Contact contact(const Points &p, const CapsuleCollider &capsule)
+{
+  const glm::vec3 ab = capsule.b - capsule.a;
+  const Points ap = p - capsule.a;
+  const float4 t = clamp(dot(ap, ab) * float4(1.f / glm::dot(ab, ab)),
+      float4(0.f), float4(1.f));
+  const Points offset = {ap.x - float4(ab.x) * t, ap.y - float4(ab.y) * t,
+      ap.z - float4(ab.z) * t};
+  return pointContact(offset, capsule.radius);
+}
+
+Contact contact(const Points &p, const BoxCollider &box)
+{
+  const Points cp = p - box.center;
+  float4 local[3], sign[3], excess[3], outside[3];
+  for (int k = 0; k < 3; ++k) {
+    local[k] = dot(cp, box.axes[k]);
+    sign[k] = select(local[k] < float4(0.f), float4(-1.f), float4(1.f));
+    excess[k] = abs(local[k]) - float4(box.halfExtents[k]);
+    outside[k] = max(excess[k], float4(0.f));
+  }
+
+  // Outside: distance to the closest point of the box. Inside: distance to
+  // the closest face, pushed along its axis.
+  const float4 outsideLength = sqrt(max(
+      outside[0] * outside[0] + outside[1] * outside[1] + outside[2] * outside[2],
+      float4(1e-12f)));
+  const float4 insideDistance = max(max(excess[0], excess[1]), excess[2]);
+  const float4 isOutside = insideDistance > float4(0.f);
+  const float4 isX = (excess[0] >= excess[1]) & (excess[0] >= excess[2]);
+  const float4 isY = (excess[1] >= excess[2]) & (excess[1] > excess[0]);
+  const float4 isAxis[3] = {
+      isX, isY, (excess[2] > excess[0]) & (excess[2] > excess[1])};
+
+  Contact result;
+  result.distance = select(isOutside, outsideLength, insideDistance);
+  result.normal = {float4(0.f), float4(0.f), float4(0.f)};
+  for (int k = 0; k < 3; ++k) {
+    const float4 n = select(isOutside, sign[k] * outside[k] / outsideLength,
+        select(isAxis[k], sign[k], float4(0.f)));
+    result.normal.x = result.normal.x + float4(box.axes[k].x) * n;
+    result.normal.y = result.normal.y + float4(box.axes[k].y) * n;
+    result.normal.z = result.normal.z + float4(box.axes[k].z) * n;
+  }
+  return result;
+}
+
+// One lane at a time, lanes farther than a few margins don't touch
+Contact contact(const Points &p, const MeshInstance &instance, uint32_t count,
+    float margin)
+{
+  alignas(16) float values[3][4];
+  p.x.store(values[0]);
+  p.y.store(values[1]);
+  p.z.store(values[2]);
+  alignas(16) float distances[4] = {margin, margin, margin, margin};
+  alignas(16) float normals[3][4] = {};
+
+  // A particle deeper than that has gone through anyway
+  const float reach = 4.f * margin;
+  const glm::mat3 toSet = glm::transpose(glm::mat3(instance.toMesh));
+  for (uint32_t i = 0; i < count; ++i) {
+    const glm::vec3 local = glm::vec3(instance.toMesh *
+        glm::vec4(values[0][i], values[1][i], values[2][i], 1));
+    float distance;
+    glm::vec3 normal;
+    if (instance.mesh->query(local, reach, distance, normal)) {
+      normal = toSet * normal;
+      distances[i] = distance;
+      normals[0][i] = normal.x;
+      normals[1][i] = normal.y;
+      normals[2][i] = normal.z;
+    }
+  }
+
+  return {float4(distances[0], distances[1], distances[2], distances[3]),
+      {float4(normals[0][0], normals[0][1], normals[0][2], normals[0][3]),
+          float4(normals[1][0], normals[1][1], normals[1][2], normals[1][3]),
+          float4(normals[2][0], normals[2][1], normals[2][2], normals[2][3])}};
+}
+
+} // namespace
+
+bool ColliderSet::empty() const
+{
+  return planes.empty() && spheres.empty() && capsules.empty() &&
+         boxes.empty() && meshes.empty();
+}
+
+ColliderSet ColliderSet::transformed(const glm::mat4 &transform) const
+{
+  const glm::mat3 rotation(transform);
+  const glm::vec3 translation(transform[3]);
+  const auto point = [&](const glm::vec3 &p) {
+    return rotation * p + translation;
+  };
+
+  ColliderSet result;
+  result.margin = margin;
+  for (const auto &plane : planes) {
+    const glm::vec3 normal = rotation * plane.normal;
+    result.planes.push_back(
+        {normal, plane.offset + glm::dot(normal, translation)});
+  }
+  for (const auto &sphere : spheres) {
+    result.spheres.push_back({point(sphere.center), sphere.radius});
+  }
+  for (const auto &capsule : capsules) {
+    result.capsules.push_back(
+        {point(capsule.a), point(capsule.b), capsule.radius});
+  }
+  for (const auto &box : boxes) {
+    result.boxes.push_back(
+        {point(box.center), rotation * box.axes, box.halfExtents});
+  }
+  for (const auto &mesh : meshes) {
+    result.meshes.push_back(
+        {mesh.mesh, mesh.toMesh * glm::inverse(transform)});
+  }
+  return result;
+}
+
+bool ColliderSet::overlaps(const glm::vec3 &low, const glm::vec3 &high) const
+{
+  const glm::vec3 lo = low - margin;
+  const glm::vec3 hi = high + margin;
+  const auto boxesOverlap = [&](const glm::vec3 &l, const glm::vec3 &h) {
+    return glm::all(glm::lessThanEqual(l, hi)) &&
+           glm::all(glm::lessThanEqual(lo, h));
+  };
+
+  for (const auto &plane : planes) {
+    // Corner of the box the deepest under the plane
+    const glm::vec3 corner = glm::mix(
+        hi, lo, glm::vec3(glm::greaterThanEqual(plane.normal, glm::vec3(0))));
+    if (glm::dot(plane.normal, corner) < plane.offset) {
+      return true;
+    }
+  }
+  for (const auto &sphere : spheres) {
+    const glm::vec3 closest = glm::clamp(sphere.center, lo, hi);
+    const glm::vec3 offset = closest - sphere.center;
+    if (glm::dot(offset, offset) < sphere.radius * sphere.radius) {
+      return true;
+    }
+  }
+  for (const auto &capsule : capsules) {
+    if (boxesOverlap(glm::min(capsule.a, capsule.b) - capsule.radius,
+            glm::max(capsule.a, capsule.b) + capsule.radius)) {
+      return true;
+    }
+  }
+  for (const auto &box : boxes) {
+    const glm::vec3 extent = glm::abs(box.axes[0]) * box.halfExtents.x +
+                             glm::abs(box.axes[1]) * box.halfExtents.y +
+                             glm::abs(box.axes[2]) * box.halfExtents.z;
+    if (boxesOverlap(box.center - extent, box.center + extent)) {
+      return true;
+    }
+  }
+  for (const auto &mesh : meshes) {
+    // The box seen from the mesh, against the bounds of the mesh
+    const glm::mat3 rotation(mesh.toMesh);
+    const glm::vec3 center =
+        glm::vec3(mesh.toMesh * glm::vec4(0.5f * (lo + hi), 1));
+    const glm::vec3 half = 0.5f * (hi - lo);
+    const glm::vec3 extent = glm::abs(rotation[0]) * half.x +
+                             glm::abs(rotation[1]) * half.y +
+                             glm::abs(rotation[2]) * half.z;
+    if (glm::all(
+            glm::lessThanEqual(center - extent, mesh.mesh->boundsMax())) &&
+        glm::all(
+            glm::lessThanEqual(mesh.mesh->boundsMin(), center + extent))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ColliderSet::resolve(glm::vec3 *positions, glm::vec3 *speeds,
+    const float *invMasses, uint32_t count) const
+{
+  // Missing lanes repeat the last particle and are never written back
+  const auto lane = [count](uint32_t i) { return std::min(i, count - 1); };
+  const auto gather = [&](const glm::vec3 *values) {
+    return Points{
+        float4(values[lane(0)].x, values[lane(1)].x, values[lane(2)].x,
+            values[lane(3)].x),
+        float4(values[lane(0)].y, values[lane(1)].y, values[lane(2)].y,
+            values[lane(3)].y),
+        float4(values[lane(0)].z, values[lane(1)].z, values[lane(2)].z,
+            values[lane(3)].z)};
+  };
+
+  Points p = gather(positions);
+  Points v = gather(speeds);
+  const float4 movable = float4(invMasses[lane(0)], invMasses[lane(1)],
+                             invMasses[lane(2)], invMasses[lane(3)]) >
+                         float4(0.f);
+  bool touched = false;
+
+  const auto apply = [&](const Contact &c) {
+    const float4 hit = movable & (c.distance < float4(margin));
+    if (!any(hit)) {
+      return;
+    }
+    touched = true;
+
+    const float4 push = select(hit, float4(margin) - c.distance, float4(0.f));
+    p.x = p.x + c.normal.x * push;
+    p.y = p.y + c.normal.y * push;
+    p.z = p.z + c.normal.z * push;
+
+    const float4 speed = dot(v, c.normal);
+    const float4 into = select(hit & (speed < float4(0.f)), speed, float4(0.f));
+    v.x = v.x - c.normal.x * into;
+    v.y = v.y - c.normal.y * into;
+    v.z = v.z - c.normal.z * into;
+  };
+
+  for (const auto &plane : planes) {
+    apply(contact(p, plane));
+  }
+  for (const auto &sphere : spheres) {
+    apply(contact(p, sphere));
+  }
+  for (const auto &capsule : capsules) {
+    apply(contact(p, capsule));
+  }
+  for (const auto &box : boxes) {
+    apply(contact(p, box));
+  }
+  for (const auto &mesh : meshes) {
+    apply(contact(p, mesh, count, margin));
+  }
+
+  if (!touched) {
+    return;
+  }
+  alignas(16) float values[6][4];
+  p.x.store(values[0]);
+  p.y.store(values[1]);
+  p.z.store(values[2]);
+  v.x.store(values[3]);
+  v.y.store(values[4]);
+  v.z.store(values[5]);
+  for (uint32_t i = 0; i < count; ++i) {
+    positions[i] = glm::vec3(values[0][i], values[1][i], values[2][i]);
+    speeds[i] = glm::vec3(values[3][i], values[4][i], values[5][i]);
+  }
+}
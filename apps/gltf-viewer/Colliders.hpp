@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MeshCollider.hpp"
+
+// Half-space dot(normal, x) >= offset is free, normal of unit length
+struct PlaneCollider
+{
+  glm::vec3 normal;
+  float offset;
+};
+
+struct SphereCollider
+{
+  glm::vec3 center;
+  float radius;
+};
+
+// Segment [a, b] swept by a sphere, a flagpole
+struct CapsuleCollider
+{
+  glm::vec3 a, b;
+  float radius;
+};
+
+// Oriented box, axes of unit length
+struct BoxCollider
+{
+  glm::vec3 center;
+  glm::mat3 axes;
+  glm::vec3 halfExtents;
+};
+
+// Triangle mesh shared between the sets, placed by a rigid transform
+struct MeshInstance
+{
+  std::shared_ptr<const MeshCollider> mesh;
+  glm::mat4 toMesh; // from the space of the set to the space of the mesh
+};
+
+// Static obstacles the particles are pushed out of, margin away from the
+// surfaces
+class ColliderSet
+{
+public:
+  std::vector<PlaneCollider> planes;
+  std::vector<SphereCollider> spheres;
+  std::vector<CapsuleCollider> capsules;
+  std::vector<BoxCollider> boxes;
+  std::vector<MeshInstance> meshes;
+  float margin = 0.f;
+
+  bool empty() const;
+
+  // Same obstacles seen through a rigid transform
+  ColliderSet transformed(const glm::mat4 &transform) const;
+
+  // Whether a particle in the box [low, high] may touch an obstacle
+  bool overlaps(const glm::vec3 &low, const glm::vec3 &high) const;
+
+  // Push count <= 4 particles out of the obstacles and drop their speed
+  // into them. Particles of zero inverse mass are left in place.
+  void resolve(glm::vec3 *positions, glm::vec3 *speeds,
+      const float *invMasses, uint32_t count) const;
+};
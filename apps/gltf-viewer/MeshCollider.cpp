@@ -0,0 +1,408 @@
+#include "MeshCollider.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+const uint32_t BIN_COUNT = 12;
+const uint32_t LEAF_TRIANGLES = 4;
+const uint32_t MAX_DEPTH = 48;
+
+// Closest point of the triangle abc to p (Ericson, Real-Time Collision
+// Detection 5.1.5). feature is 0 inside the face, 1 + i on vertex i and
+// 4 + i on edge i, edges being ab, bc and ca.
+glm::vec3 closestOnTriangle(const glm::vec3 &p, const glm::vec3 &a,
+    const glm::vec3 &b, const glm::vec3 &c, int &feature)
+{
+  const glm::vec3 ab = b - a;
+  const glm::vec3 ac = c - a;
+  const glm::vec3 ap = p - a;
+  const float d1 = glm::dot(ab, ap);
+  const float d2 = glm::dot(ac, ap);
+  if (d1 <= 0.f && d2 <= 0.f) {
+    feature = 1;
+    return a;
+  }
+
+  const glm::vec3 bp = p - b;
+  const float d3 = glm::dot(ab, bp);
+  const float d4 = glm::dot(ac, bp);
+  if (d3 >= 0.f && d4 <= d3) {
+    feature = 2;
+    return b;
+  }
+
+  const float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+    feature = 4;
+    return a + ab * (d1 / (d1 - d3));
+  }
+
+  const glm::vec3 cp = p - c;
+  const float d5 = glm::dot(ab, cp);
+  const float d6 = glm::dot(ac, cp);
+  if (d6 >= 0.f && d5 <= d6) {
+    feature = 3;
+    return c;
+  }
+
+  const float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+    feature = 6;
+    return a + ac * (d2 / (d2 - d6));
+  }
+
+  const float va = d3 * d6 - d5 * d4;
+  if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f) {
+    feature = 5;
+    return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+
+  feature = 0;
+  const float denominator = 1.f / (va + vb + vc);
+  return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+float boxDistance2(
+    const glm::vec3 &p, const glm::vec3 &low, const glm::vec3 &high)
+{
+  const glm::vec3 d = glm::max(glm::max(low - p, p - high), glm::vec3(0));
+  return glm::dot(d, d);
+}
+
+float halfArea(const glm::vec3 &low, const glm::vec3 &high)
+{
+  const glm::vec3 d = glm::max(high - low, glm::vec3(0));
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+} // namespace
+
+MeshCollider::MeshCollider(const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices)
+{
+  // glTF splits vertices along seams of normals and texture coordinates, the
+  // pseudo normals need them merged
+  std::map<std::tuple<float, float, float>, uint32_t> welded;
+  std::vector<uint32_t> remap(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    const auto key =
+        std::make_tuple(positions[i].x, positions[i].y, positions[i].z);
+    const auto it = welded.emplace(key, uint32_t(m_positions.size())).first;
+    if (it->second == m_positions.size()) {
+      m_positions.push_back(positions[i]);
+    }
+    remap[i] = it->second;
+  }
+
+  m_vertexNormals.assign(m_positions.size(), glm::vec3(0));
+  std::map<std::pair<uint32_t, uint32_t>, glm::vec3> edgeNormals;
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    Triangle triangle;
+    for (int k = 0; k < 3; ++k) {
+      triangle.vertices[k] = remap.at(indices[t + k]);
+    }
+    const glm::vec3 &a = m_positions[triangle.vertices[0]];
+    const glm::vec3 &b = m_positions[triangle.vertices[1]];
+    const glm::vec3 &c = m_positions[triangle.vertices[2]];
+    const glm::vec3 cross = glm::cross(b - a, c - a);
+    const float length = glm::length(cross);
+    if (!(length > 1e-12f)) {
+      continue; // degenerate, covered by its neighbours
+    }
+    triangle.normal = cross / length;
+
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = triangle.vertices[k];
+      const glm::vec3 &p = m_positions[v];
+      const glm::vec3 e0 =
+          glm::normalize(m_positions[triangle.vertices[(k + 1) % 3]] - p);
+      const glm::vec3 e1 =
+          glm::normalize(m_positions[triangle.vertices[(k + 2) % 3]] - p);
+      const float angle = std::acos(glm::clamp(glm::dot(e0, e1), -1.f, 1.f));
+      m_vertexNormals[v] += angle * triangle.normal;
+
+      const uint32_t w = triangle.vertices[(k + 1) % 3];
+      edgeNormals[std::minmax(v, w)] += triangle.normal;
+    }
+    m_triangles.push_back(triangle);
+  }
+  for (auto &triangle : m_triangles) {
+    for (int k = 0; k < 3; ++k) {
+      triangle.edgeNormals[k] = edgeNormals[std::minmax(
+          triangle.vertices[k], triangle.vertices[(k + 1) % 3])];
+    }
+  }
+
+  std::vector<glm::vec3> centroids;
+  centroids.reserve(m_triangles.size());
+  for (const auto &triangle : m_triangles) {
+    centroids.push_back((m_positions[triangle.vertices[0]] +
+                            m_positions[triangle.vertices[1]] +
+                            m_positions[triangle.vertices[2]]) /
+                        3.f);
+  }
+  m_nodes.reserve(2 * m_triangles.size() / LEAF_TRIANGLES + 1);
+  build(centroids, 0, uint32_t(m_triangles.size()), 0);
+}
+
+uint32_t MeshCollider::build(std::vector<glm::vec3> &centroids,
+    uint32_t begin, uint32_t end, uint32_t depth)
+{
+  const uint32_t index = uint32_t(m_nodes.size());
+  m_nodes.push_back({glm::vec3(std::numeric_limits<float>::max()), begin,
+      glm::vec3(std::numeric_limits<float>::lowest()), end - begin});
+  if (begin == end) {
+    m_nodes[index].low = m_nodes[index].high = glm::vec3(0);
+    return index;
+  }
+
+  glm::vec3 low(std::numeric_limits<float>::max());
+  glm::vec3 high(std::numeric_limits<float>::lowest());
+  glm::vec3 centroidLow = low, centroidHigh = high;
+  for (uint32_t t = begin; t < end; ++t) {
+    for (const uint32_t v : m_triangles[t].vertices) {
+      low = glm::min(low, m_positions[v]);
+      high = glm::max(high, m_positions[v]);
+    }
+    centroidLow = glm::min(centroidLow, centroids[t]);
+    centroidHigh = glm::max(centroidHigh, centroids[t]);
+  }
+  m_nodes[index].low = low;
+  m_nodes[index].high = high;
+
+  const uint32_t count = end - begin;
+  const glm::vec3 extent = centroidHigh - centroidLow;
+  const int axis = extent.x >= extent.y && extent.x >= extent.z
+                       ? 0
+                       : (extent.y >= extent.z ? 1 : 2);
+  if (count <= LEAF_TRIANGLES || !(extent[axis] > 0.f) ||
+      depth >= MAX_DEPTH) {
+    return index;
+  }
+
+  // Binned surface area heuristic along the longest centroid axis
+  struct Bin
+  {
+    glm::vec3 low = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 high = glm::vec3(std::numeric_limits<float>::lowest());
+    uint32_t count = 0;
+  };
+  Bin bins[BIN_COUNT];
+  const float scale = BIN_COUNT / extent[axis];
+  const auto binOf = [&](uint32_t t) {
+    return std::min(BIN_COUNT - 1,
+        uint32_t((centroids[t][axis] - centroidLow[axis]) * scale));
+  };
+  for (uint32_t t = begin; t < end; ++t) {
+    Bin &bin = bins[binOf(t)];
+    for (const uint32_t v : m_triangles[t].vertices) {
+      bin.low = glm::min(bin.low, m_positions[v]);
+      bin.high = glm::max(bin.high, m_positions[v]);
+    }
+    ++bin.count;
+  }
+
+  float rightCost[BIN_COUNT];
+  Bin right;
+  for (uint32_t b = BIN_COUNT - 1; b > 0; --b) {
+    right.low = glm::min(right.low, bins[b].low);
+    right.high = glm::max(right.high, bins[b].high);
+    right.count += bins[b].count;
+    rightCost[b] = right.count * halfArea(right.low, right.high);
+  }
+  Bin left;
+  float bestCost = std::numeric_limits<float>::max();
+  uint32_t bestSplit = 0;
+  for (uint32_t b = 0; b + 1 < BIN_COUNT; ++b) {
+    left.low = glm::min(left.low, bins[b].low);
+    left.high = glm::max(left.high, bins[b].high);
+    left.count += bins[b].count;
+    const float cost =
+        left.count * halfArea(left.low, left.high) + rightCost[b + 1];
+    if (left.count > 0 && left.count < count && cost < bestCost) {
+      bestCost = cost;
+      bestSplit = b;
+    }
+  }
+
+  // Traversing costs about as much as testing a triangle
+  const float leafCost = count * halfArea(low, high);
+  if (bestCost >= leafCost - halfArea(low, high) &&
+      count <= 4 * LEAF_TRIANGLES) {
+    return index;
+  }
+
+  uint32_t middle = begin;
+  for (uint32_t t = begin; t < end; ++t) {
+    if (binOf(t) <= bestSplit) {
+      std::swap(m_triangles[t], m_triangles[middle]);
+      std::swap(centroids[t], centroids[middle]);
+      ++middle;
+    }
+  }
+
+  m_nodes[index].count = 0;
+  build(centroids, begin, middle, depth + 1);
+  const uint32_t second = build(centroids, middle, end, depth + 1);
+  m_nodes[index].offset = second;
+  return index;
+}
+
+bool MeshCollider::query(const glm::vec3 &p, float maxDistance,
+    float &distance, glm::vec3 &normal) const
+{
+  if (hasDistanceField() && queryField(p, distance, normal)) {
+    return distance < maxDistance;
+  }
+  return queryTree(p, maxDistance, distance, normal);
+}
+
+bool MeshCollider::queryTree(const glm::vec3 &p, float maxDistance,
+    float &distance, glm::vec3 &normal) const
+{
+  if (m_triangles.empty()) {
+    return false;
+  }
+  float best = maxDistance * maxDistance;
+  const Triangle *closestTriangle = nullptr;
+  glm::vec3 closest(0.f);
+  int closestFeature = 0;
+
+  // Nearest child first, so that the bound shrinks quickly
+  uint32_t stack[MAX_DEPTH + 2];
+  uint32_t size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    const Node &node = m_nodes[stack[--size]];
+    if (boxDistance2(p, node.low, node.high) >= best) {
+      continue;
+    }
+    if (node.count == 0) {
+      const uint32_t first = uint32_t(&node - m_nodes.data()) + 1;
+      const uint32_t second = node.offset;
+      const float d0 =
+          boxDistance2(p, m_nodes[first].low, m_nodes[first].high);
+      const float d1 =
+          boxDistance2(p, m_nodes[second].low, m_nodes[second].high);
+      const bool firstNearer = d0 <= d1;
+      if (std::max(d0, d1) < best) {
+        stack[size++] = firstNearer ? second : first;
+      }
+      if (std::min(d0, d1) < best) {
+        stack[size++] = firstNearer ? first : second;
+      }
+      continue;
+    }
+
+    for (uint32_t t = node.offset; t < node.offset + node.count; ++t) {
+      const Triangle &triangle = m_triangles[t];
+      int feature;
+      const glm::vec3 q = closestOnTriangle(p,
+          m_positions[triangle.vertices[0]], m_positions[triangle.vertices[1]],
+          m_positions[triangle.vertices[2]], feature);
+      const glm::vec3 offset = p - q;
+      const float d = glm::dot(offset, offset);
+      if (d < best) {
+        best = d;
+        closestTriangle = &triangle;
+        closest = q;
+        closestFeature = feature;
+      }
+    }
+  }
+  if (!closestTriangle) {
+    return false;
+  }
+
+  // The pseudo normal of the closest feature tells inside from outside
+  // (Baerentzen and Aanaes, 2005)
+  const glm::vec3 pseudoNormal =
+      closestFeature == 0
+          ? closestTriangle->normal
+          : closestFeature < 4
+                ? m_vertexNormals[closestTriangle->vertices[closestFeature - 1]]
+                : closestTriangle->edgeNormals[closestFeature - 4];
+  const glm::vec3 offset = p - closest;
+  const float sign = glm::dot(offset, pseudoNormal) < 0.f ? -1.f : 1.f;
+  const float length = std::sqrt(best);
+  distance = sign * length;
+  normal = length > 1e-6f ? offset * (sign / length) : closestTriangle->normal;
+  return true;
+}
+
+void MeshCollider::bakeDistanceField(
+    ThreadPool &pool, uint32_t resolution, float padding)
+{
+  m_field.clear();
+  if (m_triangles.empty() || resolution == 0) {
+    return;
+  }
+  const glm::vec3 low = boundsMin() - padding;
+  const glm::vec3 extent = boundsMax() + padding - low;
+  const float cell =
+      std::max(std::max(extent.x, extent.y), extent.z) / resolution;
+  const glm::uvec3 size = glm::uvec3(glm::ceil(extent / cell)) + 1u;
+
+  std::vector<float> field(size_t(size.x) * size.y * size.z);
+  const float unbounded = std::numeric_limits<float>::max();
+  pool.parallelFor(size.z, [&](size_t z) {
+    for (uint32_t y = 0; y < size.y; ++y) {
+      for (uint32_t x = 0; x < size.x; ++x) {
+        const glm::vec3 p = low + glm::vec3(x, y, z) * cell;
+        float distance;
+        glm::vec3 normal;
+        queryTree(p, unbounded, distance, normal);
+        field[(z * size.y + y) * size.x + x] = distance;
+      }
+    }
+  });
+
+  m_fieldLow = low;
+  m_fieldCell = cell;
+  m_fieldSize = size;
+  m_field = std::move(field);
+}
+
+bool MeshCollider::queryField(
+    const glm::vec3 &p, float &distance, glm::vec3 &normal) const
+{
+  const glm::vec3 g = (p - m_fieldLow) / m_fieldCell;
+  const glm::vec3 last = glm::vec3(m_fieldSize - 1u);
+  if (!glm::all(glm::greaterThanEqual(g, glm::vec3(0))) ||
+      !glm::all(glm::lessThanEqual(g, last))) {
+    return false;
+  }
+  const glm::uvec3 i = glm::uvec3(glm::min(glm::floor(g), last - 1.f));
+  const glm::vec3 f = g - glm::vec3(i);
+
+  const size_t strideY = m_fieldSize.x;
+  const size_t strideZ = size_t(m_fieldSize.x) * m_fieldSize.y;
+  const float *c = m_field.data() + i.z * strideZ + i.y * strideY + i.x;
+  const float c000 = c[0], c100 = c[1];
+  const float c010 = c[strideY], c110 = c[strideY + 1];
+  const float c001 = c[strideZ], c101 = c[strideZ + 1];
+  const float c011 = c[strideZ + strideY], c111 = c[strideZ + strideY + 1];
+
+  // Trilinear value and its exact gradient
+  const float x00 = glm::mix(c000, c100, f.x), x10 = glm::mix(c010, c110, f.x);
+  const float x01 = glm::mix(c001, c101, f.x), x11 = glm::mix(c011, c111, f.x);
+  const float y0 = glm::mix(x00, x10, f.y), y1 = glm::mix(x01, x11, f.y);
+  distance = glm::mix(y0, y1, f.z);
+
+  const glm::vec3 gradient(
+      glm::mix(glm::mix(c100 - c000, c110 - c010, f.y),
+          glm::mix(c101 - c001, c111 - c011, f.y), f.z),
+      glm::mix(x10 - x00, x11 - x01, f.z), y1 - y0);
+  const float length = glm::length(gradient);
+  if (!(length > 1e-6f)) {
+    return false; // on a ridge of the field, ask the tree
+  }
+  normal = gradient / length;
+  return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "utils/ThreadPool.hpp"
+
+// Static triangle mesh the cloths collide with. Distance queries go through a
+// bounding volume hierarchy built with the surface area heuristic, or through
+// a signed distance grid baked from it.
+// The sign comes from angle weighted pseudo normals, meaningful for closed
+// meshes only: particles behind an open surface are pushed through it.
+class MeshCollider
+{
+public:
+  // Three indices per triangle. Vertices at the same position are merged.
+  MeshCollider(const std::vector<glm::vec3> &positions,
+      const std::vector<uint32_t> &indices);
+
+  // Signed distance to the surface and outward normal at the closest point,
+  // false when the surface is farther than maxDistance
+  bool query(const glm::vec3 &p, float maxDistance, float &distance,
+      glm::vec3 &normal) const;
+
+  // Sample the distance on a grid of resolution cells along the longest
+  // side of the bounds grown by padding, then answer the queries inside the
+  // grid by trilinear interpolation
+  void bakeDistanceField(ThreadPool &pool, uint32_t resolution, float padding);
+  inline bool hasDistanceField() const { return !m_field.empty(); }
+
+  inline size_t triangleCount() const { return m_triangles.size(); }
+  inline glm::vec3 boundsMin() const { return m_nodes[0].low; }
+  inline glm::vec3 boundsMax() const { return m_nodes[0].high; }
+
+private:
+  struct Triangle
+  {
+    uint32_t vertices[3];
+    glm::vec3 normal;
+    glm::vec3 edgeNormals[3]; // ab, bc, ca
+  };
+
+  // Children of an inner node are the next node and the node at offset,
+  // a leaf holds the triangles [offset, offset + count) of m_triangles
+  struct Node
+  {
+    glm::vec3 low;
+    uint32_t offset;
+    glm::vec3 high;
+    uint32_t count;
+  };
+
+  uint32_t build(std::vector<glm::vec3> &centroids, uint32_t begin,
+      uint32_t end, uint32_t depth);
+  bool queryTree(const glm::vec3 &p, float maxDistance, float &distance,
+      glm::vec3 &normal) const;
+  bool queryField(const glm::vec3 &p, float &distance, glm::vec3 &normal) const;
+
+  std::vector<glm::vec3> m_positions;
+  std::vector<glm::vec3> m_vertexNormals;
+  std::vector<Triangle> m_triangles;
+  std::vector<Node> m_nodes;
+
+  glm::vec3 m_fieldLow = glm::vec3(0);
+  float m_fieldCell = 0.f;
+  glm::uvec3 m_fieldSize = glm::uvec3(0); // samples along each axis
+  std::vector<float> m_field;
+};
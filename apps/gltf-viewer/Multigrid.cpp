@@ -0,0 +1,458 @@
+#include "Multigrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+const glm::ivec2 Multigrid::LINK_OFFSETS[LINK_COUNT] = {{1, 0}, {-1, 0},
+    {0, 1}, {0, -1}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1}, {2, 0}, {-2, 0},
+    {0, 2}, {0, -2}};
+
+const SpringFamily Multigrid::LINK_FAMILIES[LINK_COUNT] = {
+    SpringFamily::Structural, SpringFamily::Structural,
+    SpringFamily::Structural, SpringFamily::Structural, SpringFamily::Shear,
+    SpringFamily::Shear, SpringFamily::Shear, SpringFamily::Shear,
+    SpringFamily::Bend, SpringFamily::Bend, SpringFamily::Bend,
+    SpringFamily::Bend};
+
+namespace
+{
+
+const uint32_t ROW_BLOCK = 16;
+const uint32_t COARSEST_SIDE = 4;
+const uint32_t SMOOTHING_SWEEPS = 2;
+const float JACOBI_WEIGHT = 0.6f;
+const uint32_t COARSEST_ITERATIONS = 200;
+const float COARSEST_TOLERANCE = 1e-6f;
+
+inline uint32_t rowBlockCount(uint32_t height)
+{
+  return (height + ROW_BLOCK - 1) / ROW_BLOCK;
+}
+
+// f(firstRow, endRow, block) over blocks of rows, on the pool if any
+template <typename F>
+void forRowBlocks(ThreadPool *pool, uint32_t height, const F &f)
+{
+  const uint32_t blocks = rowBlockCount(height);
+  const auto run = [&](size_t block) {
+    const uint32_t begin = uint32_t(block) * ROW_BLOCK;
+    f(begin, std::min(begin + ROW_BLOCK, height), uint32_t(block));
+  };
+  if (pool && blocks > 1) {
+    pool->parallelFor(blocks, run);
+  } else {
+    for (uint32_t block = 0; block < blocks; ++block) {
+      run(block);
+    }
+  }
+}
+
+// Weight of coarse node c in the bilinear prolongation to fine node f, along
+// one axis of coarseCount nodes. A fine node past the last coarse one copies
+// it.
+inline float prolongationWeight(uint32_t f, uint32_t c, uint32_t coarseCount)
+{
+  if (f % 2 == 0) {
+    return c == f / 2 ? 1.f : 0.f;
+  }
+  if (f / 2 + 1 < coarseCount) {
+    return c == f / 2 || c == f / 2 + 1 ? 0.5f : 0.f;
+  }
+  return c == f / 2 ? 1.f : 0.f;
+}
+
+// Sum of f(n) over the nodes of a width x height grid, by blocks of rows
+template <typename F>
+float sumNodes(ThreadPool *pool, uint32_t width, uint32_t height, const F &f)
+{
+  std::vector<float> partial(rowBlockCount(height), 0.f);
+  forRowBlocks(pool, height, [&](uint32_t begin, uint32_t end, uint32_t block) {
+    float sum = 0.f;
+    for (size_t n = size_t(begin) * width; n < size_t(end) * width; ++n) {
+      sum += f(n);
+    }
+    partial[block] = sum;
+  });
+
+  float sum = 0.f;
+  for (float value : partial) {
+    sum += value;
+  }
+  return sum;
+}
+
+} // namespace
+
+void Multigrid::reset(uint32_t width, uint32_t height,
+    const std::vector<uint16_t> &links, const std::vector<float> &masses)
+{
+  m_levels.clear();
+  m_levels.push_back({width, height, links, masses, {}, {}, {}});
+
+  while (std::min(m_levels.back().width, m_levels.back().height) >
+         COARSEST_SIDE) {
+    const Level &fine = m_levels.back();
+    Level coarse;
+    coarse.width = (fine.width + 1) / 2;
+    coarse.height = (fine.height + 1) / 2;
+    const size_t count = size_t(coarse.width) * coarse.height;
+    coarse.links.assign(count, 0);
+    coarse.masses.assign(count, 0.f);
+
+    for (uint32_t j = 0; j < fine.height; ++j) {
+      for (uint32_t i = 0; i < fine.width; ++i) {
+        for (uint32_t cj = j / 2; cj <= std::min(j / 2 + 1, coarse.height - 1);
+             ++cj) {
+          for (uint32_t ci = i / 2;
+               ci <= std::min(i / 2 + 1, coarse.width - 1); ++ci) {
+            coarse.masses[ci + cj * coarse.width] +=
+                prolongationWeight(i, ci, coarse.width) *
+                prolongationWeight(j, cj, coarse.height) *
+                fine.masses[i + j * fine.width];
+          }
+        }
+      }
+    }
+
+    for (uint32_t cj = 0; cj < coarse.height; ++cj) {
+      for (uint32_t ci = 0; ci < coarse.width; ++ci) {
+        const size_t n = ci + cj * coarse.width;
+        if (fine.masses[2 * ci + 2 * cj * fine.width] == 0.f) {
+          coarse.masses[n] = 0.f; // fixed
+        }
+        for (uint32_t l = 0; l < LINK_COUNT; ++l) {
+          if (LINK_FAMILIES[l] == SpringFamily::Bend) {
+            continue; // folded in the structural links, see linkWeights()
+          }
+          const glm::ivec2 neighbor =
+              glm::ivec2(ci, cj) + LINK_OFFSETS[l];
+          if (neighbor.x >= 0 && neighbor.y >= 0 &&
+              neighbor.x < int(coarse.width) &&
+              neighbor.y < int(coarse.height)) {
+            coarse.links[n] |= uint16_t(1u << l);
+          }
+        }
+      }
+    }
+    m_levels.push_back(std::move(coarse));
+  }
+
+  for (auto &level : m_levels) {
+    const size_t count = size_t(level.width) * level.height;
+    level.u.assign(count, glm::vec3(0.f));
+    level.b.assign(count, glm::vec3(0.f));
+    level.r.assign(count, glm::vec3(0.f));
+  }
+}
+
+void Multigrid::removeLink(uint32_t node, uint32_t link)
+{
+  Level &fine = m_levels.front();
+  const glm::ivec2 offset = LINK_OFFSETS[link];
+  fine.links[node] &= uint16_t(~(1u << link));
+  fine.links[node + offset.x + offset.y * int(fine.width)] &=
+      uint16_t(~(1u << (link ^ 1)));
+}
+
+void Multigrid::apply(const float weights[SPRING_FAMILY_COUNT],
+    float massScale, const std::vector<glm::vec3> &u,
+    std::vector<glm::vec3> &result, ThreadPool *pool)
+{
+  std::copy(weights, weights + SPRING_FAMILY_COUNT, m_weights);
+  result.resize(u.size());
+  apply(m_levels.front(), massScale, u.data(), result.data(), pool);
+}
+
+// Bend links skip a node, so they can't see the modes of a coarse level
+// that alternate every other node, which the fine level does stiffen. Coarse
+// levels leave them out and give their weight to the structural links
+// instead, 4 times over as a link twice as long stretches twice as much.
+void Multigrid::linkWeights(const Level &level, float weights[LINK_COUNT]) const
+{
+  const float bend = m_weights[uint32_t(SpringFamily::Bend)];
+  for (uint32_t l = 0; l < LINK_COUNT; ++l) {
+    weights[l] = m_weights[uint32_t(LINK_FAMILIES[l])];
+    if (&level != &m_levels.front() &&
+        LINK_FAMILIES[l] == SpringFamily::Structural) {
+      weights[l] += 4.f * bend;
+    }
+  }
+}
+
+void Multigrid::apply(const Level &level, float massScale,
+    const glm::vec3 *u, glm::vec3 *result, ThreadPool *pool) const
+{
+  int strides[LINK_COUNT];
+  float weights[LINK_COUNT];
+  linkWeights(level, weights);
+  for (uint32_t l = 0; l < LINK_COUNT; ++l) {
+    strides[l] = LINK_OFFSETS[l].x + LINK_OFFSETS[l].y * int(level.width);
+  }
+
+  forRowBlocks(pool, level.height, [&](uint32_t begin, uint32_t end, uint32_t) {
+    for (size_t n = size_t(begin) * level.width;
+         n < size_t(end) * level.width; ++n) {
+      glm::vec3 sum = massScale * level.masses[n] * u[n];
+      const uint32_t links = level.links[n];
+      for (uint32_t l = 0; l < LINK_COUNT; ++l) {
+        if (links & (1u << l)) {
+          sum += weights[l] * (u[n] - u[n + strides[l]]);
+        }
+      }
+      result[n] = sum;
+    }
+  });
+}
+
+float Multigrid::residual(const Level &level, const glm::vec3 *u,
+    const glm::vec3 *b, glm::vec3 *r, ThreadPool *pool) const
+{
+  apply(level, 1.f, u, r, pool);
+  return sumNodes(pool, level.width, level.height, [&](size_t n) {
+    r[n] = level.masses[n] > 0.f ? b[n] - r[n] : glm::vec3(0.f);
+    return glm::dot(r[n], r[n]);
+  });
+}
+
+void Multigrid::relax(const Level &level, glm::vec3 *u, const glm::vec3 *r,
+    ThreadPool *pool) const
+{
+  float weights[LINK_COUNT];
+  linkWeights(level, weights);
+
+  forRowBlocks(pool, level.height, [&](uint32_t begin, uint32_t end, uint32_t) {
+    for (size_t n = size_t(begin) * level.width;
+         n < size_t(end) * level.width; ++n) {
+      if (level.masses[n] == 0.f) {
+        continue;
+      }
+      float diagonal = level.masses[n];
+      const uint32_t links = level.links[n];
+      for (uint32_t l = 0; l < LINK_COUNT; ++l) {
+        if (links & (1u << l)) {
+          diagonal += weights[l];
+        }
+      }
+      u[n] += (JACOBI_WEIGHT / diagonal) * r[n];
+    }
+  });
+}
+
+void Multigrid::smooth(const Level &level, glm::vec3 *u, const glm::vec3 *b,
+    glm::vec3 *r, uint32_t sweeps, ThreadPool *pool) const
+{
+  for (uint32_t sweep = 0; sweep < sweeps; ++sweep) {
+    residual(level, u, b, r, pool);
+    relax(level, u, r, pool);
+  }
+}
+
+// Coarse b from the fine residual, by the transpose of prolongate()
+void Multigrid::restrictResidual(uint32_t fine, ThreadPool *pool)
+{
+  const Level &f = m_levels[fine];
+  Level &c = m_levels[fine + 1];
+
+  forRowBlocks(pool, c.height, [&](uint32_t begin, uint32_t end, uint32_t) {
+    for (uint32_t cj = begin; cj < end; ++cj) {
+      for (uint32_t ci = 0; ci < c.width; ++ci) {
+        const size_t n = ci + size_t(cj) * c.width;
+        glm::vec3 sum(0.f);
+        if (c.masses[n] > 0.f) {
+          const uint32_t j0 = cj > 0 ? 2 * cj - 1 : 0;
+          const uint32_t i0 = ci > 0 ? 2 * ci - 1 : 0;
+          for (uint32_t j = j0; j < std::min(2 * cj + 2, f.height); ++j) {
+            const float wj = prolongationWeight(j, cj, c.height);
+            for (uint32_t i = i0; i < std::min(2 * ci + 2, f.width); ++i) {
+              sum += wj * prolongationWeight(i, ci, c.width) *
+                     f.r[i + size_t(j) * f.width];
+            }
+          }
+        }
+        c.b[n] = sum;
+      }
+    }
+  });
+}
+
+// Fine u += bilinear interpolation of the coarse u
+void Multigrid::prolongate(uint32_t fine, ThreadPool *pool)
+{
+  Level &f = m_levels[fine];
+  const Level &c = m_levels[fine + 1];
+
+  forRowBlocks(pool, f.height, [&](uint32_t begin, uint32_t end, uint32_t) {
+    for (uint32_t j = begin; j < end; ++j) {
+      for (uint32_t i = 0; i < f.width; ++i) {
+        const size_t n = i + size_t(j) * f.width;
+        if (f.masses[n] == 0.f) {
+          continue;
+        }
+        glm::vec3 sum(0.f);
+        for (uint32_t cj = j / 2; cj <= std::min(j / 2 + 1, c.height - 1);
+             ++cj) {
+          const float wj = prolongationWeight(j, cj, c.height);
+          for (uint32_t ci = i / 2; ci <= std::min(i / 2 + 1, c.width - 1);
+               ++ci) {
+            sum += wj * prolongationWeight(i, ci, c.width) *
+                   c.u[ci + size_t(cj) * c.width];
+          }
+        }
+        f.u[n] += sum;
+      }
+    }
+  });
+}
+
+void Multigrid::vCycle(uint32_t index, ThreadPool *pool)
+{
+  if (index + 1 == m_levels.size()) {
+    solveCoarsest(pool);
+    return;
+  }
+
+  Level &level = m_levels[index];
+  smooth(level, level.u.data(), level.b.data(), level.r.data(),
+      SMOOTHING_SWEEPS, pool);
+  residual(level, level.u.data(), level.b.data(), level.r.data(), pool);
+  restrictResidual(index, pool);
+
+  Level &coarse = m_levels[index + 1];
+  std::fill(coarse.u.begin(), coarse.u.end(), glm::vec3(0.f));
+  vCycle(index + 1, pool);
+
+  prolongate(index, pool);
+  smooth(level, level.u.data(), level.b.data(), level.r.data(),
+      SMOOTHING_SWEEPS, pool);
+}
+
+// Conjugate gradient, the coarsest grid being a few nodes across
+void Multigrid::solveCoarsest(ThreadPool *pool)
+{
+  Level &level = m_levels.back();
+  float bb = 0.f;
+  for (const auto &b : level.b) {
+    bb += glm::dot(b, b);
+  }
+  float rr = residual(level, level.u.data(), level.b.data(),
+      level.r.data(), pool);
+  conjugateGradient(level, level.u.data(), level.r.data(), nullptr, rr,
+      COARSEST_TOLERANCE * COARSEST_TOLERANCE * bb, COARSEST_ITERATIONS,
+      m_coarseP, m_coarseQ, pool);
+}
+
+// Improve u from its residual r and |r|^2 until |r|^2 <= target. The
+// preconditioner, if any, leaves its result in the finest level's u.
+uint32_t Multigrid::conjugateGradient(Level &level, glm::vec3 *u,
+    glm::vec3 *r, const std::function<void()> *precondition, float &rr,
+    float target, uint32_t maxIterations, std::vector<glm::vec3> &p,
+    std::vector<glm::vec3> &q, ThreadPool *pool)
+{
+  const size_t count = size_t(level.width) * level.height;
+  p.resize(count);
+  q.resize(count);
+
+  // z = r without preconditioner
+  const glm::vec3 *z = r;
+  if (precondition) {
+    (*precondition)();
+    z = m_levels.front().u.data();
+  }
+  float rz = sumNodes(pool, level.width, level.height, [&](size_t n) {
+    p[n] = z[n];
+    return glm::dot(r[n], z[n]);
+  });
+
+  uint32_t iteration = 0;
+  for (; iteration < maxIterations && rr > target; ++iteration) {
+    apply(level, 1.f, p.data(), q.data(), pool);
+    const float pq = sumNodes(pool, level.width, level.height, [&](size_t n) {
+      if (level.masses[n] == 0.f) {
+        q[n] = glm::vec3(0.f);
+      }
+      return glm::dot(p[n], q[n]);
+    });
+    if (pq <= 0.f) {
+      break;
+    }
+
+    const float alpha = rz / pq;
+    rr = sumNodes(pool, level.width, level.height, [&](size_t n) {
+      u[n] += alpha * p[n];
+      r[n] -= alpha * q[n];
+      return glm::dot(r[n], r[n]);
+    });
+
+    if (precondition) {
+      (*precondition)();
+    }
+    const float next = sumNodes(pool, level.width, level.height,
+        [&](size_t n) { return glm::dot(r[n], z[n]); });
+    const float beta = next / rz;
+    forRowBlocks(pool, level.height, [&](uint32_t begin, uint32_t end, uint32_t) {
+      for (size_t n = size_t(begin) * level.width;
+           n < size_t(end) * level.width; ++n) {
+        p[n] = z[n] + beta * p[n];
+      }
+    });
+    rz = next;
+  }
+  return iteration;
+}
+
+Multigrid::Result Multigrid::solve(const SolverSettings &settings,
+    const float weights[SPRING_FAMILY_COUNT],
+    const std::vector<glm::vec3> &b, std::vector<glm::vec3> &u,
+    ThreadPool *pool)
+{
+  std::copy(weights, weights + SPRING_FAMILY_COUNT, m_weights);
+  Level &top = m_levels.front();
+  const size_t count = top.u.size();
+  u.resize(count, glm::vec3(0.f));
+
+  // Residual of u, kept apart from the scratch of the cycles
+  std::vector<glm::vec3> &r = m_residual;
+  r.resize(count);
+  const float bb = sumNodes(pool, top.width, top.height, [&](size_t n) {
+    return top.masses[n] > 0.f ? glm::dot(b[n], b[n]) : 0.f;
+  });
+  if (bb == 0.f) {
+    std::fill(u.begin(), u.end(), glm::vec3(0.f));
+    return {0, 0.f};
+  }
+  const float target = settings.tolerance * settings.tolerance * bb;
+
+  // One V-cycle on A e = r, e left in top.u
+  const std::function<void()> precondition = [&]() {
+    std::copy(r.begin(), r.end(), top.b.begin());
+    std::fill(top.u.begin(), top.u.end(), glm::vec3(0.f));
+    vCycle(0, pool);
+  };
+
+  float rr = residual(top, u.data(), b.data(), r.data(), pool);
+  uint32_t iteration = 0;
+
+  if (settings.method == SolverMethod::MultigridCG) {
+    iteration = conjugateGradient(top, u.data(), r.data(), &precondition, rr,
+        target, settings.maxIterations, m_p, m_q, pool);
+  } else {
+    for (; iteration < settings.maxIterations && rr > target; ++iteration) {
+      if (settings.method == SolverMethod::VCycle) {
+        precondition();
+        forRowBlocks(pool, top.height,
+            [&](uint32_t begin, uint32_t end, uint32_t) {
+              for (size_t n = size_t(begin) * top.width;
+                   n < size_t(end) * top.width; ++n) {
+                u[n] += top.u[n];
+              }
+            });
+      } else {
+        relax(top, u.data(), r.data(), pool);
+      }
+      rr = residual(top, u.data(), b.data(), r.data(), pool);
+    }
+  }
+
+  return {iteration, std::sqrt(rr / bb)};
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ClothMaterial.hpp"
+#include "utils/ThreadPool.hpp"
+
+// Geometric multigrid for the system of an implicit cloth step
+//   (M + sum_f w_f L_f) u = b
+// on the particle grid, M the diagonal of the masses and L_f the graph
+// Laplacian of the springs of family f, one vec3 unknown per particle.
+// Each level halves the grid, coarse node (i, j) sitting on fine node
+// (2i, 2j). Residuals go down by the transpose of the bilinear prolongation,
+// and coarse operators are rediscretized: restricted masses and the same
+// spring weights, which is how a 2D Laplacian scales under that restriction,
+// bend links aside (see linkWeights()).
+// Nodes of mass 0 (pinned particles) are fixed at u = 0.
+class Multigrid
+{
+public:
+  // Stencil of the cloth springs, bit l of a node's links ties it to its
+  // neighbour at LINK_OFFSETS[l]
+  static const uint32_t LINK_COUNT = 12;
+  static const glm::ivec2 LINK_OFFSETS[LINK_COUNT];
+  static const SpringFamily LINK_FAMILIES[LINK_COUNT];
+
+  struct Result
+  {
+    uint32_t iterations;
+    float residual; // |b - A u| / |b|
+  };
+
+  Multigrid() = default;
+
+  // Nodes are row major, n = i + j * width
+  void reset(uint32_t width, uint32_t height,
+      const std::vector<uint16_t> &links, const std::vector<float> &masses);
+  inline bool empty() const { return m_levels.empty(); }
+  inline size_t levelCount() const { return m_levels.size(); }
+
+  // Cut the link of a node and the one back, on the finest level alone: the
+  // coarse levels only precondition, and a few links less leaves them close
+  void removeLink(uint32_t node, uint32_t link);
+
+  // (massScale M + sum_f weights[f] L_f) u on the finest level
+  void apply(const float weights[SPRING_FAMILY_COUNT], float massScale,
+      const std::vector<glm::vec3> &u, std::vector<glm::vec3> &result,
+      ThreadPool *pool);
+
+  // Improve u until the relative residual falls below settings.tolerance
+  // or settings.maxIterations sweeps, cycles or CG iterations are done.
+  // The pool, if any, splits every pass by rows.
+  Result solve(const SolverSettings &settings,
+      const float weights[SPRING_FAMILY_COUNT],
+      const std::vector<glm::vec3> &b, std::vector<glm::vec3> &u,
+      ThreadPool *pool);
+
+private:
+  struct Level
+  {
+    uint32_t width, height;
+    std::vector<uint16_t> links;
+    std::vector<float> masses;
+    std::vector<glm::vec3> u, b, r; // scratch of the cycles
+  };
+
+  void linkWeights(const Level &level, float weights[LINK_COUNT]) const;
+  void apply(const Level &level, float massScale, const glm::vec3 *u,
+      glm::vec3 *result, ThreadPool *pool) const;
+  // r = b - A u, returns |r|^2
+  float residual(const Level &level, const glm::vec3 *u, const glm::vec3 *b,
+      glm::vec3 *r, ThreadPool *pool) const;
+  // u += omega r / diag(A), r being the residual of u
+  void relax(const Level &level, glm::vec3 *u, const glm::vec3 *r,
+      ThreadPool *pool) const;
+  void smooth(const Level &level, glm::vec3 *u, const glm::vec3 *b,
+      glm::vec3 *r, uint32_t sweeps, ThreadPool *pool) const;
+  void restrictResidual(uint32_t fine, ThreadPool *pool);
+  void prolongate(uint32_t fine, ThreadPool *pool);
+  void vCycle(uint32_t level, ThreadPool *pool);
+  void solveCoarsest(ThreadPool *pool);
+  uint32_t conjugateGradient(Level &level, glm::vec3 *u, glm::vec3 *r,
+      const std::function<void()> *precondition, float &rr, float target,
+      uint32_t maxIterations, std::vector<glm::vec3> &p,
+      std::vector<glm::vec3> &q, ThreadPool *pool);
+
+  std::vector<Level> m_levels;
+  float m_weights[SPRING_FAMILY_COUNT] = {};
+  std::vector<glm::vec3> m_residual;
+  // Conjugate gradient on the finest level and inside the coarsest solve
+  std::vector<glm::vec3> m_p, m_q, m_coarseP, m_coarseQ;
+};
@@ -1,30 +1,27 @@
 #include "PLink.hpp"
 
-PLink::PLink(const PPoint &p1, const PPoint &p2)
+PLink::PLink(const PPoint &p1, const PPoint &p2, SpringFamily family)
 : m_p1(std::make_shared<PPoint>(p1)),
   m_p2(std::make_shared<PPoint>(p2)),
-  m_k(0.f),
-  m_z(0.f),
+  m_family(family),
   m_l(p2.position() - p1.position())
 {
 
 }
 
-PLink::PLink(PPoint *const p1, PPoint *const p2)
+PLink::PLink(PPoint *const p1, PPoint *const p2, SpringFamily family)
 : m_p1(p1),
   m_p2(p2),
-  m_k(0.f),
-  m_z(0.f),
+  m_family(family),
   m_l(p2->position() - p1->position())
 {
 
 }
 
-PLink::PLink(const std::shared_ptr<PPoint> &p1, const std::shared_ptr<PPoint> &p2)
+PLink::PLink(const std::shared_ptr<PPoint> &p1, const std::shared_ptr<PPoint> &p2, SpringFamily family)
 : m_p1(p1),
   m_p2(p2),
-  m_k(0.f),
-  m_z(0.f),
+  m_family(family),
   m_l(p2->position() - p1->position())
 {
 
@@ -33,8 +30,7 @@ PLink::PLink(const std::shared_ptr<PPoint> &p1, const std::shared_ptr<PPoint> &p
 PLink::PLink(const PLink &plink)
 : m_p1(plink.m_p1),
   m_p2(plink.m_p2),
-  m_k(plink.m_k),
-  m_z(plink.m_z),
+  m_family(plink.m_family),
   m_l(plink.m_l)
 {
 
@@ -44,25 +40,22 @@ PLink::~PLink() {
   
 }
 
-float PLink::s_k(0.);
-float PLink::s_z(0.);
-
-void PLink::SpringHook(const PLink &link) {
+void PLink::SpringHook(const PLink &link, const SpringMaterial &material) {
   glm::vec3 d = link.m_p2->position() - link.m_p1->position();
-  glm::vec3 f = (link.m_k + s_k) * (d - link.m_l); // raideur * allongement
+  glm::vec3 f = material.rigidity * (d - link.m_l); // raideur * allongement
   // distrib
   link.m_p1->applyForce(f);
   link.m_p2->applyForce(-f);
 }
 
-void PLink::SpringBrake(const PLink &link) {
-  SpringHook(link);
-  Brake(link);
+void PLink::SpringBrake(const PLink &link, const SpringMaterial &material) {
+  SpringHook(link, material);
+  Brake(link, material);
 }
 
-void PLink::Brake(const PLink &link) {
+void PLink::Brake(const PLink &link, const SpringMaterial &material) {
   glm::vec3 s = link.m_p2->speed() - link.m_p1->speed();
-  glm::vec3 f = (link.m_z + s_z) * s;
+  glm::vec3 f = material.viscosity * s;
   // distrib
   link.m_p1->applyForce(f);
   link.m_p2->applyForce(-f);
@@ -1,4 +1,7 @@
+#pragma once
+
 #include <glm/glm.hpp>
+#include "ClothMaterial.hpp"
 #include "PPoint.hpp"
 
 class PLink
@@ -6,27 +9,25 @@ class PLink
   public:
 
     // CONSTRUCTORS
-    PLink(const PPoint &p1, const PPoint &p2);
-    PLink(PPoint *const p1, PPoint *const p2);
-    PLink(const std::shared_ptr<PPoint> &p1, const std::shared_ptr<PPoint> &p2);
+    PLink(const PPoint &p1, const PPoint &p2, SpringFamily family = SpringFamily::Structural);
+    PLink(PPoint *const p1, PPoint *const p2, SpringFamily family = SpringFamily::Structural);
+    PLink(const std::shared_ptr<PPoint> &p1, const std::shared_ptr<PPoint> &p2, SpringFamily family = SpringFamily::Structural);
     PLink(const PLink &plink);
     ~PLink();
 
-    // STATIC ATTRIBUTES
-    static float s_k;
-    static float s_z;
-
     // STATIC METHODS
-    static void SpringHook(const PLink &link);
-    static void SpringBrake(const PLink &link);
-    static void Brake(const PLink &link);
-    
+    static void SpringHook(const PLink &link, const SpringMaterial &material);
+    static void SpringBrake(const PLink &link, const SpringMaterial &material);
+    static void Brake(const PLink &link, const SpringMaterial &material);
+
+    // GETTERS
+    inline SpringFamily family() const { return m_family; };
+
     // METHODS
-    virtual void execute() { SpringBrake(*this); };
+    virtual void execute(const StepParams &params) { SpringBrake(*this, params.springs[uint32_t(m_family)]); };
 
   protected:
     const std::shared_ptr<PPoint> m_p1, m_p2;
-    float m_k; // k, raideur
+    SpringFamily m_family; // k, raideur et z, viscosité dans StepParams
     glm::vec3 m_l; // l, longueur à vide 
-    float m_z; // z, viscosité;
 };
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include "ViewerApplication.hpp"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <chrono>
-#include <thread>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -13,15 +16,19 @@
 #include "utils/cameras.hpp"
 #include "utils/images.hpp"
 
-#include "PLink.hpp"
+#include "AdaptiveStepper.hpp"
+#include "ClothBvh.hpp"
+#include "ClothScene.hpp"
+#include "MeshCollider.hpp"
+#include "utils/FramePacer.hpp"
+#include "utils/GpuTimers.hpp"
+#include "utils/gltf.hpp"
+#include "utils/ProgramCache.hpp"
+#include "utils/Profiler.hpp"
+#include "utils/ShaderWatcher.hpp"
+#include "utils/TaskGraph.hpp"
 
-struct ShapeVertex {
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec2 texCoords;
-};
-
-const float FRAMERATE_MILLISECONDS = 1000. / 60.;
+const double TRACE_SECONDS = 10.; // kept for the trace saved by F12
 
 void keyCallback(
     GLFWwindow *window, int key, int scancode, int action, int mods)
@@ -31,46 +38,219 @@ void keyCallback(
   }
 }
 
+namespace {
+
+// A program drawing the cloths and its uniforms, -1 for those it lacks
+struct DrawProgram
+{
+  std::vector<fs::path> paths;
+  GLProgram program;
+  GLint viewMatrix, projMatrix, lightDirection, lightIntensity;
+  GLint viewportSize, pixelsPerSegment; // PN triangles
+  std::unique_ptr<ProgramCache::Build> reload; // once a file changed
+
+  void locate()
+  {
+    viewMatrix = program.getUniformLocation("uViewMatrix");
+    projMatrix = program.getUniformLocation("uProjMatrix");
+    lightDirection = program.getUniformLocation("uLightDirection");
+    lightIntensity = program.getUniformLocation("uLightIntensity");
+    viewportSize = program.getUniformLocation("uViewportSize");
+    pixelsPerSegment = program.getUniformLocation("uPixelsPerSegment");
+  }
+};
+
+} // namespace
+
 int ViewerApplication::run()
 {
-  // Loader shaders
-  const auto glslProgram =
-      compileProgram({m_ShadersRootPath / m_AppName / m_vertexShader,
-          m_ShadersRootPath / m_AppName / m_fragmentShader});
+  // Loader shaders, and PN triangles refining the simulated mesh with the
+  // same shading, each edge split in segments of about pixelsPerSegment on
+  // screen
+  const fs::path shadersPath = m_ShadersRootPath / m_AppName;
+  DrawProgram drawPrograms[2];
+  drawPrograms[0].paths = {
+      shadersPath / m_vertexShader, shadersPath / m_fragmentShader};
+  drawPrograms[1].paths = {shadersPath / "pn_triangles.vs.glsl",
+      shadersPath / "pn_triangles.tcs.glsl",
+      shadersPath / "pn_triangles.tes.glsl", shadersPath / m_fragmentShader};
+  ProgramCache programCache(m_simulation.shaderCachePath);
+  {
+    auto programs =
+        programCache.build({drawPrograms[0].paths, drawPrograms[1].paths});
+    for (size_t p = 0; p < programs.size(); ++p) {
+      drawPrograms[p].program = std::move(programs[p]);
+      drawPrograms[p].locate();
+    }
+  }
+  // Edited shaders are rebuilt while the simulation goes on
+  ShaderWatcher shaderWatcher(shadersPath);
 
   // For the size of the flag | cloth
   const float STEP = 0.5;
 
-  const auto modelViewProjMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelViewProjMatrix");
-  const auto modelViewMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelViewMatrix");
-  const auto normalMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uNormalMatrix");
-
-
-  // LIGHTS
-
-  const auto lightDirectionLocation =
-      glGetUniformLocation(glslProgram.glId(), "uLightDirection");
-  const auto lightIntensityLocation =
-      glGetUniformLocation(glslProgram.glId(), "uLightIntensity");
+  bool tessellation = m_simulation.tessellationPixels > 0.f;
+  float pixelsPerSegment =
+      tessellation ? m_simulation.tessellationPixels : 8.f;
 
   // GLOBAL
   float mass = 1.f;
-  float viscosity = 0.0024f;
-  float rigidity = 0.00965f;
+  ClothMaterial material;
+  material.thickness = 0.2f * STEP;
+  material.drag = 0.05f;
+  material.lift = 0.03f;
   float gravity = 0.5f;
   const float PHYSICS_SCALE = 1e-5;
 
-  glm::vec3 windAmplitude(0.05f, 0.f, 2.25f);
-  glm::vec3 windFrequency(glm::pi<float>(), 0.f, glm::pi<float>());
+  Wind wind{glm::vec3(0.05f, 0.f, 2.25f),
+      glm::vec3(glm::pi<float>(), 0.f, glm::pi<float>())};
+  wind.turbulence = 1.f;
+  wind.gustRate = 0.25f;
+  wind.gustStrength = 3.f;
+
+  ThreadPool threadPool(m_simulation.threadCount);
+  std::vector<float> threadUtilization(threadPool.size(), 0.f);
+
+  // Phases of a frame, timed on the CPU and, for those drawing, on the GPU
+  Profiler profiler(240, TRACE_SECONDS);
+  const auto simulatePhase = profiler.addPhase("simulate");
+  const auto normalsPhase = profiler.addPhase("normals");
+  const auto uploadPhase = profiler.addPhase("upload");
+  const auto drawPhase = profiler.addPhase("draw");
+  const auto imguiPhase = profiler.addPhase("imgui");
+  const auto pollPhase = profiler.addPhase("poll");
+  const auto swapPhase = profiler.addPhase("swap");
+  const auto pacePhase = profiler.addPhase("pace");
+  const auto pickPhase = profiler.addPhase("pick");
+  GpuTimers gpuTimers(profiler);
+  std::vector<float> cpuTimes, gpuTimes;
+  bool saveTrace = false;
+
+  FramePacer pacer(m_simulation.frameRate);
+  bool vsync = m_simulation.vsync;
+  m_GLFWHandle.setVSync(vsync);
+
+  // Calculate vertices and indexes, the index buffer is shared by every whole
+  // cloth
+
+  ClothScene scene(m_simulation.instanceCount, m_simulation.clothWidth,
+      m_simulation.clothHeight, STEP, mass, m_simulation.ordering,
+      m_simulation.springModel, m_simulation.precision);
+
+  if (!m_simulation.colliderPath.empty()) {
+    TriangleMesh model;
+    try {
+      model = loadGltfTriangles(m_simulation.colliderPath);
+    } catch (const std::runtime_error &e) {
+      std::cerr << m_simulation.colliderPath << ": " << e.what() << std::endl;
+      return 1;
+    }
+
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(std::numeric_limits<float>::lowest());
+    for (const auto &p : model.positions) {
+      low = glm::min(low, p);
+      high = glm::max(high, p);
+    }
+    const glm::mat4 placement = scene.groundPlacement(low, high);
+    for (auto &p : model.positions) {
+      p = glm::vec3(placement * glm::vec4(p, 1));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto mesh = std::make_shared<MeshCollider>(model.positions, model.indices);
+    if (m_simulation.sdfResolution > 0) {
+      mesh->bakeDistanceField(
+          threadPool, m_simulation.sdfResolution, 4.f * STEP);
+    }
+    std::cout << "Collider: " << mesh->triangleCount() << " triangles, "
+              << (mesh->hasDistanceField() ? "distance grid" : "BVH")
+              << " built in "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << " ms" << std::endl;
+
+    ColliderSet colliders = scene.colliders();
+    colliders.meshes.push_back({mesh, glm::mat4(1)});
+    scene.setColliders(colliders);
+  }
+
+  // Ray casts of the mouse, the hierarchies refit by the frame graph
+  std::vector<ClothBvh> bvhs;
+  for (const auto &instance : scene.instances()) {
+    bvhs.emplace_back(instance.cloth);
+  }
+  bool picking = true;
+
+  // Particle held by the right button, pinned until released
+  struct Grab
+  {
+    bool active = false;
+    bool pressed = false; // the button, at the last frame
+    size_t instance;
+    uint32_t particle;
+    bool wasPinned;
+    float depth; // along the front of the camera
+    glm::vec3 target; // in the space of the cloth
+  } grab;
+
+  // Substeps as short as the material needs, replayed when they diverge
+  AdaptiveStepper stepper(scene);
+  bool adaptiveStep = true;
+
+  // Edited by the GUI and applied by the wind node of the next frame, like
+  // the material. The GUI shows copies of the last step, taken by the wind
+  // node before any cloth task writes them.
+  SolverSettings solver = scene.solver();
+  AdaptiveStepper::Stats stepperStats;
+  Multigrid::Result lastSolve{0, 0.f};
+
+  // Telemetry of the last frames, plotted from rings starting at
+  // telemetryFrame and streamed to CSV when asked
+  const size_t TELEMETRY_FRAMES = 300;
+  const size_t TELEMETRY_CHANNELS = 3 + 2 * SPRING_FAMILY_COUNT;
+  std::vector<std::string> telemetryNames{
+      "kinetic_energy", "potential_energy", "max_speed"};
+  for (const char *measure : {"max_strain_", "mean_strain_"}) {
+    for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+      std::string name = toString(SpringFamily(f));
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      telemetryNames.push_back(measure + name);
+    }
+  }
+  std::vector<std::vector<float>> telemetryHistory(
+      TELEMETRY_CHANNELS, std::vector<float>(TELEMETRY_FRAMES, 0.f));
+  size_t telemetryFrame = 0;
+
+  std::ofstream telemetryCsv;
+  if (!m_simulation.telemetryPath.empty()) {
+    telemetryCsv.open(m_simulation.telemetryPath);
+    if (!telemetryCsv) {
+      std::cerr << m_simulation.telemetryPath << ": unable to write"
+                << std::endl;
+      return 1;
+    }
+    telemetryCsv << "frame,time";
+    for (const auto &name : telemetryNames) {
+      telemetryCsv << "," << name;
+    }
+    telemetryCsv << "\n";
+    scene.setTelemetryEnabled(true);
+  }
+
+  const auto &indexes = scene.instances().front().cloth.indexes();
+  const size_t vertexCount = scene.instances().front().cloth.particleCount();
+  const GLsizei instanceCount = GLsizei(scene.instances().size());
+
+  const glm::vec3 sceneCenter = 0.5f * (scene.boundsMin() + scene.boundsMax());
+  const float sceneDiagonal = glm::length(scene.boundsMax() - scene.boundsMin());
 
   glm::vec3 up = glm::vec3(0, 1, 0);
-  glm::vec3 eye = glm::vec3(0, 0, 35);
+  glm::vec3 eye = sceneCenter + glm::vec3(0, 0, glm::max(35.f, sceneDiagonal));
 
    // Build projection matrix
-  auto maxDistance = 100.f;
+  auto maxDistance = glm::max(100.f, 2.f * sceneDiagonal);
   const auto projMatrix =
       glm::perspective(70.f, float(m_nWindowWidth) / m_nWindowHeight,
           0.001f * maxDistance, 1.5f * maxDistance);
@@ -84,56 +264,17 @@ int ViewerApplication::run()
   if (m_hasUserCamera) {
     cameraController->setCamera(m_userCamera);
   } else {
-    // TODO Use scene bounds to compute a better default camera
-    cameraController->setCamera(
-        Camera{eye, glm::vec3(0, 0, 0), up});
+    cameraController->setCamera(Camera{eye, sceneCenter, up});
   }
 
 
   // Setup OpenGL state for rendering
   glEnable(GL_DEPTH_TEST);
-  glslProgram.use();
 
   // Light Variables
   glm::vec3 lightDirection(1., 1., 1.);
   glm::vec3 lightIntensity(1., 1., 1.);
 
-  // Calculate vertices
-
-  std::vector<ShapeVertex> data;
-
-  for(size_t i = 0; i < m_nClothWidth; ++i) {
-    for(size_t j = 0; j < m_nClothHeight; ++j) {
-      ShapeVertex vertex;
-            
-      vertex.texCoords.x = float(i) / float(m_nClothWidth);
-      vertex.texCoords.y = float(j) / float(m_nClothHeight);
-
-      vertex.normal = glm::vec3(0, 0, 1); // perpendicular with cloth
-      
-      vertex.position = glm::vec3(i - float(m_nClothWidth) / 2., j - float(m_nClothHeight) / 2., 0.) * STEP;
-
-      data.push_back(vertex);
-    }
-  }
-
-
-  // Store the indexes
-
-  std::vector<GLuint> indexes;
-
-  for(size_t i = 0; i < m_nClothWidth - 1; ++i) {
-    size_t offset = i * m_nClothHeight;
-    for(size_t j = 0; j < m_nClothHeight - 1; ++j) {
-        indexes.push_back(offset + j);
-        indexes.push_back(offset + j + 1);
-        indexes.push_back(offset + m_nClothHeight + j + 1);
-        indexes.push_back(offset + j);
-        indexes.push_back(offset + m_nClothHeight + j);
-        indexes.push_back(offset + m_nClothHeight + j + 1);
-    }
-  }
-
   // Generate VAO
   GLuint vao;
   glGenVertexArrays(1, &vao);
@@ -144,9 +285,11 @@ int ViewerApplication::run()
   const GLuint VERTEX_ATTR_POSITION = 0;
   const GLuint VERTEX_ATTR_NORMAL = 1;
   const GLuint VERTEX_ATTR_TEXTURE = 2;
+  const GLuint VERTEX_ATTR_INSTANCE = 3;
   glEnableVertexAttribArray(VERTEX_ATTR_POSITION);
   glEnableVertexAttribArray(VERTEX_ATTR_NORMAL);
   glEnableVertexAttribArray(VERTEX_ATTR_TEXTURE);
+  glEnableVertexAttribArray(VERTEX_ATTR_INSTANCE);
 
    // Generate VBO
   GLuint vbo;
@@ -155,13 +298,18 @@ int ViewerApplication::run()
   // Bind VBO to VAO
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-  // Insert Data
+  // Insert Data, cloth n owns vertices [n * vertexCount, (n + 1) * vertexCount)
   glBufferData(
       GL_ARRAY_BUFFER,
-      data.size() * sizeof(ShapeVertex),
-      &data[0],
+      instanceCount * vertexCount * sizeof(ShapeVertex),
+      nullptr,
       GL_DYNAMIC_DRAW
   );
+  for (GLsizei n = 0; n < instanceCount; ++n) {
+    const auto &vertices = scene.instances()[n].cloth.vertices();
+    glBufferSubData(GL_ARRAY_BUFFER, n * vertexCount * sizeof(ShapeVertex),
+        vertexCount * sizeof(ShapeVertex), vertices.data());
+  }
 
   // Generate IBO
   GLuint ibo;
@@ -169,7 +317,14 @@ int ViewerApplication::run()
 
   // Bind IBO to VAO
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexes.size() * sizeof(GLuint), &indexes[0], GL_STATIC_DRAW);
+  // Whole cloths share the first indexCount indexes. Cloth n gets a range of
+  // its own at indexBase[n] the first time it tears, the buffer doubling
+  // when every range it holds is taken.
+  const size_t indexCount = indexes.size();
+  std::vector<size_t> indexBase(instanceCount, 0);
+  size_t indexRanges = 1, indexCapacity = 1;
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint),
+      indexes.data(), GL_DYNAMIC_DRAW);
 
   //Specify vertex attributes
   glVertexAttribPointer(
@@ -199,320 +354,705 @@ int ViewerApplication::run()
       (const GLvoid*)(offsetof(ShapeVertex, texCoords))
   );
 
+  // Instance index, advanced once per draw through baseInstance
+  std::vector<GLuint> instanceIndexes(instanceCount);
+  std::iota(instanceIndexes.begin(), instanceIndexes.end(), 0);
+
+  GLuint instanceVbo;
+  glGenBuffers(1, &instanceVbo);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+  glBufferData(GL_ARRAY_BUFFER, instanceCount * sizeof(GLuint),
+      instanceIndexes.data(), GL_STATIC_DRAW);
+  glVertexAttribIPointer(VERTEX_ATTR_INSTANCE, 1, GL_UNSIGNED_INT, 0, 0);
+  glVertexAttribDivisor(VERTEX_ATTR_INSTANCE, 1);
+
 
   glBindVertexArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-  // PHYSICS
-
-  std::vector<std::shared_ptr<PPoint>> ppoints;
-
-  // Immovible extremity
-  for(size_t i = 0; i < m_nClothHeight; ++i) {
-    PFixedPoint pfpoint(data[i].position, 0.);
-    ppoints.push_back(std::make_shared<PFixedPoint>(pfpoint));
+  // Per-instance model matrices, read by the vertex shader
+  std::vector<glm::mat4> modelMatrices;
+  for (const auto &instance : scene.instances()) {
+    modelMatrices.push_back(instance.transform);
   }
 
-  // Inside
-  for(size_t i = m_nClothHeight; i < data.size() - m_nClothHeight; ++i) {
-    PPoint ppoint(data[i].position, mass);
-    ppoints.push_back(std::make_shared<PPoint>(ppoint));
+  GLuint instanceSsbo;
+  glGenBuffers(1, &instanceSsbo);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceSsbo);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, modelMatrices.size() * sizeof(glm::mat4),
+      modelMatrices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  // One indirect draw per run of visible meshlets, each with its part of the
+  // index buffer, rebuilt by every frame
+  struct DrawElementsIndirectCommand
+  {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLuint baseVertex;
+    GLuint baseInstance;
+  };
+  std::vector<DrawElementsIndirectCommand> drawCommands;
+
+  GLuint indirectBuffer;
+  glGenBuffers(1, &indirectBuffer);
+
+  // Meshlets outside the view are not drawn, and tiles no drawn meshlet
+  // reads are not uploaded: their vertices go stale until one comes into
+  // view, and are uploaded before it is drawn
+  bool culling = true;
+  size_t drawnMeshlets = 0;
+  std::vector<std::vector<uint8_t>> tileNeeded(instanceCount);
+  std::vector<std::vector<uint8_t>> tileStale(instanceCount);
+  for (GLsizei n = 0; n < instanceCount; ++n) {
+    tileNeeded[n].assign(scene.instances()[n].cloth.tiles().size(), 1);
+    tileStale[n].assign(scene.instances()[n].cloth.tiles().size(), 0);
   }
 
-  // Extremity
-  for(size_t i = data.size() - m_nClothHeight; i < data.size(); ++i) {
-    PPoint ppoint(data[i].position, mass * 0.9);
-    ppoints.push_back(std::make_shared<PPoint>(ppoint));
-  }
+  // Lambda function to draw the scene
+  const auto drawScene = [&](const Camera &camera) {
+    glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  std::vector<PLink> plinks;
+    const auto viewMatrix = camera.getViewMatrix();
 
-  /// Structural Mesh + Diagonal Mesh
-  // For fixed Point
-  for(size_t j = 0; j < m_nClothHeight - 1; ++j) {
-    // Horizontal
-    plinks.push_back(PLink(ppoints[j], ppoints[m_nClothHeight + j]));
-    // Diagonal left-top corner to right-bottom corner
-    plinks.push_back(PLink(ppoints[j], ppoints[m_nClothHeight + j + 1]));
-  }
+    glm::vec3 ligthDirInViewSpace(glm::normalize(viewMatrix * glm::vec4(lightDirection, 0.))); 
 
-  // For internal
-  for (size_t i = 1; i < m_nClothWidth - 1; ++i) {
-    for (size_t j = 0; j < m_nClothHeight - 1; ++j) {
-      // Horizontal
-      plinks.push_back(PLink(ppoints[i * m_nClothHeight + j], ppoints[(i + 1) * m_nClothHeight + j]));
-      // Verical
-      plinks.push_back(PLink(ppoints[i * m_nClothHeight + j], ppoints[i * m_nClothHeight + j + 1]));
-      // Diagonal left-bottom corner to right-top corner
-      plinks.push_back(PLink(ppoints[(i - 1) * m_nClothHeight + j + 1], ppoints[i * m_nClothHeight + j]));
-      // Diagonal left-top corner to right-bottom corner
-      plinks.push_back(PLink(ppoints[i * m_nClothHeight + j], ppoints[(i + 1) * m_nClothHeight + j + 1]));
+    const DrawProgram &draw = drawPrograms[tessellation ? 1 : 0];
+    draw.program.use();
+
+    if(draw.lightDirection >= 0 ) {
+      glUniform3fv(draw.lightDirection, 1, glm::value_ptr(ligthDirInViewSpace));
     }
-  }
 
-  // For extrema
-  for (size_t i = 0; i < m_nClothWidth - 1; ++i) {
-    // Horizontal
-    plinks.push_back(PLink(ppoints[(i + 1) * m_nClothHeight - 1], ppoints[(i + 2) * m_nClothHeight - 1]));
-  }
-  
-  for (size_t j = 0; j < m_nClothHeight - 1; ++j) {
-    // Vertical
-    plinks.push_back(PLink(ppoints[(m_nClothWidth - 1) * m_nClothHeight + j], ppoints[(m_nClothWidth - 1) * m_nClothHeight + j + 1]));
-    // Diagonal left-bottom corner to right-top corner
-    plinks.push_back(PLink(ppoints[(m_nClothWidth - 2) * m_nClothHeight + j + 1], ppoints[(m_nClothWidth - 1) * m_nClothHeight + j]));
-  }
+    if(draw.lightIntensity >= 0) {
+      glUniform3fv(draw.lightIntensity, 1, glm::value_ptr(lightIntensity));
+    }
 
-  /// Bridge Mesh
-  for(size_t i = 0; i < m_nClothWidth - 2; ++i) {
-    for(size_t j = 0; j < m_nClothHeight - 2; ++j) {
+    glUniformMatrix4fv(
+        draw.viewMatrix, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+    glUniformMatrix4fv(
+        draw.projMatrix, 1, GL_FALSE, glm::value_ptr(projMatrix));
+    if (tessellation) {
+      glUniform2f(draw.viewportSize, float(m_nWindowWidth),
+          float(m_nWindowHeight));
+      glUniform1f(draw.pixelsPerSegment, pixelsPerSegment);
+      glPatchParameteri(GL_PATCH_VERTICES, 3);
+    }
 
-      if(i > 0) { // no need for fixed points
-        // Vertical Bridge
-        plinks.push_back(PLink(ppoints[i * m_nClothHeight + j], ppoints[i * m_nClothHeight + j + 2]));
-      }
+    // The simulation is idle while drawing, the vertices of the cloths are
+    // those of the last step
+    drawCommands.clear();
+    drawnMeshlets = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (GLsizei n = 0; n < instanceCount; ++n) {
+      const Cloth &cloth = scene.instances()[n].cloth;
+      const Frustum frustum(
+          projMatrix * viewMatrix * scene.instances()[n].transform);
+      // PN triangles bulge out of the flat ones
+      const glm::vec3 margin(tessellation ? cloth.spacing() : 0.f);
+      std::fill(tileNeeded[n].begin(), tileNeeded[n].end(), 0);
+      for (const auto &meshlet : cloth.meshlets()) {
+        if (culling &&
+            !frustum.intersects(meshlet.low - margin, meshlet.high + margin)) {
+          continue;
+        }
+        ++drawnMeshlets;
+        for (const uint32_t tile : meshlet.tiles) {
+          tileNeeded[n][tile] = 1;
+          if (tileStale[n][tile]) {
+            const auto &range = cloth.tiles()[tile];
+            glBufferSubData(GL_ARRAY_BUFFER,
+                (n * vertexCount + range.begin) * sizeof(ShapeVertex),
+                (range.end - range.begin) * sizeof(ShapeVertex),
+                cloth.vertices().data() + range.begin);
+            tileStale[n][tile] = 0;
+          }
+        }
 
-      // Horizontal Bridge
-      plinks.push_back(PLink(ppoints[i * m_nClothHeight + j], ppoints[(i + 2) * m_nClothHeight + j]));
-      
+        const GLuint firstIndex =
+            GLuint(indexBase[n] + 3 * meshlet.firstTriangle);
+        if (!drawCommands.empty() &&
+            drawCommands.back().baseInstance == GLuint(n) &&
+            drawCommands.back().firstIndex + drawCommands.back().count ==
+                firstIndex) {
+          drawCommands.back().count += 3 * meshlet.triangleCount;
+        } else {
+          drawCommands.push_back({3 * meshlet.triangleCount, 1, firstIndex,
+              GLuint(n * vertexCount), GLuint(n)});
+        }
+      }
     }
-  }
-  
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  // Lambda function to simulate physics
-  const auto simulateScene = [&](const float h) {
-    
-    const float fe = 1. / h;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceSsbo);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER,
+        drawCommands.size() * sizeof(DrawElementsIndirectCommand),
+        drawCommands.data(), GL_STREAM_DRAW);
+    glBindVertexArray(vao);
 
-    const glm::vec3 wind = windAmplitude * glm::cos(windFrequency * float(glfwGetTime())) * fe;
-    const glm::vec3 g = glm::vec3(0, -gravity * fe, 0);
+    glMultiDrawElementsIndirect(tessellation ? GL_PATCHES : GL_TRIANGLES,
+        GL_UNSIGNED_INT, nullptr, GLsizei(drawCommands.size()), 0);
 
-    PLink::s_k = rigidity * fe * fe;
-    PLink::s_z = viscosity * fe;
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  };
 
-    for(size_t i = 0; i < plinks.size(); ++i) {
-      plinks[i].execute();
-    }
+  // Lambda function to build the GUI
+  const auto drawGUI = [&](const Camera &camera) {
+    imguiNewFrame();
 
-    // For positions
-    for(size_t i = 0; i < data.size(); ++i) {
-      ppoints[i]->applyForce(g + wind); // apply gravity and wind
-      ppoints[i]->execute(h);
-      ppoints[i]->clearForce();
-      data[i].position = ppoints[i]->position();
-    }
+    ImGui::Begin("GUI");
+    ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
+        1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
+      ImGui::Text("eye: %.3f %.3f %.3f", camera.eye().x, camera.eye().y,
+          camera.eye().z);
+      ImGui::Text("center: %.3f %.3f %.3f", camera.center().x,
+          camera.center().y, camera.center().z);
+      ImGui::Text(
+          "up: %.3f %.3f %.3f", camera.up().x, camera.up().y, camera.up().z);
+
+      ImGui::Text("front: %.3f %.3f %.3f", camera.front().x, camera.front().y,
+          camera.front().z);
+      ImGui::Text("left: %.3f %.3f %.3f", camera.left().x, camera.left().y,
+          camera.left().z);
+
+      if (ImGui::Button("CLI camera args to clipboard")) {
+        std::stringstream ss;
+        ss << "--lookat " << camera.eye().x << "," << camera.eye().y << ","
+           << camera.eye().z << "," << camera.center().x << ","
+           << camera.center().y << "," << camera.center().z << ","
+           << camera.up().x << "," << camera.up().y << "," << camera.up().z;
+        const auto str = ss.str();
+        glfwSetClipboardString(m_GLFWHandle.window(), str.c_str());
+      }
 
-    // For Normals
-    for(size_t i = 0; i < m_nClothWidth; ++i) {
-      for(size_t j = 0; j < m_nClothHeight; ++j) {
-        glm::vec3 sum(0.);
-        float count = 0.f;
-        if(j > 0 && i > 0) { // Top - Left (2 triangles)
-          sum += glm::cross(
-            ppoints[i * m_nClothHeight + j - 1]->position() - ppoints[i * m_nClothHeight + j]->position(),
-            ppoints[(i - 1) * m_nClothHeight + j - 1]->position() - ppoints[i * m_nClothHeight + j]->position()
-          );
-          ++count;
+      // Radio buttons to switch camera type
+      static int cameraControllerType = 0;
+      if (ImGui::RadioButton("Trackball", &cameraControllerType, 0)) {
+        cameraController = std::make_unique<TrackballCameraController>(m_GLFWHandle.window(), cameraSpeed);
+        cameraController->setCamera(camera);
+      }
+      ImGui::SameLine();
+      if (ImGui::RadioButton("FirstPerson", &cameraControllerType, 1)) {
+        cameraController = std::make_unique<FirstPersonCameraController>(m_GLFWHandle.window(), cameraSpeed * maxDistance);
+        cameraController->setCamera(camera);
+      }
+    }
 
-          sum += glm::cross(
-            ppoints[(i - 1) * m_nClothHeight + j - 1]->position() - ppoints[i * m_nClothHeight + j]->position(),
-            ppoints[(i - 1) * m_nClothHeight + j]->position() - ppoints[i * m_nClothHeight + j]->position()
+    if (ImGui::CollapsingHeader("Light", ImGuiTreeNodeFlags_DefaultOpen)) {
+      static float theta = 0.0f;
+      static float phi = 0.0f;
+      static bool lightFromCamera = true;
+      ImGui::Checkbox("Light from camera", &lightFromCamera);
+      if (lightFromCamera) {
+        lightDirection = -camera.front();
+      } else {
+        if (ImGui::SliderFloat("Theta", &theta, 0.f, glm::pi<float>()) ||
+            ImGui::SliderFloat("Phi", &phi, 0, 2.f * glm::pi<float>())) {
+          lightDirection = glm::vec3(
+            glm::sin(theta) * glm::cos(phi),
+            glm::cos(theta),
+            glm::sin(theta) * glm::sin(phi)
           );
-          ++count;
         }
+      }
 
-        if(j < m_nClothWidth - 1 && i < m_nClothWidth - 1) { // Bottom - Right (2 triangles)
-          sum += glm::cross(
-            ppoints[(i + 1) * m_nClothHeight + j + 1]->position() - ppoints[i * m_nClothHeight + j]->position(),
-            ppoints[(i + 1) * m_nClothHeight + j]->position() - ppoints[i * m_nClothHeight + j]->position()
-          );
-          ++count;
+      static glm::vec3 lightColor(1.f, 1.f, 1.f);
+      static float lightIntensityFactor = 1.f;
+      if (ImGui::ColorEdit3("Light Color", (float *)&lightColor) ||
+          ImGui::SliderFloat("Ligth Intensity", &lightIntensityFactor, 0.f, 10.f)) {
+        lightIntensity = lightColor * lightIntensityFactor;
+      }
+    }
 
-          sum += glm::cross(
-            ppoints[i * m_nClothHeight + j + 1]->position() - ppoints[i * m_nClothHeight + j]->position(),
-            ppoints[(i + 1) * m_nClothHeight + j + 1]->position() - ppoints[i * m_nClothHeight + j]->position()
-          );
-          ++count;
+    // Smoothness on screen no longer depends on the particle count
+    if (ImGui::CollapsingHeader("Tessellation")) {
+      ImGui::Checkbox("PN triangles", &tessellation);
+      if (tessellation) {
+        ImGui::SliderFloat("Pixels per segment", &pixelsPerSegment, 1.f, 64.f);
+      }
+      ImGui::Text("%zu particles, %u triangles simulated per cloth",
+          scene.instances().front().cloth.particleCount(),
+          scene.instances().front().cloth.triangleCount());
+      ImGui::Checkbox("Cull meshlets out of view", &culling);
+      ImGui::Text("%zu of %zu meshlets drawn", drawnMeshlets,
+          instanceCount * scene.instances().front().cloth.meshlets().size());
+    }
+
+    if (ImGui::CollapsingHeader("Physics", ImGuiTreeNodeFlags_DefaultOpen)) {
+      static float g = gravity * 10.f;
+
+      if (ImGui::SliderFloat("Gravity", &g, 0.f, 10.f)) {
+        gravity = g / 10.f;
+      }
+
+      // 0 lets the cloth pass through itself
+      ImGui::SliderFloat("Thickness", &material.thickness, 0.f, STEP);
+
+      // 0 never tears
+      ImGui::SliderFloat("Tear strain", &material.tearStrain, 0.f, 4.f);
+      ImGui::Text("%zu springs left in the first cloth",
+          scene.instances().front().cloth.springCount());
+
+      // Settled tiles stop being simulated and uploaded, 0 never
+      ImGui::SliderFloat("Sleep speed", &material.sleepSpeed, 0.f, 1.f);
+      ImGui::Text("%u of %zu tiles asleep in the first cloth",
+          scene.instances().front().cloth.asleepCount(),
+          scene.instances().front().cloth.tiles().size());
+
+      // Per triangle, against the drift of the wind
+      ImGui::SliderFloat("Drag", &material.drag, 0.f, 1.f);
+      ImGui::SliderFloat("Lift", &material.lift, 0.f, 1.f);
+
+      // Implicit steps are stable at any length, they replace the adaptive
+      // stepper while enabled
+      ImGui::Checkbox("Implicit step", &solver.implicit);
+      if (solver.implicit) {
+        const char *methods[] = {toString(SolverMethod::Jacobi),
+            toString(SolverMethod::VCycle),
+            toString(SolverMethod::MultigridCG)};
+        int method = int(solver.method);
+        if (ImGui::Combo("Solver", &method, methods, IM_ARRAYSIZE(methods))) {
+          solver.method = SolverMethod(method);
         }
+        ImGui::SliderFloat("Tolerance", &solver.tolerance,
+            1e-6f, 1e-1f, "%.1e", 10.f);
+        int iterations = int(solver.maxIterations);
+        if (ImGui::SliderInt("Iterations", &iterations, 1, 200)) {
+          solver.maxIterations = uint32_t(iterations);
+        }
+        ImGui::Text("%u iterations, residual %.2e", lastSolve.iterations,
+            lastSolve.residual);
+      }
 
-        if (j > 0 && i < m_nClothWidth - 1) { // Top - Right
-          sum += glm::cross(
-            ppoints[i * m_nClothHeight + j - 1]->position() - ppoints[i * m_nClothHeight + j]->position(),
-            ppoints[(i + 1) * m_nClothHeight + j]->position() - ppoints[i * m_nClothHeight + j]->position()
-          );
-          ++count;
+      ImGui::Checkbox("Grab with the right button", &picking);
+
+      ImGui::Checkbox("Adaptive step", &adaptiveStep);
+      if (adaptiveStep && !solver.implicit) {
+        ImGui::Text("%u substeps, %u rollbacks, stable below %.3g s",
+            stepperStats.substeps, stepperStats.rollbacks,
+            stepperStats.stableStep);
+        if (stepperStats.stops > 0) {
+          ImGui::Text("Stopped %u times", stepperStats.stops);
         }
+      }
 
-        if(i > 0 && j < m_nClothWidth - 1) { // Left - Bottom
-          sum += glm::cross(
-            ppoints[(i - 1) * m_nClothHeight + j]->position() - ppoints[i * m_nClothHeight + j]->position(),
-            ppoints[i * m_nClothHeight + j + 1]->position() - ppoints[i * m_nClothHeight + j]->position()
-          );
-          ++count;
+      bool telemetry = scene.telemetryEnabled();
+      if (ImGui::Checkbox("Telemetry", &telemetry)) {
+        scene.setTelemetryEnabled(telemetry);
+      }
+      if (telemetry && ImGui::TreeNode("Last frames")) {
+        const size_t last =
+            (telemetryFrame + TELEMETRY_FRAMES - 1) % TELEMETRY_FRAMES;
+        for (size_t c = 0; c < TELEMETRY_CHANNELS; ++c) {
+          char overlay[32];
+          std::snprintf(
+              overlay, sizeof(overlay), "%.4g", telemetryHistory[c][last]);
+          ImGui::PlotLines(telemetryNames[c].c_str(),
+              telemetryHistory[c].data(), int(TELEMETRY_FRAMES),
+              int(telemetryFrame % TELEMETRY_FRAMES), overlay, FLT_MAX,
+              FLT_MAX, ImVec2(0, 40));
         }
+        ImGui::TreePop();
+      }
 
-        data[i * m_nClothHeight + j].normal = glm::normalize(sum / count);
+      bool obstacles = scene.collidersEnabled();
+      if (ImGui::Checkbox("Ground, poles and obstacles", &obstacles)) {
+        scene.setCollidersEnabled(obstacles);
       }
-    }
 
-    void* ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-    std::memcpy(ptr, &data[0], data.size() * sizeof(ShapeVertex));
-    bool done = glUnmapBuffer(GL_ARRAY_BUFFER);
-    assert(done);
+      for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+        SpringMaterial &spring = material.springs[f];
+        float k = spring.rigidity / PHYSICS_SCALE;
+        float z = spring.viscosity / PHYSICS_SCALE;
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-  };
+        ImGui::PushID(f);
+        if (ImGui::TreeNodeEx(toString(SpringFamily(f)),
+                ImGuiTreeNodeFlags_DefaultOpen)) {
+          if (ImGui::SliderFloat("Rigidity", &k, 0.f, 1000.f)) {
+            spring.rigidity = k * PHYSICS_SCALE;
+          }
 
-  // Lambda function to draw the scene
-  const auto drawScene = [&](const Camera &camera) {
-    glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          if (ImGui::SliderFloat("Viscosity", &z, 0.f, 1000.f)) {
+            spring.viscosity = z * PHYSICS_SCALE;
+          }
+          ImGui::TreePop();
+        }
+        ImGui::PopID();
+      }
 
-    const auto viewMatrix = camera.getViewMatrix();
+      if(ImGui::SliderFloat3("Wind Amplitude", &wind.amplitude.x, 0.f, 5.f)) {
+        // VOID
+      }
 
-    glm::vec3 ligthDirInViewSpace(glm::normalize(viewMatrix * glm::vec4(lightDirection, 0.))); 
+      if(ImGui::SliderFloat3("Wind Frequency", &wind.frequency.x, 0.f, 2.f * glm::pi<float>())) {
+        // VOID
+      }
 
-    if(lightDirectionLocation >= 0 ) {
-      glUniform3fv(lightDirectionLocation, 1, glm::value_ptr(ligthDirInViewSpace));
+      ImGui::SliderFloat("Turbulence", &wind.turbulence, 0.f, 5.f);
+      ImGui::SliderFloat("Turbulence scale", &wind.scale, 0.5f, 20.f);
+      ImGui::SliderFloat3("Drift", &wind.drift.x, -10.f, 10.f);
+      ImGui::SliderFloat("Gusts per second", &wind.gustRate, 0.f, 2.f);
+      ImGui::SliderFloat("Gust strength", &wind.gustStrength, 0.f, 10.f);
     }
-
-    if(lightIntensityLocation >= 0) {
-      glUniform3fv(lightIntensityLocation, 1, glm::value_ptr(lightIntensity));
+    if (ImGui::CollapsingHeader("Profiler")) {
+      // CPU time summed over the threads, GPU time a few frames late
+      for (Profiler::PhaseId phase = 0; phase < profiler.phaseCount();
+           ++phase) {
+        profiler.cpuHistory(phase, cpuTimes);
+        profiler.gpuHistory(phase, gpuTimes);
+        const size_t recent = std::min<size_t>(60, cpuTimes.size());
+        const float cpu = std::accumulate(cpuTimes.end() - recent,
+                              cpuTimes.end(), 0.f) / recent;
+        const float gpu = std::accumulate(gpuTimes.end() - recent,
+                              gpuTimes.end(), 0.f) / recent;
+        char overlay[48];
+        std::snprintf(overlay, sizeof(overlay), "CPU %.2f ms, GPU %.2f ms",
+            cpu, gpu);
+        ImGui::PlotLines(profiler.phaseName(phase).c_str(), cpuTimes.data(),
+            int(cpuTimes.size()), 0, overlay, 0.f, FLT_MAX, ImVec2(0, 40));
+      }
+      if (ImGui::Button("Save trace (F12)")) {
+        saveTrace = true;
+      }
     }
+    if (ImGui::IsKeyPressed(GLFW_KEY_F12, false)) {
+      saveTrace = true;
+    }
+    if (ImGui::CollapsingHeader("Frame pacing")) {
+      float rate = pacer.targetRate();
+      if (ImGui::SliderFloat("Target FPS (0 uncapped)", &rate, 0.f, 240.f,
+              "%.0f")) {
+        pacer.setTargetRate(rate);
+      }
+      float spin = pacer.spinMilliseconds();
+      if (ImGui::SliderFloat("Spin before deadline", &spin, 0.f, 5.f,
+              "%.1f ms")) {
+        pacer.setSpinMilliseconds(spin);
+      }
+      if (ImGui::Checkbox("VSync", &vsync)) {
+        m_GLFWHandle.setVSync(vsync);
+      }
 
-    const glm::mat4 modelMatrix(1);
-
-    const glm::mat4 modelViewMatrix = viewMatrix * modelMatrix;
-    const glm::mat4 modelViewProjMatrix = projMatrix * modelViewMatrix;
-    const glm::mat4 normalMatrix = glm::transpose(glm::inverse(modelViewMatrix));
+      // Up to the slowest bucket used, the last one holding longer frames
+      const auto &histogram = pacer.histogram();
+      size_t used = 1;
+      for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+        if (histogram[bucket] > 0) {
+          used = bucket + 1;
+        }
+      }
+      std::vector<float> counts(histogram.begin(), histogram.begin() + used);
+      char overlay[64];
+      std::snprintf(overlay, sizeof(overlay), "p50 %.1f ms, p99 %.1f ms",
+          pacer.percentile(0.5f), pacer.percentile(0.99f));
+      ImGui::PlotHistogram("Frame times", counts.data(), int(counts.size()),
+          0, overlay, 0.f, FLT_MAX, ImVec2(0, 60));
+      ImGui::Text("%llu frames in %.1f ms buckets",
+          (unsigned long long)pacer.frameCount(),
+          FramePacer::BUCKET_MILLISECONDS);
+      if (ImGui::Button("Reset histogram")) {
+        pacer.resetHistogram();
+      }
+    }
+    if (ImGui::CollapsingHeader("Threads")) {
+      // Busy fraction of the last frame, slot 0 is the main thread
+      for (size_t slot = 0; slot < threadUtilization.size(); ++slot) {
+        const auto label = std::to_string(slot);
+        ImGui::ProgressBar(
+            std::min(threadUtilization[slot], 1.f), ImVec2(-1, 0), label.c_str());
+      }
+    }
+    ImGui::End();
 
-    glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-    glUniformMatrix4fv(modelViewProjMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjMatrix));
-    glUniformMatrix4fv(normalMatrixLocation, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    GpuTimers::Scope gpuScope(gpuTimers, imguiPhase);
+    imguiRenderFrame();
+  };
 
-    glBindVertexArray(vao);
+  // Frame graph, the simulation runs on the pool while the main thread builds
+  // the GUI. Nodes touching OpenGL or ImGui stay on the main thread, and the
+  // wind node snapshots the parameters before the GUI may change them.
+  // Each frame simulates the whole period of the previous one, drawing, GUI,
+  // events and swap included
+  double frameStart = glfwGetTime();
+  double framePeriod = 1. / pacer.targetRate();
+  ShapeVertex *mappedVertices = nullptr;
+  std::vector<uint32_t> tornTriangles;
+
+  // Fixed steps schedule every phase of every tile in the frame graph, the
+  // adaptive stepper runs its substeps from a single node
+  const auto buildFrameGraph = [&](TaskGraph &frameGraph, bool adaptive,
+                                   const ClothScene::StepStages &stages) {
+    const auto windNode = frameGraph.addNode("wind",
+        [&]() {
+          stepperStats = stepper.stats();
+          lastSolve = scene.instances().front().cloth.lastSolve();
+          scene.setSolver(solver, &threadPool);
+          scene.prepareStep(material, float(framePeriod),
+              float(glfwGetTime()), gravity, wind);
+          if (grab.active) {
+            scene.instances()[grab.instance].cloth.movePinned(grab.particle,
+                grab.target, scene.stepParams()[grab.instance].h);
+          }
 
-    glDrawElements(GL_TRIANGLES, indexes.size(), GL_UNSIGNED_INT, 0);
+          // Only the runs of triangles just torn: a tear across the rows
+          // touches triangles all over the buffer. The VAO keeps the index
+          // buffer bound as the element one.
+          for (GLsizei n = 0; n < instanceCount; ++n) {
+            Cloth &cloth = scene.instances()[n].cloth;
+            cloth.takeTornTriangles(tornTriangles);
+            if (tornTriangles.empty()) {
+              continue;
+            }
+            if (indexBase[n] == 0) {
+              if (indexRanges == indexCapacity) {
+                indexCapacity *= 2;
+                GLuint grown;
+                glGenBuffers(1, &grown);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+                glBufferData(GL_COPY_WRITE_BUFFER,
+                    indexCapacity * indexCount * sizeof(GLuint), nullptr,
+                    GL_DYNAMIC_DRAW);
+                glBindBuffer(GL_COPY_READ_BUFFER, ibo);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                    0, 0, indexRanges * indexCount * sizeof(GLuint));
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                glDeleteBuffers(1, &ibo);
+                ibo = grown;
+                glBindVertexArray(vao);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+                glBindVertexArray(0);
+              }
+              // Every index at once, torn triangles included
+              indexBase[n] = indexRanges++ * indexCount;
+              glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+              glBufferSubData(GL_COPY_WRITE_BUFFER,
+                  indexBase[n] * sizeof(GLuint), indexCount * sizeof(GLuint),
+                  cloth.indexes().data());
+              continue;
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+            for (size_t t = 0; t < tornTriangles.size();) {
+              size_t end = t + 1;
+              while (end < tornTriangles.size() &&
+                     tornTriangles[end] == tornTriangles[end - 1] + 1) {
+                ++end;
+              }
+              const size_t first = 3 * size_t(tornTriangles[t]);
+              glBufferSubData(GL_COPY_WRITE_BUFFER,
+                  (indexBase[n] + first) * sizeof(GLuint),
+                  3 * (end - t) * sizeof(GLuint), &cloth.indexes()[first]);
+              t = end;
+            }
+          }
+          glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        },
+        true);
+    const auto guiNode = frameGraph.addNode(
+        "gui", [&]() { drawGUI(cameraController->getCamera()); }, true);
+    frameGraph.addDependency(windNode, guiNode);
+
+    const auto mapNode = frameGraph.addNode("map",
+        [&]() {
+          glBindBuffer(GL_ARRAY_BUFFER, vbo);
+          mappedVertices = static_cast<ShapeVertex *>(
+              glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
+          glBindBuffer(GL_ARRAY_BUFFER, 0);
+        },
+        true);
+    const auto uploadNode = frameGraph.addNode("upload",
+        [&]() {
+          glBindBuffer(GL_ARRAY_BUFFER, vbo);
+          bool done = glUnmapBuffer(GL_ARRAY_BUFFER);
+          assert(done);
+          glBindBuffer(GL_ARRAY_BUFFER, 0);
+        },
+        true);
+
+    const auto clothNodes =
+        adaptive ? stepper.addStepTasks(frameGraph, windNode, threadPool)
+                 : scene.addStepTasks(frameGraph, windNode, stages);
+    for (size_t n = 0; n < clothNodes.size(); ++n) {
+      const auto &tiles = scene.instances()[n].cloth.tiles();
+      for (size_t tile = 0; tile < tiles.size(); ++tile) {
+        const auto packNode = frameGraph.addNode("pack", [&, n, tile]() {
+          // A sleeping tile has not moved since its last upload, which the
+          // mapping keeps
+          const Cloth &cloth = scene.instances()[n].cloth;
+          if (cloth.isAsleep(tile)) {
+            return;
+          }
+          // Out of view at the last draw, uploaded once back in view
+          if (!tileNeeded[n][tile]) {
+            tileStale[n][tile] = 1;
+            return;
+          }
+          tileStale[n][tile] = 0;
+          const auto &vertices = cloth.vertices();
+          const auto &range = cloth.tiles()[tile];
+          std::memcpy(mappedVertices + n * vertexCount + range.begin,
+              vertices.data() + range.begin,
+              (range.end - range.begin) * sizeof(ShapeVertex));
+        });
+        frameGraph.addDependency(clothNodes[n][tile], packNode);
+        frameGraph.addDependency(mapNode, packNode);
+        frameGraph.addDependency(packNode, uploadNode);
+      }
 
-    glBindVertexArray(0);
+      // Boxes of the settled cloth, for the ray casts between frames
+      const auto settled = frameGraph.addNode("settled", []() {});
+      for (const auto node : clothNodes[n]) {
+        frameGraph.addDependency(node, settled);
+      }
+      const auto refitted = frameGraph.addNode("bvh", [&, n]() {
+        if (picking) {
+          bvhs[n].refitTop();
+        }
+      });
+      for (uint32_t subtree = 0; subtree < bvhs[n].subtreeCount();
+           ++subtree) {
+        const auto refit = frameGraph.addNode("bvh", [&, n, subtree]() {
+          if (picking) {
+            bvhs[n].refitSubtree(scene.instances()[n].cloth, subtree);
+          }
+        });
+        frameGraph.addDependency(settled, refit);
+        frameGraph.addDependency(refit, refitted);
+      }
+    }
+  };
 
+  // Rebuilt for the stages of the next step, before its wind node prepares
+  // it: the GUI only changes them after that
+  TaskGraph fixedFrameGraph, adaptiveFrameGraph;
+  ClothScene::StepStages frameStages;
+  const auto buildFrameGraphs = [&](const ClothScene::StepStages &stages) {
+    frameStages = stages;
+    fixedFrameGraph.clear();
+    adaptiveFrameGraph.clear();
+    buildFrameGraph(fixedFrameGraph, false, stages);
+    buildFrameGraph(adaptiveFrameGraph, true, stages);
+
+    // Every node is timed, the phase following from its name
+    for (TaskGraph *frameGraph : {&fixedFrameGraph, &adaptiveFrameGraph}) {
+      frameGraph->setProfiler(&profiler);
+      for (TaskGraph::NodeId node = 0; node < frameGraph->size(); ++node) {
+        const std::string &name = frameGraph->name(node);
+        const std::string normals = "/normals";
+        if (name == "gui") {
+          frameGraph->setPhase(node, imguiPhase);
+        } else if (name == "bvh") {
+          frameGraph->setPhase(node, pickPhase);
+        } else if (name == "map" || name == "pack" || name == "upload") {
+          frameGraph->setPhase(node, uploadPhase);
+        } else if (name.size() > normals.size() &&
+                   name.compare(name.size() - normals.size(), normals.size(),
+                       normals) == 0) {
+          frameGraph->setPhase(node, normalsPhase);
+        } else {
+          frameGraph->setPhase(node, simulatePhase);
+        }
+      }
+    }
+  };
+  const auto nextStages = [&]() {
+    ClothScene::StepStages stages;
+    stages.selfCollision = material.thickness > 0.f;
+    stages.implicit = solver.implicit;
+    return stages;
   };
+  buildFrameGraphs(nextStages());
 
   // Loop until the user closes the window
   for (auto iterationCount = 0u; !m_GLFWHandle.shouldClose();
        ++iterationCount) {
     const auto seconds = glfwGetTime();
-
-    const auto camera = cameraController->getCamera();
-    drawScene(camera);
-
-    // GUI code:
-    imguiNewFrame();
+    if (iterationCount > 0) {
+      framePeriod = seconds - frameStart;
+    }
+    frameStart = seconds;
 
     {
-      ImGui::Begin("GUI");
-      ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
-          1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-      if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
-        ImGui::Text("eye: %.3f %.3f %.3f", camera.eye().x, camera.eye().y,
-            camera.eye().z);
-        ImGui::Text("center: %.3f %.3f %.3f", camera.center().x,
-            camera.center().y, camera.center().z);
-        ImGui::Text(
-            "up: %.3f %.3f %.3f", camera.up().x, camera.up().y, camera.up().z);
-
-        ImGui::Text("front: %.3f %.3f %.3f", camera.front().x, camera.front().y,
-            camera.front().z);
-        ImGui::Text("left: %.3f %.3f %.3f", camera.left().x, camera.left().y,
-            camera.left().z);
-
-        if (ImGui::Button("CLI camera args to clipboard")) {
-          std::stringstream ss;
-          ss << "--lookat " << camera.eye().x << "," << camera.eye().y << ","
-             << camera.eye().z << "," << camera.center().x << ","
-             << camera.center().y << "," << camera.center().z << ","
-             << camera.up().x << "," << camera.up().y << "," << camera.up().z;
-          const auto str = ss.str();
-          glfwSetClipboardString(m_GLFWHandle.window(), str.c_str());
-        }
+      Profiler::Scope scope(profiler, drawPhase);
+      GpuTimers::Scope gpuScope(gpuTimers, drawPhase);
+      drawScene(cameraController->getCamera());
+    }
 
-        // Radio buttons to switch camera type
-        static int cameraControllerType = 0;
-        if (ImGui::RadioButton("Trackball", &cameraControllerType, 0)) {
-          cameraController = std::make_unique<TrackballCameraController>(m_GLFWHandle.window(), cameraSpeed);
-          cameraController->setCamera(camera);
-        }
-        ImGui::SameLine();
-        if (ImGui::RadioButton("FirstPerson", &cameraControllerType, 1)) {
-          cameraController = std::make_unique<FirstPersonCameraController>(m_GLFWHandle.window(), cameraSpeed * maxDistance);
-          cameraController->setCamera(camera);
-        }
+    if (nextStages() != frameStages) {
+      buildFrameGraphs(nextStages());
+    }
+    (adaptiveStep && !solver.implicit ? adaptiveFrameGraph
+                                              : fixedFrameGraph)
+        .run(threadPool);
+
+    if (scene.telemetryEnabled()) {
+      const Cloth::Telemetry telemetry = scene.telemetry();
+      float sample[TELEMETRY_CHANNELS] = {telemetry.kineticEnergy,
+          telemetry.potentialEnergy, telemetry.maxSpeed};
+      for (uint32_t f = 0; f < SPRING_FAMILY_COUNT; ++f) {
+        sample[3 + f] = telemetry.maxStrain[f];
+        sample[3 + SPRING_FAMILY_COUNT + f] = telemetry.meanStrain[f];
       }
 
-      if (ImGui::CollapsingHeader("Light", ImGuiTreeNodeFlags_DefaultOpen)) {
-        static float theta = 0.0f;
-        static float phi = 0.0f;
-        static bool lightFromCamera = true;
-        ImGui::Checkbox("Light from camera", &lightFromCamera);
-        if (lightFromCamera) {
-          lightDirection = -camera.front();
-        } else {
-          if (ImGui::SliderFloat("Theta", &theta, 0.f, glm::pi<float>()) ||
-              ImGui::SliderFloat("Phi", &phi, 0, 2.f * glm::pi<float>())) {
-            lightDirection = glm::vec3(
-              glm::sin(theta) * glm::cos(phi),
-              glm::cos(theta),
-              glm::sin(theta) * glm::sin(phi)
-            );
-          }
-        }
-
-        static glm::vec3 lightColor(1.f, 1.f, 1.f);
-        static float lightIntensityFactor = 1.f;
-        if (ImGui::ColorEdit3("Light Color", (float *)&lightColor) ||
-            ImGui::SliderFloat("Ligth Intensity", &lightIntensityFactor, 0.f, 10.f)) {
-          lightIntensity = lightColor * lightIntensityFactor;
-        }
+      const size_t slot = telemetryFrame % TELEMETRY_FRAMES;
+      for (size_t c = 0; c < TELEMETRY_CHANNELS; ++c) {
+        telemetryHistory[c][slot] = sample[c];
       }
+      ++telemetryFrame;
 
-      if (ImGui::CollapsingHeader("Physics", ImGuiTreeNodeFlags_DefaultOpen)) {
-        static float g = gravity * 10.f;
-        static float k = rigidity / PHYSICS_SCALE;
-        static float z = viscosity / PHYSICS_SCALE;
-
-        if (ImGui::SliderFloat("Gravity", &g, 0.f, 10.f)) {
-          gravity = g / 10.f;
-        }
-
-        if (ImGui::SliderFloat("Rigidity", &k, 0.f, 1000.f)) {
-          rigidity = k * PHYSICS_SCALE;
+      if (telemetryCsv.is_open()) {
+        telemetryCsv << iterationCount << "," << seconds;
+        for (float value : sample) {
+          telemetryCsv << "," << value;
         }
+        telemetryCsv << "\n";
+      }
+    }
+    threadUtilization = threadPool.utilization();
+    threadPool.resetStats();
 
-        if (ImGui::SliderFloat("Viscosity", &z, 0.f, 1000.f)) {
-          viscosity = z * PHYSICS_SCALE;
+    {
+      Profiler::Scope scope(profiler, pollPhase);
+      glfwPollEvents(); // Poll for and process events
+
+      // A program is swapped between frames once linked, the previous one
+      // drawing until then and kept when the new one fails
+      for (const auto &path : shaderWatcher.takeChanged()) {
+        for (auto &draw : drawPrograms) {
+          if (std::find(draw.paths.begin(), draw.paths.end(), path) ==
+              draw.paths.end()) {
+            continue;
+          }
+          try {
+            draw.reload = std::make_unique<ProgramCache::Build>(
+                programCache.start(draw.paths));
+          } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            draw.reload.reset();
+          }
         }
-
-        if(ImGui::SliderFloat3("Wind Amplitude", &windAmplitude.x, 0.f, 5.f)) {
-          // VOID
+      }
+      for (auto &draw : drawPrograms) {
+        if (!draw.reload || !programCache.ready(*draw.reload)) {
+          continue;
         }
-
-        if(ImGui::SliderFloat3("Wind Frequency", &windFrequency.x, 0.f, 2.f * glm::pi<float>())) {
-          // VOID
+        try {
+          draw.program = programCache.finish(*draw.reload);
+          draw.locate();
+          std::clog << "Reloaded " << draw.paths.front() << "\n";
+        } catch (const std::runtime_error &) {
+          std::cerr << "Keeping the previous program" << std::endl;
         }
+        draw.reload.reset();
       }
-      ImGui::End();
     }
 
-    imguiRenderFrame();
-
-    glfwPollEvents(); // Poll for and process events
-
-    // For Physics rendering
-    simulateScene(glfwGetTime() - seconds);
-
     auto elapsedTime = glfwGetTime() - seconds;
     auto guiHasFocus =
         ImGui::GetIO().WantCaptureMouse || ImGui::GetIO().WantCaptureKeyboard;
@@ -520,16 +1060,96 @@ int ViewerApplication::run()
       cameraController->update(float(elapsedTime));
     }
 
-    m_GLFWHandle.swapBuffers(); // Swap front and back buffers
-  
-    // Regulate FPS
-    if (elapsedTime < FRAMERATE_MILLISECONDS) {
-      std::this_thread::sleep_for(std::chrono::duration<float, std::milli>(FRAMERATE_MILLISECONDS - elapsedTime * 1000.f));
+    {
+      Profiler::Scope scope(profiler, pickPhase);
+      const Camera &camera = cameraController->getCamera();
+      double cursorX, cursorY;
+      glfwGetCursorPos(m_GLFWHandle.window(), &cursorX, &cursorY);
+      const glm::vec2 ndc(2.f * float(cursorX) / m_nWindowWidth - 1.f,
+          1.f - 2.f * float(cursorY) / m_nWindowHeight);
+      glm::vec3 origin, direction;
+      camera.ray(projMatrix, ndc, origin, direction);
+      const bool pressed = glfwGetMouseButton(m_GLFWHandle.window(),
+                               GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+
+      if (grab.active && (!pressed || !picking)) {
+        Cloth &cloth = scene.instances()[grab.instance].cloth;
+        const glm::uvec2 cell = cloth.layout().cell(grab.particle);
+        // Thrown at its last speed, or stopped where it was left
+        cloth.setPinned(cell.x, cell.y, grab.wasPinned);
+        grab.active = false;
+      } else if (!grab.active && pressed && !grab.pressed && picking &&
+                 !ImGui::GetIO().WantCaptureMouse) {
+        // Closest cloth under the cursor, each in its own space: the
+        // transforms are rigid and keep the distances
+        ClothBvh::Hit best{std::numeric_limits<float>::max(), 0, 0};
+        for (size_t n = 0; n < bvhs.size(); ++n) {
+          const glm::mat4 &transform = scene.instances()[n].transform;
+          const glm::mat3 toLocal = glm::transpose(glm::mat3(transform));
+          ClothBvh::Hit hit;
+          if (bvhs[n].intersect(scene.instances()[n].cloth,
+                  toLocal * (origin - glm::vec3(transform[3])),
+                  toLocal * direction, best.distance, hit)) {
+            best = hit;
+            grab.instance = n;
+            grab.active = true;
+          }
+        }
+        if (grab.active) {
+          Cloth &cloth = scene.instances()[grab.instance].cloth;
+          const glm::uvec2 cell = cloth.layout().cell(best.particle);
+          grab.particle = best.particle;
+          grab.wasPinned = cloth.isPinned(best.particle);
+          grab.depth =
+              glm::dot(origin + best.distance * direction - camera.eye(),
+                  camera.front());
+          cloth.setPinned(cell.x, cell.y, true);
+        }
+      }
+
+      grab.pressed = pressed;
+
+      // The held particle follows the cursor at the depth it was grabbed
+      if (grab.active) {
+        const glm::mat4 &transform = scene.instances()[grab.instance].transform;
+        const glm::vec3 front = camera.front();
+        const float distance =
+            (grab.depth - glm::dot(origin - camera.eye(), front)) /
+            glm::dot(direction, front);
+        const glm::vec3 world = origin + distance * direction;
+        grab.target = glm::transpose(glm::mat3(transform)) *
+                      (world - glm::vec3(transform[3]));
+      }
+    }
+
+    {
+      Profiler::Scope scope(profiler, swapPhase);
+      m_GLFWHandle.swapBuffers(); // Swap front and back buffers
+    }
+    {
+      Profiler::Scope scope(profiler, pacePhase);
+      pacer.endFrame();
+    }
+    gpuTimers.collect();
+    profiler.endFrame();
+
+    if (saveTrace) {
+      const fs::path path = m_AppName + "-trace.json";
+      try {
+        profiler.writeTrace(path);
+        std::cout << "Last " << TRACE_SECONDS << " s of frames written to "
+                  << path << std::endl;
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+      }
+      saveTrace = false;
     }
-  
   }
 
   // TODO clean up allocated GL data
+  glDeleteBuffers(1, &indirectBuffer);
+  glDeleteBuffers(1, &instanceSsbo);
+  glDeleteBuffers(1, &instanceVbo);
   glDeleteBuffers(1, &ibo);
   glDeleteBuffers(1, &vbo);
   glDeleteVertexArrays(1, &vao);
@@ -538,13 +1158,12 @@ int ViewerApplication::run()
 }
 
 ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
-    uint32_t height, uint32_t fWidth, uint32_t fHeight,
+    uint32_t height, const SimulationOptions &simulation,
     const std::vector<float> &lookatArgs, const std::string &vertexShader,
     const std::string &fragmentShader) :
     m_nWindowWidth(width),
     m_nWindowHeight(height),
-    m_nClothWidth(fWidth),
-    m_nClothHeight(fHeight),
+    m_simulation(simulation),
     m_AppPath{appPath},
     m_AppName{m_AppPath.stem().string()},
     m_ImGuiIniFilename{m_AppName + ".imgui.ini"},
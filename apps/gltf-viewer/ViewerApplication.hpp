@@ -1,14 +1,36 @@
 #pragma once
 
+#include "Cloth.hpp"
 #include "utils/GLFWHandle.hpp"
 #include "utils/cameras.hpp"
 #include "utils/filesystem.hpp"
 #include "utils/shaders.hpp"
 
+// Cloth simulation and frame pacing settings chosen on the command line
+struct SimulationOptions
+{
+  uint32_t clothWidth = 50;
+  uint32_t clothHeight = 50;
+  uint32_t instanceCount = 1;
+  ParticleOrdering ordering = ParticleOrdering::ColumnMajor;
+  SpringModel springModel = SpringModel::RestOffset;
+  ClothPrecision precision = ClothPrecision::Float;
+  uint32_t threadCount = 0; // including the main thread, 0 for hardware
+  fs::path colliderPath; // glTF model the cloths collide with, if any
+  uint32_t sdfResolution = 0; // distance grid of the model, 0 for its BVH
+  fs::path telemetryPath; // CSV receiving the telemetry of every frame
+  float frameRate = 60.f; // 0 for uncapped
+  bool vsync = false;
+  // Edges of the PN triangles on screen, 0 draws the simulated mesh as is
+  float tessellationPixels = 0.f;
+  fs::path shaderCachePath; // program binaries, empty to always compile
+};
+
 class ViewerApplication
 {
 public:
-  ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height, uint32_t fWidth, uint32_t fHeight,
+  ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height,
+      const SimulationOptions &simulation,
       const std::vector<float> &lookatArgs,
       const std::string &vertexShader, const std::string &fragmentShader);
 
@@ -25,8 +47,7 @@ private:
   GLsizei m_nWindowWidth = 1280;
   GLsizei m_nWindowHeight = 720;
 
-  GLsizei m_nClothWidth = 50;
-  GLsizei m_nClothHeight = 50;
+  SimulationOptions m_simulation;
 
   const fs::path m_AppPath;
   const std::string m_AppName;
@@ -1,3 +1,4 @@
+#include "Benchmarks.hpp"
 #include "ViewerApplication.hpp"
 #include "utils/GLFWHandle.hpp"
 #include "utils/filesystem.hpp"
@@ -7,6 +8,10 @@
 std::vector<std::string> split(
     const std::string &str, const std::string &delim);
 
+ParticleOrdering parseOrdering(args::ValueFlag<std::string> &flag);
+SpringModel parseSprings(args::ValueFlag<std::string> &flag);
+ClothPrecision parsePrecision(args::ValueFlag<std::string> &flag);
+
 int main(int argc, char **argv)
 {
   auto returnCode = 0;
@@ -29,6 +34,44 @@ int main(int argc, char **argv)
         args::ValueFlag<int32_t> flagHeight{parser, "fHeight",
             "Height of cloth",
             {"fh", "fHeight"}};
+        args::ValueFlag<std::string> ordering{parser, "ordering",
+            "Particle storage order: column, morton or tiled",
+            {"ordering"}};
+        args::ValueFlag<std::string> springs{parser, "springs",
+            "Spring model: offset (rest vector) or length (rest length)",
+            {"springs"}};
+        args::ValueFlag<std::string> precision{parser, "precision",
+            "Precision of the spring and integration passes: float, mixed "
+            "(double positions, float forces) or double",
+            {"precision"}};
+        args::ValueFlag<uint32_t> instances{parser, "instances",
+            "Number of cloths in the scene", {"instances"}};
+        args::ValueFlag<uint32_t> threads{parser, "threads",
+            "Simulation threads including the main one, 0 for one per core",
+            {"threads"}};
+        args::ValueFlag<std::string> collider{parser, "collider",
+            "glTF model (.gltf or .glb) placed under the first cloth as an "
+            "obstacle",
+            {"collider"}};
+        args::ValueFlag<uint32_t> sdf{parser, "sdf",
+            "Bake the collider in a distance grid of that many cells along "
+            "its longest side, 0 to query its BVH",
+            {"sdf"}};
+        args::ValueFlag<std::string> telemetry{parser, "telemetry",
+            "Stream the energies and strains of every frame to a CSV file",
+            {"telemetry"}};
+        args::ValueFlag<float> fps{parser, "fps",
+            "Target frame rate, 0 for uncapped (default 60)", {"fps"}};
+        args::Flag vsync{
+            parser, "vsync", "Wait for the vertical blank", {"vsync"}};
+        args::ValueFlag<float> tessellate{parser, "pixels",
+            "Refine the cloths on the GPU into PN triangles with edges of "
+            "that many pixels",
+            {"tessellate"}};
+        args::Flag noShaderCache{parser, "no-shader-cache",
+            "Compile the shaders at every launch instead of keeping their "
+            "binaries next to the executable",
+            {"no-shader-cache"}};
         args::ValueFlag<std::string> lookat{parser, "lookat",
             "Look at parameters for the Camera with format "
             "eye_x,eye_y,eye_z,center_x,center_y,center_z,up_x,up_y,up_z",
@@ -62,13 +105,302 @@ int main(int argc, char **argv)
         uint32_t width = imageWidth ? args::get(imageWidth) : 1280;
         uint32_t height = imageHeight ? args::get(imageHeight) : 720;
 
-        uint32_t fWidth = flagWidth ? args::get(flagWidth) : 50;
-        uint32_t fHeight = flagHeight ? args::get(flagHeight) : fWidth;
+        SimulationOptions simulation;
+        simulation.clothWidth = flagWidth ? args::get(flagWidth) : 50;
+        simulation.clothHeight =
+            flagHeight ? args::get(flagHeight) : simulation.clothWidth;
+        simulation.instanceCount = instances ? args::get(instances) : 1;
+        simulation.ordering = parseOrdering(ordering);
+        simulation.springModel = parseSprings(springs);
+        simulation.precision = parsePrecision(precision);
+        simulation.threadCount = threads ? args::get(threads) : 0;
+        simulation.colliderPath = collider ? args::get(collider) : "";
+        simulation.sdfResolution = sdf ? args::get(sdf) : 0;
+        simulation.telemetryPath = telemetry ? args::get(telemetry) : "";
+        simulation.frameRate = fps ? args::get(fps) : 60.f;
+        simulation.vsync = vsync;
+        simulation.tessellationPixels =
+            tessellate ? args::get(tessellate) : 0.f;
+        if (!noShaderCache) {
+          simulation.shaderCachePath =
+              fs::path{argv[0]}.parent_path() / "shader-cache";
+        }
+        if (simulation.frameRate < 0.f) {
+          throw args::ValidationError("--fps must be positive or 0");
+        }
+        if (tessellate && simulation.tessellationPixels <= 0.f) {
+          throw args::ValidationError("--tessellate must be positive");
+        }
+        if (simulation.instanceCount == 0) {
+          throw args::ValidationError("--instances must be at least 1");
+        }
+        if (collider && !fs::exists(simulation.colliderPath)) {
+          throw args::ValidationError(
+              "--collider: no such file " + args::get(collider));
+        }
 
-        ViewerApplication app{fs::path{argv[0]}, width, height, fWidth, fHeight,
+        ViewerApplication app{fs::path{argv[0]}, width, height, simulation,
             lookatParams, args::get(vertexShader), args::get(fragmentShader)};
         returnCode = app.run();
       }};
+  args::Command bench{commands, "bench",
+      "Benchmark the particle orderings without opening a window",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> sizes{parser, "sizes",
+            "Comma separated cloth sizes with format widthxheight",
+            {"sizes"}};
+        args::ValueFlag<uint32_t> steps{
+            parser, "steps", "Number of measured steps per run", {"steps"}};
+        args::ValueFlag<std::string> springs{parser, "springs",
+            "Spring model: offset (rest vector) or length (rest length)",
+            {"springs"}};
+        parser.Parse();
+
+        std::vector<glm::uvec2> clothSizes;
+        const auto tokens = split(sizes ? args::get(sizes)
+                                        : "128x128,512x512,1024x1024,64x16384",
+            ",");
+        for (const auto &token : tokens) {
+          const auto dims = split(token, "x");
+          if (dims.size() != 2) {
+            throw args::ValidationError(
+                "Unable to parse --sizes entry " + token);
+          }
+          clothSizes.emplace_back(std::stoul(dims[0]), std::stoul(dims[1]));
+        }
+
+        returnCode = runOrderingBenchmark(
+            clothSizes, steps ? args::get(steps) : 100, parseSprings(springs));
+      }};
+
+  args::Command windBench{commands, "wind",
+      "Measure the cost of a turbulence lookup per particle",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> sides{parser, "sides",
+            "Comma separated sides of the square cloths", {"sides"}};
+        args::ValueFlag<uint32_t> passes{parser, "passes",
+            "Number of measured passes over the particles", {"passes"}};
+        parser.Parse();
+
+        std::vector<uint32_t> clothSides;
+        for (const auto &token :
+            split(sides ? args::get(sides) : "64,256,1024", ",")) {
+          clothSides.push_back(std::stoul(token));
+          if (clothSides.back() < 3) {
+            throw args::ValidationError("--sides must be at least 3");
+          }
+        }
+        returnCode =
+            runWindBenchmark(clothSides, passes ? args::get(passes) : 50);
+      }};
+  args::Command precision{commands, "precision",
+      "Compare the throughput and drift of the cloth precisions",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> sides{parser, "sides",
+            "Comma separated sides of the square cloths", {"sides"}};
+        args::ValueFlag<uint32_t> steps{
+            parser, "steps", "Number of measured steps per run", {"steps"}};
+        args::ValueFlag<std::string> springs{parser, "springs",
+            "Spring model: offset (rest vector) or length (rest length, "
+            "the default)",
+            {"springs"}};
+        args::ValueFlag<double> offset{parser, "offset",
+            "Distance of the cloths from the origin along every axis",
+            {"offset"}};
+        parser.Parse();
+
+        std::vector<uint32_t> clothSides;
+        for (const auto &token :
+            split(sides ? args::get(sides) : "64,256,1024", ",")) {
+          clothSides.push_back(std::stoul(token));
+          if (clothSides.back() < 3) {
+            throw args::ValidationError("--sides must be at least 3");
+          }
+        }
+        returnCode = runPrecisionBenchmark(clothSides,
+            steps ? args::get(steps) : 1000,
+            springs ? parseSprings(springs) : SpringModel::RestLength,
+            offset ? args::get(offset) : 0.);
+      }};
+  args::Command picking{commands, "picking",
+      "Measure the refit and the ray casts of the picking hierarchy",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> sides{parser, "sides",
+            "Comma separated sides of the square cloths", {"sides"}};
+        args::ValueFlag<uint32_t> rays{
+            parser, "rays", "Number of rays cast per cloth", {"rays"}};
+        args::ValueFlag<uint32_t> threads{parser, "threads",
+            "Threads including the main one, 0 for one per core",
+            {"threads"}};
+        parser.Parse();
+
+        std::vector<uint32_t> clothSides;
+        for (const auto &token :
+            split(sides ? args::get(sides) : "64,256,1024", ",")) {
+          clothSides.push_back(std::stoul(token));
+          if (clothSides.back() < 3) {
+            throw args::ValidationError("--sides must be at least 3");
+          }
+        }
+        returnCode = runPickingBenchmark(clothSides,
+            rays ? args::get(rays) : 1000, threads ? args::get(threads) : 0);
+      }};
+  args::Command sweep{commands, "sweep",
+      "Simulate every combination of parameters concurrently and write "
+      "measures of each run to CSV",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> masses{parser, "mass",
+            "Comma separated particle masses (default 1)", {"mass"}};
+        args::ValueFlag<std::string> rigidities{parser, "rigidity",
+            "Comma separated spring rigidities, as the slider (default 965)",
+            {"rigidity"}};
+        args::ValueFlag<std::string> viscosities{parser, "viscosity",
+            "Comma separated spring viscosities, as the slider (default 240)",
+            {"viscosity"}};
+        args::ValueFlag<std::string> gravities{parser, "gravity",
+            "Comma separated gravities, as the slider (default 5)",
+            {"gravity"}};
+        args::ValueFlag<std::string> winds{parser, "wind",
+            "Comma separated wind amplitudes along z (default 2.25)",
+            {"wind"}};
+        args::ValueFlag<std::string> precision{parser, "precision",
+            "Precision of the spring and integration passes: float, mixed "
+            "(double positions, float forces) or double",
+            {"precision"}};
+        args::ValueFlag<float> maxStrain{parser, "strain",
+            "Strain past which a run counts as diverged (default 1)",
+            {"max-strain"}};
+        args::ValueFlag<uint32_t> side{
+            parser, "side", "Side of the square cloth (default 64)", {"side"}};
+        args::ValueFlag<uint32_t> steps{
+            parser, "steps", "Steps per run (default 600)", {"steps"}};
+        args::ValueFlag<std::string> output{parser, "output",
+            "CSV file of the runs, the standard output if omitted",
+            {"output"}};
+        args::ValueFlag<uint32_t> threads{parser, "threads",
+            "Threads including the main one, 0 for one per core",
+            {"threads"}};
+        parser.Parse();
+
+        const auto values = [](args::ValueFlag<std::string> &flag,
+                                const std::string &fallback) {
+          std::vector<float> list;
+          for (const auto &token :
+              split(flag ? args::get(flag) : fallback, ",")) {
+            try {
+              list.push_back(std::stof(token));
+            } catch (const std::logic_error &) {
+              throw args::ValidationError(
+                  "Unable to parse --" + flag.Name() + " entry " + token);
+            }
+          }
+          if (list.empty()) {
+            throw args::ValidationError("--" + flag.Name() + " is empty");
+          }
+          return list;
+        };
+
+        SweepGrid grid;
+        grid.masses = values(masses, "1");
+        grid.rigidities = values(rigidities, "965");
+        grid.viscosities = values(viscosities, "240");
+        grid.gravities = values(gravities, "5");
+        grid.winds = values(winds, "2.25");
+        for (const float mass : grid.masses) {
+          if (mass <= 0.f) {
+            throw args::ValidationError("--mass must be positive");
+          }
+        }
+        grid.precision = parsePrecision(precision);
+        if (maxStrain) {
+          grid.maxStrain = args::get(maxStrain);
+          if (!(grid.maxStrain > 0.f)) {
+            throw args::ValidationError("--max-strain must be positive");
+          }
+        }
+        const uint32_t clothSide = side ? args::get(side) : 64;
+        if (clothSide < 3) {
+          throw args::ValidationError("--side must be at least 3");
+        }
+        returnCode = runSweep(grid, clothSide, steps ? args::get(steps) : 600,
+            output ? args::get(output) : "", threads ? args::get(threads) : 0);
+      }};
+  args::Command verify{commands, "verify",
+      "Check the cloth steps against the original PPoint and PLink one on "
+      "random cloths",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<uint32_t> cases{parser, "cases",
+            "Random cloths and parameters to check (default 20)", {"cases"}};
+        args::ValueFlag<uint32_t> steps{
+            parser, "steps", "Steps per cloth (default 200)", {"steps"}};
+        args::ValueFlag<uint32_t> maxSide{parser, "max-side",
+            "Largest side of the cloths (default 96)", {"max-side"}};
+        args::ValueFlag<uint32_t> seed{
+            parser, "seed", "Seed of the random cases (default 1)", {"seed"}};
+        args::ValueFlag<uint32_t> ulps{parser, "ulps",
+            "Floats a coordinate may be off by, at its magnitude or the "
+            "spacing if larger (default 1024)",
+            {"ulps"}};
+        args::ValueFlag<float> epsilon{parser, "epsilon",
+            "And distance it may be off by, in spacings (default 2e-3)",
+            {"epsilon"}};
+        args::ValueFlag<std::string> output{parser, "output",
+            "CSV file of the divergence at every step", {"output"}};
+        args::ValueFlag<uint32_t> threads{parser, "threads",
+            "Threads of the threaded backend including the main one, at "
+            "least 2, 0 for one per core",
+            {"threads"}};
+        parser.Parse();
+
+        VerifySettings settings;
+        settings.cases = cases ? args::get(cases) : settings.cases;
+        settings.steps = steps ? args::get(steps) : settings.steps;
+        settings.maxSide = maxSide ? args::get(maxSide) : settings.maxSide;
+        settings.seed = seed ? args::get(seed) : settings.seed;
+        settings.ulps = ulps ? args::get(ulps) : settings.ulps;
+        settings.epsilon = epsilon ? args::get(epsilon) : settings.epsilon;
+        settings.threadCount =
+            threads ? args::get(threads) : settings.threadCount;
+        if (settings.maxSide < 3) {
+          throw args::ValidationError("--max-side must be at least 3");
+        }
+        returnCode =
+            runVerification(settings, output ? args::get(output) : "");
+      }};
+  args::Command multigrid{commands, "multigrid",
+      "Compare the solvers of implicit steps on growing cloths",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> sides{parser, "sides",
+            "Comma separated sides of the square cloths", {"sides"}};
+        args::ValueFlag<float> rigidity{parser, "rigidity",
+            "Rigidity of every spring, per step (default 100)",
+            {"rigidity"}};
+        args::ValueFlag<float> tolerance{parser, "tolerance",
+            "Relative residual to reach (default 1e-4)", {"tolerance"}};
+        args::ValueFlag<uint32_t> iterations{parser, "iterations",
+            "Most sweeps, cycles or CG iterations (default 50)",
+            {"iterations"}};
+        args::ValueFlag<uint32_t> threads{parser, "threads",
+            "Threads including the main one, 0 for one per core",
+            {"threads"}};
+        parser.Parse();
+
+        std::vector<uint32_t> clothSides;
+        for (const auto &token :
+            split(sides ? args::get(sides) : "128,256,512,1024,2048", ",")) {
+          clothSides.push_back(std::stoul(token));
+          if (clothSides.back() < 3) {
+            throw args::ValidationError("--sides must be at least 3");
+          }
+        }
+
+        SolverSettings settings;
+        settings.tolerance = tolerance ? args::get(tolerance) : 1e-4f;
+        settings.maxIterations = iterations ? args::get(iterations) : 50;
+        returnCode = runMultigridBenchmark(clothSides,
+            rigidity ? args::get(rigidity) : 100.f, settings,
+            threads ? args::get(threads) : 0);
+      }};
 
   try {
     parser.ParseCLI(argc, argv);
@@ -109,4 +441,40 @@ std::vector<std::string> split(const std::string &str, const std::string &delim)
     prev = pos + delim.length();
   } while (pos < str.length() && prev < str.length());
   return tokens;
+}
+
+ParticleOrdering parseOrdering(args::ValueFlag<std::string> &flag)
+{
+  if (!flag) {
+    return ParticleOrdering::ColumnMajor;
+  }
+  try {
+    return parseParticleOrdering(args::get(flag));
+  } catch (const std::invalid_argument &e) {
+    throw args::ValidationError(e.what());
+  }
+}
+
+SpringModel parseSprings(args::ValueFlag<std::string> &flag)
+{
+  if (!flag) {
+    return SpringModel::RestOffset;
+  }
+  try {
+    return parseSpringModel(args::get(flag));
+  } catch (const std::invalid_argument &e) {
+    throw args::ValidationError(e.what());
+  }
+}
+
+ClothPrecision parsePrecision(args::ValueFlag<std::string> &flag)
+{
+  if (!flag) {
+    return ClothPrecision::Float;
+  }
+  try {
+    return parseClothPrecision(args::get(flag));
+  } catch (const std::invalid_argument &e) {
+    throw args::ValidationError(e.what());
+  }
 }
\ No newline at end of file
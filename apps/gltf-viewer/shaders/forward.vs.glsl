@@ -1,21 +1,29 @@
-#version 330
+#version 430
 
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
+layout(location = 3) in uint aInstance;
 
 out vec3 vViewSpacePosition;
 out vec3 vViewSpaceNormal;
 out vec2 vTexCoords;
 
-uniform mat4 uModelViewProjMatrix;
-uniform mat4 uModelViewMatrix;
-uniform mat4 uNormalMatrix;
+uniform mat4 uViewMatrix;
+uniform mat4 uProjMatrix;
+
+// One model matrix per cloth, made of rotations and translations only
+layout(std430, binding = 0) readonly buffer InstanceMatrices
+{
+    mat4 uModelMatrices[];
+};
 
 void main()
 {
-    vViewSpacePosition = vec3(uModelViewMatrix * vec4(aPosition, 1));
-	vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
+    mat4 modelViewMatrix = uViewMatrix * uModelMatrices[aInstance];
+    vViewSpacePosition = vec3(modelViewMatrix * vec4(aPosition, 1));
+	// Rigid transform: the normal matrix is the model view matrix itself
+	vViewSpaceNormal = normalize(vec3(modelViewMatrix * vec4(aNormal, 0)));
 	vTexCoords = aTexCoords;
-    gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
+    gl_Position =  uProjMatrix * vec4(vViewSpacePosition, 1);
 }
\ No newline at end of file
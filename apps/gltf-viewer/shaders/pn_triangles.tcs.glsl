@@ -0,0 +1,79 @@
+#version 430
+
+// PN triangles (Vlachos et al. 2001): every triangle of the simulated mesh
+// becomes a cubic Bezier patch through its corners and tangent to their
+// normals, shaded with a quadratic normal.
+layout(vertices = 3) out;
+
+in vec3 vcPosition[];
+in vec3 vcNormal[];
+in vec2 vcTexCoords[];
+
+out vec3 tcPosition[];
+out vec3 tcNormal[];
+out vec2 tcTexCoords[];
+
+// Control points between the corners, named after their barycentric weights
+patch out vec3 tcB210, tcB120, tcB021, tcB012, tcB102, tcB201, tcB111;
+// Normals at the middle of the edges
+patch out vec3 tcN110, tcN011, tcN101;
+
+uniform mat4 uProjMatrix;
+uniform vec2 uViewportSize;
+uniform float uPixelsPerSegment;
+
+// Segments of an edge so that each spans about uPixelsPerSegment on screen.
+// It only depends on the edge, so neighbour patches split it the same way.
+float edgeLevel(vec3 a, vec3 b)
+{
+    float depth = max(-0.5 * (a.z + b.z), 1e-3);
+    float pixels =
+        distance(a, b) * uProjMatrix[1][1] * 0.5 * uViewportSize.y / depth;
+    return clamp(pixels / uPixelsPerSegment, 1.0, float(gl_MaxTessGenLevel));
+}
+
+// Corner i projected on the tangent plane of corner j
+vec3 edgePoint(int i, int j)
+{
+    vec3 pi = vcPosition[i];
+    vec3 pj = vcPosition[j];
+    vec3 ni = vcNormal[i];
+    return (2.0 * pi + pj - dot(pj - pi, ni) * ni) / 3.0;
+}
+
+vec3 edgeNormal(int i, int j)
+{
+    vec3 d = vcPosition[j] - vcPosition[i];
+    vec3 n = vcNormal[i] + vcNormal[j];
+    return normalize(n - 2.0 * dot(d, n) / dot(d, d) * d);
+}
+
+void main()
+{
+    tcPosition[gl_InvocationID] = vcPosition[gl_InvocationID];
+    tcNormal[gl_InvocationID] = vcNormal[gl_InvocationID];
+    tcTexCoords[gl_InvocationID] = vcTexCoords[gl_InvocationID];
+
+    if (gl_InvocationID == 0) {
+        tcB210 = edgePoint(0, 1);
+        tcB120 = edgePoint(1, 0);
+        tcB021 = edgePoint(1, 2);
+        tcB012 = edgePoint(2, 1);
+        tcB102 = edgePoint(2, 0);
+        tcB201 = edgePoint(0, 2);
+        vec3 e = (tcB210 + tcB120 + tcB021 + tcB012 + tcB102 + tcB201) / 6.0;
+        vec3 v = (vcPosition[0] + vcPosition[1] + vcPosition[2]) / 3.0;
+        tcB111 = e + (e - v) / 2.0;
+
+        tcN110 = edgeNormal(0, 1);
+        tcN011 = edgeNormal(1, 2);
+        tcN101 = edgeNormal(2, 0);
+
+        // Outer level i is the edge opposite to corner i
+        gl_TessLevelOuter[0] = edgeLevel(vcPosition[1], vcPosition[2]);
+        gl_TessLevelOuter[1] = edgeLevel(vcPosition[2], vcPosition[0]);
+        gl_TessLevelOuter[2] = edgeLevel(vcPosition[0], vcPosition[1]);
+        gl_TessLevelInner[0] = max(gl_TessLevelOuter[0],
+            max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
+    }
+}
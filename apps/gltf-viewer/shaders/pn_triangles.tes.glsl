@@ -0,0 +1,34 @@
+#version 430
+
+layout(triangles, fractional_odd_spacing, ccw) in;
+
+in vec3 tcPosition[];
+in vec3 tcNormal[];
+in vec2 tcTexCoords[];
+
+patch in vec3 tcB210, tcB120, tcB021, tcB012, tcB102, tcB201, tcB111;
+patch in vec3 tcN110, tcN011, tcN101;
+
+out vec3 vViewSpacePosition;
+out vec3 vViewSpaceNormal;
+out vec2 vTexCoords;
+
+uniform mat4 uProjMatrix;
+
+void main()
+{
+    float u = gl_TessCoord.x;
+    float v = gl_TessCoord.y;
+    float w = gl_TessCoord.z;
+
+    vViewSpacePosition = tcPosition[0] * u * u * u +
+        tcPosition[1] * v * v * v + tcPosition[2] * w * w * w +
+        3.0 * (tcB210 * u * u * v + tcB120 * u * v * v + tcB021 * v * v * w +
+            tcB012 * v * w * w + tcB102 * w * w * u + tcB201 * w * u * u) +
+        6.0 * tcB111 * u * v * w;
+    vViewSpaceNormal = normalize(tcNormal[0] * u * u + tcNormal[1] * v * v +
+        tcNormal[2] * w * w + tcN110 * u * v + tcN011 * v * w +
+        tcN101 * w * u);
+    vTexCoords = tcTexCoords[0] * u + tcTexCoords[1] * v + tcTexCoords[2] * w;
+    gl_Position = uProjMatrix * vec4(vViewSpacePosition, 1);
+}
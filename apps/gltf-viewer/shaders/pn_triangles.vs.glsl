@@ -0,0 +1,27 @@
+#version 430
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+layout(location = 3) in uint aInstance;
+
+// View space corners of the patches, projected after tessellation
+out vec3 vcPosition;
+out vec3 vcNormal;
+out vec2 vcTexCoords;
+
+uniform mat4 uViewMatrix;
+
+// One model matrix per cloth, made of rotations and translations only
+layout(std430, binding = 0) readonly buffer InstanceMatrices
+{
+    mat4 uModelMatrices[];
+};
+
+void main()
+{
+    mat4 modelViewMatrix = uViewMatrix * uModelMatrices[aInstance];
+    vcPosition = vec3(modelViewMatrix * vec4(aPosition, 1));
+    vcNormal = normalize(vec3(modelViewMatrix * vec4(aNormal, 0)));
+    vcTexCoords = aTexCoords;
+}
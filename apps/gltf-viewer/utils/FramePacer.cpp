@@ -0,0 +1,73 @@
+#include "FramePacer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+FramePacer::FramePacer(float targetRate, float spinMilliseconds) :
+    m_targetRate(targetRate),
+    m_spinMilliseconds(spinMilliseconds),
+    m_frameStart(Clock::now()),
+    m_deadline(m_frameStart),
+    m_histogram(BUCKET_COUNT, 0)
+{
+}
+
+void FramePacer::setTargetRate(float rate)
+{
+  m_targetRate = rate;
+  m_deadline = m_frameStart;
+}
+
+void FramePacer::endFrame()
+{
+  if (m_targetRate > 0.f) {
+    using Duration = std::chrono::duration<float>;
+    m_deadline += std::chrono::duration_cast<Clock::duration>(
+        Duration(1.f / m_targetRate));
+
+    auto now = Clock::now();
+    if (m_deadline < now) {
+      m_deadline = now;
+    } else {
+      const auto spin = std::chrono::duration_cast<Clock::duration>(
+          Duration(1e-3f * m_spinMilliseconds));
+      if (m_deadline - now > spin) {
+        std::this_thread::sleep_for(m_deadline - now - spin);
+      }
+      while (Clock::now() < m_deadline) {
+      }
+    }
+  }
+
+  const auto now = Clock::now();
+  const float milliseconds =
+      std::chrono::duration<float, std::milli>(now - m_frameStart).count();
+  const auto bucket = std::min<size_t>(
+      size_t(milliseconds / BUCKET_MILLISECONDS), BUCKET_COUNT - 1);
+  ++m_histogram[bucket];
+  ++m_frameCount;
+
+  m_frameStart = now;
+  if (m_targetRate <= 0.f) {
+    m_deadline = now;
+  }
+}
+
+float FramePacer::percentile(float fraction) const
+{
+  const uint64_t rank = uint64_t(fraction * m_frameCount);
+  uint64_t count = 0;
+  for (uint32_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+    count += m_histogram[bucket];
+    if (count > rank) {
+      return (bucket + 1) * BUCKET_MILLISECONDS;
+    }
+  }
+  return BUCKET_COUNT * BUCKET_MILLISECONDS;
+}
+
+void FramePacer::resetHistogram()
+{
+  std::fill(m_histogram.begin(), m_histogram.end(), 0);
+  m_frameCount = 0;
+}
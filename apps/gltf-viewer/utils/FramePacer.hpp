@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Holds the main loop to a target frame rate. The wait sleeps while the
+// deadline is far, then spins through the last stretch that the scheduler
+// would overshoot. Deadlines advance by whole periods, a late frame restarts
+// them from its end instead of rushing the next ones. Frame times, from one
+// endFrame() to the next, are counted in a histogram.
+class FramePacer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr float BUCKET_MILLISECONDS = 0.1f;
+  static const uint32_t BUCKET_COUNT = 1000; // the last one counts the rest
+
+  // 0 leaves the loop uncapped
+  explicit FramePacer(float targetRate = 60.f, float spinMilliseconds = 2.f);
+
+  void setTargetRate(float rate);
+  inline float targetRate() const { return m_targetRate; }
+  inline void setSpinMilliseconds(float milliseconds)
+  {
+    m_spinMilliseconds = milliseconds;
+  }
+  inline float spinMilliseconds() const { return m_spinMilliseconds; }
+
+  // Wait for the deadline of the frame, then start the next one
+  void endFrame();
+
+  // Frame time below which a fraction of the frames fall, in milliseconds
+  float percentile(float fraction) const;
+  inline uint64_t frameCount() const { return m_frameCount; }
+  inline const std::vector<uint32_t> &histogram() const { return m_histogram; }
+  void resetHistogram();
+
+private:
+  float m_targetRate;
+  float m_spinMilliseconds;
+  Clock::time_point m_frameStart, m_deadline;
+
+  std::vector<uint32_t> m_histogram;
+  uint64_t m_frameCount = 0;
+};
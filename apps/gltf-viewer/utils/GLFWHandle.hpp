@@ -44,7 +44,7 @@ public:
 
     glfwMakeContextCurrent(m_pWindow);
 
-    glfwSwapInterval(0); // No VSync
+    glfwSwapInterval(0); // No VSync, see setVSync()
 
     if (!gladLoadGL()) {
       std::cerr << "Unable to init OpenGL.\n";
@@ -85,6 +85,8 @@ public:
 
   void swapBuffers() const { glfwSwapBuffers(m_pWindow); }
 
+  void setVSync(bool enabled) { glfwSwapInterval(enabled ? 1 : 0); }
+
   GLFWwindow *window() { return m_pWindow; }
 
 private:
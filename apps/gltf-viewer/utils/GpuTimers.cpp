@@ -0,0 +1,62 @@
+#include "GpuTimers.hpp"
+
+GpuTimers::GpuTimers(Profiler &profiler, uint32_t capacity) :
+    m_profiler(profiler),
+    m_queries(capacity)
+{
+  std::vector<GLuint> ids(capacity);
+  glGenQueries(GLsizei(capacity), ids.data());
+  for (uint32_t q = 0; q < capacity; ++q) {
+    m_queries[q] = {ids[q], Profiler::NO_PHASE, 0, 0, false};
+  }
+}
+
+GpuTimers::~GpuTimers()
+{
+  for (const auto &query : m_queries) {
+    glDeleteQueries(1, &query.id);
+  }
+}
+
+void GpuTimers::begin(Profiler::PhaseId phase)
+{
+  for (uint32_t q = 0; q < m_queries.size(); ++q) {
+    Query &query = m_queries[q];
+    if (!query.pending) {
+      query.phase = phase;
+      query.frame = m_profiler.frame();
+      query.begin = m_profiler.now();
+      query.pending = true;
+      glBeginQuery(GL_TIME_ELAPSED, query.id);
+      m_active = int32_t(q);
+      return;
+    }
+  }
+}
+
+void GpuTimers::end()
+{
+  if (m_active >= 0) {
+    glEndQuery(GL_TIME_ELAPSED);
+    m_active = -1;
+  }
+}
+
+void GpuTimers::collect()
+{
+  for (int32_t q = 0; q < int32_t(m_queries.size()); ++q) {
+    Query &query = m_queries[q];
+    if (!query.pending || q == m_active) {
+      continue;
+    }
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &nanoseconds);
+      m_profiler.recordGpu(
+          query.phase, query.frame, query.begin, int64_t(nanoseconds));
+      query.pending = false;
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Profiler.hpp"
+
+// GL_TIME_ELAPSED queries around profiler phases. Queries are recycled from a
+// fixed pool and only read back once the GPU made them available, so timing
+// never waits for the GPU; a phase goes untimed when it runs too far ahead.
+// Time elapsed queries can't nest: one phase at a time.
+class GpuTimers
+{
+public:
+  explicit GpuTimers(Profiler &profiler, uint32_t capacity = 32);
+  ~GpuTimers();
+
+  GpuTimers(const GpuTimers &) = delete;
+  GpuTimers &operator=(const GpuTimers &) = delete;
+
+  void begin(Profiler::PhaseId phase);
+  void end();
+
+  // Hand the finished queries to the profiler, once per frame
+  void collect();
+
+  // begin() and end() around the enclosing block
+  class Scope
+  {
+  public:
+    inline Scope(GpuTimers &timers, Profiler::PhaseId phase) : m_timers(timers)
+    {
+      m_timers.begin(phase);
+    }
+    inline ~Scope() { m_timers.end(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    GpuTimers &m_timers;
+  };
+
+private:
+  struct Query
+  {
+    GLuint id;
+    Profiler::PhaseId phase;
+    uint64_t frame;
+    int64_t begin; // CPU time of the submission, where the trace shows it
+    bool pending;
+  };
+
+  Profiler &m_profiler;
+  std::vector<Query> m_queries;
+  int32_t m_active = -1; // query between begin() and end()
+};
@@ -0,0 +1,168 @@
+#include "Profiler.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+Profiler::Profiler(size_t historyFrames, double traceSeconds) :
+    m_start(Clock::now()),
+    m_historyFrames(historyFrames),
+    m_traceNanoseconds(int64_t(traceSeconds * 1e9))
+{
+  // The creating thread is the main one
+  m_lanes[std::this_thread::get_id()] = 0;
+}
+
+Profiler::PhaseId Profiler::addPhase(std::string name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_phases.push_back(std::move(name));
+  m_current.push_back(0.f);
+  m_cpu.emplace_back(m_historyFrames + 1, 0.f);
+  m_gpu.emplace_back(m_historyFrames + 1, 0.f);
+  return PhaseId(m_phases.size() - 1);
+}
+
+Profiler::Scope::Scope(Profiler &profiler, PhaseId phase, const char *name) :
+    m_profiler(profiler),
+    m_phase(phase),
+    m_name(name),
+    m_begin(profiler.now())
+{
+}
+
+Profiler::Scope::~Scope()
+{
+  m_profiler.record(m_phase, m_name, m_begin, m_profiler.now());
+}
+
+int64_t Profiler::now() const
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - m_start)
+      .count();
+}
+
+void Profiler::record(
+    PhaseId phase, const char *name, int64_t begin, int64_t end)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto lane =
+      m_lanes.emplace(std::this_thread::get_id(), uint32_t(m_lanes.size()))
+          .first->second;
+  m_current[phase] += float(end - begin) * 1e-6f;
+  m_events.push_back(
+      {name ? name : m_phases[phase].c_str(), phase, lane, begin, end});
+}
+
+void Profiler::recordGpu(
+    PhaseId phase, uint64_t frame, int64_t begin, int64_t duration)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (frame + m_historyFrames >= m_frame) {
+    m_gpu[phase][frame % (m_historyFrames + 1)] += float(duration) * 1e-6f;
+  }
+  m_events.push_back({m_phases[phase].c_str(), phase, GPU_LANE, begin,
+      begin + duration});
+}
+
+void Profiler::endFrame()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const size_t slot = m_frame % (m_historyFrames + 1);
+  for (size_t phase = 0; phase < m_phases.size(); ++phase) {
+    m_cpu[phase][slot] = m_current[phase];
+    m_current[phase] = 0.f;
+  }
+  ++m_frame;
+  // The slot of the new frame still holds the oldest one
+  for (auto &gpu : m_gpu) {
+    gpu[m_frame % (m_historyFrames + 1)] = 0.f;
+  }
+
+  const int64_t oldest = now() - m_traceNanoseconds;
+  while (!m_events.empty() && m_events.front().end < oldest) {
+    m_events.pop_front();
+  }
+}
+
+void Profiler::cpuHistory(
+    PhaseId phase, std::vector<float> &milliseconds) const
+{
+  history(m_cpu, phase, milliseconds);
+}
+
+void Profiler::gpuHistory(
+    PhaseId phase, std::vector<float> &milliseconds) const
+{
+  history(m_gpu, phase, milliseconds);
+}
+
+void Profiler::history(const std::vector<std::vector<float>> &source,
+    PhaseId phase, std::vector<float> &milliseconds) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const size_t slots = m_historyFrames + 1;
+  milliseconds.resize(m_historyFrames);
+  for (size_t i = 0; i < m_historyFrames; ++i) {
+    milliseconds[i] = source[phase][(m_frame + 1 + i) % slots];
+  }
+}
+
+static void writeString(std::ostream &out, const char *s)
+{
+  out << '"';
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') {
+      out << '\\';
+    }
+    out << *s;
+  }
+  out << '"';
+}
+
+void Profiler::writeTrace(const fs::path &path) const
+{
+  std::vector<Event> events;
+  size_t laneCount;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    events.assign(m_events.begin(), m_events.end());
+    laneCount = m_lanes.size();
+  }
+
+  std::ofstream out(path);
+  if (!out) {
+    throw std::runtime_error("Unable to write " + path.string());
+  }
+
+  // Lanes are Chrome thread ids, the GPU after every CPU thread
+  const auto tid = [&](uint32_t lane) {
+    return lane == GPU_LANE ? laneCount : lane;
+  };
+
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  for (uint32_t lane = 0; lane <= laneCount; ++lane) {
+    const std::string name = lane == 0
+                                 ? "main"
+                                 : lane == laneCount
+                                       ? "GPU"
+                                       : "worker " + std::to_string(lane);
+    out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << lane
+        << ",\"args\":{\"name\":\"" << name << "\"}}";
+    out << (lane < laneCount || !events.empty() ? ",\n" : "\n");
+  }
+  for (size_t e = 0; e < events.size(); ++e) {
+    const Event &event = events[e];
+    out << "{\"ph\":\"X\",\"name\":";
+    writeString(out, event.name);
+    out << ",\"cat\":";
+    writeString(out, m_phases[event.phase].c_str());
+    out << ",\"pid\":0,\"tid\":" << tid(event.lane)
+        << ",\"ts\":" << double(event.begin) * 1e-3
+        << ",\"dur\":" << double(event.end - event.begin) * 1e-3 << "}"
+        << (e + 1 < events.size() ? ",\n" : "\n");
+  }
+  out << "]}\n";
+}
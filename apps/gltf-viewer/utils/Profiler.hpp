@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "filesystem.hpp"
+
+// Time spent in each phase of a frame. Scopes may be opened from any thread,
+// their durations are summed per phase into a history of the last frames and
+// kept as events for the last seconds, to be written as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev). GPU durations, known a few frames
+// later, are added to the frame that issued them.
+class Profiler
+{
+public:
+  using PhaseId = uint32_t;
+  using Clock = std::chrono::steady_clock;
+
+  static const PhaseId NO_PHASE = ~PhaseId(0);
+
+  explicit Profiler(size_t historyFrames = 240, double traceSeconds = 10.);
+
+  // Before the first scope, names are shared with the events
+  PhaseId addPhase(std::string name);
+  inline size_t phaseCount() const { return m_phases.size(); }
+  inline const std::string &phaseName(PhaseId phase) const
+  {
+    return m_phases[phase];
+  }
+
+  // Record the enclosing block under phase, named after the phase unless a
+  // name is given. The name must outlive the profiler.
+  class Scope
+  {
+  public:
+    Scope(Profiler &profiler, PhaseId phase, const char *name = nullptr);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Profiler &m_profiler;
+    PhaseId m_phase;
+    const char *m_name;
+    int64_t m_begin;
+  };
+
+  // Nanoseconds since the profiler was created
+  int64_t now() const;
+
+  void record(PhaseId phase, const char *name, int64_t begin, int64_t end);
+  // Duration measured by the GPU for a phase of a frame, shown from begin
+  void recordGpu(
+      PhaseId phase, uint64_t frame, int64_t begin, int64_t duration);
+
+  // Close the current frame, the one scopes are counted in
+  void endFrame();
+  inline uint64_t frame() const { return m_frame; }
+
+  // Milliseconds of each of the last frames, oldest first, GPU times being 0
+  // until known
+  void cpuHistory(PhaseId phase, std::vector<float> &milliseconds) const;
+  void gpuHistory(PhaseId phase, std::vector<float> &milliseconds) const;
+
+  // Chrome trace event format, one lane per thread plus one for the GPU
+  void writeTrace(const fs::path &path) const;
+
+private:
+  struct Event
+  {
+    const char *name;
+    PhaseId phase;
+    uint32_t lane; // GPU_LANE for GPU events
+    int64_t begin, end;
+  };
+
+  static const uint32_t GPU_LANE = ~uint32_t(0);
+
+  void history(const std::vector<std::vector<float>> &source, PhaseId phase,
+      std::vector<float> &milliseconds) const;
+
+  const Clock::time_point m_start;
+  const size_t m_historyFrames;
+  const int64_t m_traceNanoseconds;
+
+  std::vector<std::string> m_phases;
+
+  mutable std::mutex m_mutex;
+  uint64_t m_frame = 0;
+  std::vector<float> m_current; // per phase, current frame
+  // [phase][frame % (history + 1)], the extra slot for the current frame
+  std::vector<std::vector<float>> m_cpu, m_gpu;
+  std::deque<Event> m_events;
+  std::unordered_map<std::thread::id, uint32_t> m_lanes;
+};
@@ -0,0 +1,236 @@
+#include "ProgramCache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "glfw.hpp"
+
+namespace {
+
+// GL_KHR_parallel_shader_compile, or its ARB twin, is past the GL 4.4 glad
+// was generated for
+const GLenum MAX_SHADER_COMPILER_THREADS = 0x91B0;
+const GLenum COMPLETION_STATUS = 0x91B1;
+typedef void(APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+const char BINARY_MAGIC[4] = {'F', 'V', 'P', 'B'};
+const uint32_t BINARY_VERSION = 1;
+
+struct BinaryHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  GLenum format;
+  uint32_t length;
+};
+
+// FNV-1a, the cache only has to tell sources apart
+uint64_t hash(
+    const std::string &data, uint64_t seed = 14695981039346656037ull)
+{
+  for (const char c : data) {
+    seed = (seed ^ uint8_t(c)) * 1099511628211ull;
+  }
+  return seed;
+}
+
+std::string glString(GLenum name)
+{
+  const GLubyte *value = glGetString(name);
+  return value ? reinterpret_cast<const char *>(value) : "";
+}
+
+} // namespace
+
+ProgramCache::ProgramCache(const fs::path &directory) : m_directory(directory)
+{
+  m_driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" +
+             glString(GL_VERSION) + "\n" +
+             glString(GL_SHADING_LANGUAGE_VERSION);
+
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  m_binaries = !m_directory.empty() && formatCount > 0;
+
+  // As many threads as the driver wants
+  for (const char *suffix : {"KHR", "ARB"}) {
+    const std::string extension =
+        std::string("GL_") + suffix + "_parallel_shader_compile";
+    if (!glfwExtensionSupported(extension.c_str())) {
+      continue;
+    }
+    const auto maxThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(
+        glfwGetProcAddress(
+            (std::string("glMaxShaderCompilerThreads") + suffix).c_str()));
+    if (maxThreads) {
+      maxThreads(0xFFFFFFFF);
+      m_parallel = true;
+      GLint threads = 0;
+      glGetIntegerv(MAX_SHADER_COMPILER_THREADS, &threads);
+      std::clog << extension << ": " << threads << " compiler threads\n";
+      break;
+    }
+  }
+}
+
+std::vector<GLProgram> ProgramCache::build(
+    const std::vector<std::vector<fs::path>> &programs)
+{
+  std::vector<Build> builds;
+  for (const auto &paths : programs) {
+    builds.push_back(start(paths));
+  }
+  std::vector<GLProgram> linked;
+  for (auto &build : builds) {
+    linked.push_back(finish(build));
+  }
+  return linked;
+}
+
+ProgramCache::Build ProgramCache::start(const std::vector<fs::path> &paths)
+{
+  Build build{paths, hash(m_driver), {}, {}, GLProgram(), false};
+  for (const auto &path : paths) {
+    build.sources.push_back(loadShaderSource(path));
+    build.key =
+        hash(std::to_string(shaderType(path).first) + "\n", build.key);
+    build.key = hash(build.sources.back(), build.key);
+  }
+  if (m_binaries) {
+    if (load(build.program.glId(), build.key)) {
+      std::clog << "Loaded program " << paths.front() << " from the cache\n";
+      build.cached = true;
+      return build;
+    }
+    // A rejected binary may leave the program in any state
+    build.program = GLProgram();
+  }
+
+  for (size_t s = 0; s < paths.size(); ++s) {
+    const auto &type = shaderType(paths[s]);
+    std::clog << "Compiling " << type.second << " shader " << paths[s]
+              << "\n";
+    build.shaders.emplace_back(type.first);
+    build.shaders.back().setSource(build.sources[s]);
+    glCompileShader(build.shaders.back().glId());
+    glAttachShader(build.program.glId(), build.shaders.back().glId());
+  }
+  if (m_binaries) {
+    glProgramParameteri(
+        build.program.glId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glLinkProgram(build.program.glId());
+  return build;
+}
+
+bool ProgramCache::ready(const Build &build) const
+{
+  if (build.cached || !m_parallel) {
+    return true;
+  }
+  GLint done = GL_FALSE;
+  glGetProgramiv(build.program.glId(), COMPLETION_STATUS, &done);
+  return done == GL_TRUE;
+}
+
+GLProgram ProgramCache::finish(Build &build)
+{
+  if (build.cached) {
+    ++m_hits;
+    return std::move(build.program);
+  }
+
+  for (size_t s = 0; s < build.shaders.size(); ++s) {
+    const GLShader &shader = build.shaders[s];
+    if (!shader.getCompileStatus()) {
+      std::cerr << "Shader compilation error in " << build.paths[s] << ":"
+                << shader.getInfoLog() << std::endl;
+      throw std::runtime_error(
+          "Shader compilation error:" + shader.getInfoLog());
+    }
+  }
+  if (!build.program.getLinkStatus()) {
+    std::cerr << "Program link error:" << build.program.getInfoLog()
+              << std::endl;
+    throw std::runtime_error(
+        "Program link error:" + build.program.getInfoLog());
+  }
+  ++m_misses;
+  if (m_binaries) {
+    store(build.program.glId(), build.key);
+  }
+  return std::move(build.program);
+}
+
+fs::path ProgramCache::binaryPath(uint64_t key) const
+{
+  std::stringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+  return m_directory / name.str();
+}
+
+bool ProgramCache::load(GLuint program, uint64_t key) const
+{
+  std::ifstream input(binaryPath(key).string(), std::ios::binary);
+  BinaryHeader header;
+  if (!input.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+    return false;
+  }
+  if (std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 ||
+      header.version != BINARY_VERSION || header.key != key) {
+    return false;
+  }
+  std::vector<char> binary(header.length);
+  if (!input.read(binary.data(), binary.size())) {
+    return false;
+  }
+
+  // A format the driver no longer takes fails the link
+  glProgramBinary(
+      program, header.format, binary.data(), GLsizei(header.length));
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  return status == GL_TRUE;
+}
+
+void ProgramCache::store(GLuint program, uint64_t key) const
+{
+  BinaryHeader header;
+  std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.version = BINARY_VERSION;
+  header.key = key;
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  glGetProgramBinary(program, length, nullptr, &header.format, binary.data());
+  header.length = uint32_t(length);
+
+  // Written aside then renamed, a reader never sees half a binary. A cache
+  // that can't be written only leaves startup slower.
+  const fs::path path = binaryPath(key);
+  fs::path temporary = path;
+  temporary += ".tmp";
+  std::error_code error;
+  fs::create_directories(m_directory, error);
+  {
+    std::ofstream output(temporary.string(), std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(binary.data(), binary.size());
+    if (!output) {
+      std::cerr << "Unable to write " << temporary << std::endl;
+      return;
+    }
+  }
+  fs::rename(temporary, path, error);
+  if (error) {
+    std::cerr << "Unable to write " << path << ": " << error.message()
+              << std::endl;
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "shaders.hpp"
+
+// Programs linked from GLSL files, like compileProgram(), kept on disk as the
+// binaries of the driver. A binary is keyed by a hash of the sources of the
+// program and of the vendor, renderer and version strings; one the driver
+// rejects, after an update for instance, is compiled from source again and
+// replaced. Needs a current context.
+class ProgramCache
+{
+public:
+  // directory empty disables the binaries, every program is compiled
+  explicit ProgramCache(const fs::path &directory);
+
+  // One program per list of shader files, started together then finished.
+  // Throws std::runtime_error on compilation or link errors.
+  std::vector<GLProgram> build(
+      const std::vector<std::vector<fs::path>> &programs);
+
+  // A program on its way, loaded from the cache or compiling from source
+  struct Build
+  {
+    std::vector<fs::path> paths;
+    uint64_t key;
+    std::vector<std::string> sources;
+    std::vector<GLShader> shaders;
+    GLProgram program;
+    bool cached = false;
+  };
+
+  // Load the program or issue its compilation and link without waiting for
+  // them, which a driver with GL_KHR_parallel_shader_compile runs on its own
+  // threads. Throws std::runtime_error if a file can't be read.
+  Build start(const std::vector<fs::path> &paths);
+  // Whether finish() would not wait for the driver
+  bool ready(const Build &build) const;
+  // The linked program, stored in the cache. Throws std::runtime_error on
+  // compilation or link errors.
+  GLProgram finish(Build &build);
+
+  inline bool binariesEnabled() const { return m_binaries; }
+  inline bool parallelCompile() const { return m_parallel; }
+
+  // Programs loaded from the disk and compiled so far
+  inline uint32_t hits() const { return m_hits; }
+  inline uint32_t misses() const { return m_misses; }
+
+private:
+  fs::path binaryPath(uint64_t key) const;
+  bool load(GLuint program, uint64_t key) const;
+  void store(GLuint program, uint64_t key) const;
+
+  fs::path m_directory;
+  std::string m_driver;
+  bool m_binaries = false;
+  bool m_parallel = false;
+  uint32_t m_hits = 0;
+  uint32_t m_misses = 0;
+};
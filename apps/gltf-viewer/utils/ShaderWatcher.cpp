@@ -0,0 +1,66 @@
+#include "ShaderWatcher.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher(const fs::path &directory) :
+    m_directory(directory)
+{
+#ifdef __linux__
+  m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_inotify < 0) {
+    std::cerr << "Unable to watch " << directory << std::endl;
+    return;
+  }
+  m_watch = inotify_add_watch(
+      m_inotify, directory.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (m_watch < 0) {
+    std::cerr << "Unable to watch " << directory << std::endl;
+  }
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+#ifdef __linux__
+  if (m_inotify >= 0) {
+    close(m_inotify); // the watch goes with it
+  }
+#endif
+}
+
+std::vector<fs::path> ShaderWatcher::takeChanged()
+{
+  std::vector<fs::path> changed;
+#ifdef __linux__
+  if (m_watch < 0) {
+    return changed;
+  }
+
+  // Aligned for the events, big enough for many of them
+  alignas(inotify_event) char buffer[4096];
+  for (;;) {
+    const ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break; // EAGAIN once drained
+    }
+    for (ssize_t offset = 0; offset < length;) {
+      const auto *event =
+          reinterpret_cast<const inotify_event *>(buffer + offset);
+      if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+        const fs::path path = m_directory / event->name;
+        if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+          changed.push_back(path);
+        }
+      }
+      offset += sizeof(inotify_event) + event->len;
+    }
+  }
+#endif
+  return changed;
+}
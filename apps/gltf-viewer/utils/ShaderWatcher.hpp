@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "filesystem.hpp"
+
+// Files of a directory written since the last look, through inotify. Only
+// complete writes count, a file closed after writing or moved in, which is
+// how editors save. Elsewhere, or when inotify is out of watches, nothing is
+// ever reported.
+class ShaderWatcher
+{
+public:
+  explicit ShaderWatcher(const fs::path &directory);
+  ~ShaderWatcher();
+
+  ShaderWatcher(const ShaderWatcher &) = delete;
+  ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+  inline bool watching() const { return m_watch >= 0; }
+
+  // Never blocks: the events are read from a non blocking descriptor, a
+  // file written many times appearing once
+  std::vector<fs::path> takeChanged();
+
+private:
+  fs::path m_directory;
+  int m_inotify = -1;
+  int m_watch = -1;
+};
@@ -0,0 +1,62 @@
+#include "SpatialHash.hpp"
+
+SpatialHash::SpatialHash(const SpatialHash &other)
+{
+  reset(other.m_entryCount);
+}
+
+SpatialHash &SpatialHash::operator=(const SpatialHash &other)
+{
+  reset(other.m_entryCount);
+  return *this;
+}
+
+void SpatialHash::reset(size_t entryCount)
+{
+  size_t bucketCount = 1;
+  while (bucketCount < entryCount) {
+    bucketCount <<= 1;
+  }
+
+  m_entryCount = entryCount;
+  m_mask = uint32_t(bucketCount - 1);
+  m_counts.reset(new std::atomic<uint32_t>[bucketCount]);
+  m_cursors.reset(new std::atomic<uint32_t>[bucketCount]);
+  for (size_t b = 0; b < bucketCount; ++b) {
+    m_counts[b] = 0;
+    m_cursors[b] = 0;
+  }
+  m_offsets.assign(bucketCount + 1, 0);
+  m_items.clear();
+}
+
+uint32_t SpatialHash::bucket(const glm::ivec3 &cell) const
+{
+  return (uint32_t(cell.x) * 73856093u ^ uint32_t(cell.y) * 19349663u ^
+             uint32_t(cell.z) * 83492791u) &
+         m_mask;
+}
+
+void SpatialHash::count(uint32_t bucket)
+{
+  m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Also clears the counts for the next rebuild
+void SpatialHash::prefixSum()
+{
+  uint32_t offset = 0;
+  for (uint32_t b = 0; b <= m_mask; ++b) {
+    m_offsets[b] = offset;
+    m_cursors[b].store(offset, std::memory_order_relaxed);
+    offset += m_counts[b].load(std::memory_order_relaxed);
+    m_counts[b].store(0, std::memory_order_relaxed);
+  }
+  m_offsets[m_mask + 1] = offset;
+  m_items.resize(offset);
+}
+
+void SpatialHash::insert(uint32_t bucket, uint32_t item)
+{
+  m_items[m_cursors[bucket].fetch_add(1, std::memory_order_relaxed)] = item;
+}
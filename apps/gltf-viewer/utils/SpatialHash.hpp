@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Uniform grid folded into a table of buckets, rebuilt every step with a
+// counting sort that can run in parallel: count() every entry, prefixSum()
+// once, then insert() every entry. An item may be entered in several buckets.
+// Entries of a bucket come in no particular order, and distinct cells may
+// share a bucket.
+class SpatialHash
+{
+public:
+  SpatialHash() = default;
+  // The content is rebuilt every step, copies only keep the table size
+  SpatialHash(const SpatialHash &other);
+  SpatialHash &operator=(const SpatialHash &other);
+  SpatialHash(SpatialHash &&) = default;
+  SpatialHash &operator=(SpatialHash &&) = default;
+
+  // Table sized for about entryCount entries, emptied
+  void reset(size_t entryCount);
+
+  uint32_t bucket(const glm::ivec3 &cell) const;
+
+  // Thread safe
+  void count(uint32_t bucket);
+  void prefixSum();
+  // Thread safe, after prefixSum()
+  void insert(uint32_t bucket, uint32_t item);
+
+  inline const uint32_t *begin(uint32_t bucket) const
+  {
+    return m_items.data() + m_offsets[bucket];
+  }
+  inline const uint32_t *end(uint32_t bucket) const
+  {
+    return m_items.data() + m_offsets[bucket + 1];
+  }
+
+private:
+  size_t m_entryCount = 0;
+  uint32_t m_mask = 0;
+  std::unique_ptr<std::atomic<uint32_t>[]> m_counts, m_cursors;
+  std::vector<uint32_t> m_offsets;
+  std::vector<uint32_t> m_items;
+};
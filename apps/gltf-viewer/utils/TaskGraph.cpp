@@ -0,0 +1,83 @@
+#include "TaskGraph.hpp"
+
+TaskGraph::NodeId TaskGraph::addNode(
+    std::string name, std::function<void()> fn, bool mainThread)
+{
+  auto node = std::make_unique<Node>();
+  node->name = std::move(name);
+  node->fn = std::move(fn);
+  node->mainThread = mainThread;
+  m_nodes.push_back(std::move(node));
+  return NodeId(m_nodes.size() - 1);
+}
+
+void TaskGraph::addDependency(NodeId before, NodeId after)
+{
+  m_nodes[before]->successors.push_back(after);
+  ++m_nodes[after]->dependencyCount;
+}
+
+void TaskGraph::clear()
+{
+  m_nodes.clear();
+  m_mainReady.clear();
+}
+
+void TaskGraph::run(ThreadPool &pool)
+{
+  m_completed = 0;
+  for (auto &node : m_nodes) {
+    node->remaining = node->dependencyCount;
+  }
+  for (NodeId node = 0; node < m_nodes.size(); ++node) {
+    if (m_nodes[node]->dependencyCount == 0) {
+      schedule(pool, node);
+    }
+  }
+
+  while (m_completed < m_nodes.size()) {
+    NodeId mainNode = 0;
+    bool hasMainNode = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mainMutex);
+      if (!m_mainReady.empty()) {
+        mainNode = m_mainReady.back();
+        m_mainReady.pop_back();
+        hasMainNode = true;
+      }
+    }
+
+    if (hasMainNode) {
+      execute(pool, mainNode);
+    } else if (!pool.runPendingTask()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void TaskGraph::schedule(ThreadPool &pool, NodeId node)
+{
+  if (m_nodes[node]->mainThread) {
+    std::lock_guard<std::mutex> lock(m_mainMutex);
+    m_mainReady.push_back(node);
+  } else {
+    pool.submit([this, &pool, node]() { execute(pool, node); });
+  }
+}
+
+void TaskGraph::execute(ThreadPool &pool, NodeId node)
+{
+  Node &current = *m_nodes[node];
+  if (m_profiler && current.phase != Profiler::NO_PHASE) {
+    Profiler::Scope scope(*m_profiler, current.phase, current.name.c_str());
+    current.fn();
+  } else {
+    current.fn();
+  }
+  for (const NodeId successor : current.successors) {
+    if (--m_nodes[successor]->remaining == 0) {
+      schedule(pool, successor);
+    }
+  }
+  ++m_completed;
+}
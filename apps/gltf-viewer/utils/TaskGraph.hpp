@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Profiler.hpp"
+#include "ThreadPool.hpp"
+
+// Directed acyclic graph of tasks, built once and run every frame.
+// A node starts as soon as all the nodes it depends on are done, so
+// independent chains overlap. Main thread nodes (OpenGL, ImGui) only run on
+// the thread calling run(), the others on the pool.
+class TaskGraph
+{
+public:
+  using NodeId = uint32_t;
+
+  NodeId addNode(
+      std::string name, std::function<void()> fn, bool mainThread = false);
+
+  // after starts once before is done
+  void addDependency(NodeId before, NodeId after);
+
+  // Run every node once and wait for the whole graph
+  void run(ThreadPool &pool);
+
+  // Time every node with a phase as a scope of that phase, named after it
+  inline void setProfiler(Profiler *profiler) { m_profiler = profiler; }
+  inline void setPhase(NodeId node, Profiler::PhaseId phase)
+  {
+    m_nodes[node]->phase = phase;
+  }
+
+  void clear();
+  inline size_t size() const { return m_nodes.size(); }
+  inline const std::string &name(NodeId node) const
+  {
+    return m_nodes[node]->name;
+  }
+
+private:
+  struct Node
+  {
+    std::string name;
+    std::function<void()> fn;
+    bool mainThread;
+    Profiler::PhaseId phase = Profiler::NO_PHASE;
+    std::vector<NodeId> successors;
+    uint32_t dependencyCount = 0;
+    std::atomic<uint32_t> remaining{0};
+  };
+
+  void schedule(ThreadPool &pool, NodeId node);
+  void execute(ThreadPool &pool, NodeId node);
+
+  std::vector<std::unique_ptr<Node>> m_nodes;
+  Profiler *m_profiler = nullptr;
+
+  std::mutex m_mainMutex;
+  std::vector<NodeId> m_mainReady;
+  std::atomic<size_t> m_completed{0};
+};
@@ -0,0 +1,193 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+struct CurrentWorker
+{
+  const ThreadPool *pool = nullptr;
+  uint32_t slot = 0;
+};
+
+thread_local CurrentWorker t_currentWorker;
+
+} // namespace
+
+ThreadPool::ThreadPool(uint32_t threadCount) :
+    m_statsStart(std::chrono::steady_clock::now())
+{
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (uint32_t t = 0; t < threadCount; ++t) {
+    m_slots.push_back(std::make_unique<Slot>());
+  }
+  for (uint32_t t = 1; t < threadCount; ++t) {
+    m_workers.emplace_back([this, t]() { workerLoop(t); });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+uint32_t ThreadPool::currentSlot() const
+{
+  return t_currentWorker.pool == this ? t_currentWorker.slot : 0;
+}
+
+void ThreadPool::submit(Task task)
+{
+  Slot &slot = *m_slots[currentSlot()];
+  {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.tasks.push_back(std::move(task));
+  }
+  ++m_pending;
+  {
+    // Taking the lock orders the increment with a worker going to sleep
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+  }
+  m_wake.notify_one();
+}
+
+bool ThreadPool::popTask(uint32_t slot, Task &task)
+{
+  {
+    Slot &own = *m_slots[slot];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      --m_pending;
+      return true;
+    }
+  }
+
+  // Steal the oldest task of another slot, they are the biggest ones when
+  // tasks split recursively
+  for (uint32_t offset = 1; offset < m_slots.size(); ++offset) {
+    Slot &victim = *m_slots[(slot + offset) % m_slots.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --m_pending;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::execute(uint32_t slot, Task &task)
+{
+  const auto start = std::chrono::steady_clock::now();
+  task();
+  const auto end = std::chrono::steady_clock::now();
+  m_slots[slot]->busyNanoseconds +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count();
+}
+
+bool ThreadPool::runPendingTask()
+{
+  const uint32_t slot = currentSlot();
+  Task task;
+  if (!popTask(slot, task)) {
+    return false;
+  }
+  execute(slot, task);
+  return true;
+}
+
+void ThreadPool::workerLoop(uint32_t slot)
+{
+  t_currentWorker.pool = this;
+  t_currentWorker.slot = slot;
+
+  Task task;
+  for (;;) {
+    if (popTask(slot, task)) {
+      execute(slot, task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_wake.wait(lock, [this]() { return m_stop || m_pending > 0; });
+    if (m_stop) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::parallelFor(
+    size_t count, const std::function<void(size_t)> &fn)
+{
+  if (count == 0) {
+    return;
+  }
+
+  // Helpers may start after the loop is over, so the state they touch is
+  // shared rather than on this stack. They never call fn in that case.
+  struct State
+  {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    size_t count;
+    const std::function<void(size_t)> *fn;
+  };
+  const auto state = std::make_shared<State>();
+  state->count = count;
+  state->fn = &fn;
+
+  const auto work = [state]() {
+    for (size_t i = state->next++; i < state->count; i = state->next++) {
+      (*state->fn)(i);
+      ++state->done;
+    }
+  };
+
+  const size_t helpers = std::min<size_t>(size(), count) - 1;
+  for (size_t h = 0; h < helpers; ++h) {
+    submit(work);
+  }
+  work();
+
+  while (state->done < count) {
+    if (!runPendingTask()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+std::vector<float> ThreadPool::utilization() const
+{
+  const double elapsed = double(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - m_statsStart)
+          .count());
+
+  std::vector<float> result;
+  for (const auto &slot : m_slots) {
+    result.push_back(
+        elapsed > 0. ? float(slot->busyNanoseconds / elapsed) : 0.f);
+  }
+  return result;
+}
+
+void ThreadPool::resetStats()
+{
+  for (auto &slot : m_slots) {
+    slot->busyNanoseconds = 0;
+  }
+  m_statsStart = std::chrono::steady_clock::now();
+}
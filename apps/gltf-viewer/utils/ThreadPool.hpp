@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Every thread owns a deque: it pushes and pops its own tasks at the back and
+// steals from the front of the others when it runs out. Threads that are not
+// workers (the main thread) share slot 0 and help by calling
+// runPendingTask(), so a pool of size 1 has no worker at all.
+class ThreadPool
+{
+public:
+  using Task = std::function<void()>;
+
+  // threadCount includes the calling thread, 0 means one per hardware thread
+  explicit ThreadPool(uint32_t threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  uint32_t size() const { return uint32_t(m_slots.size()); }
+
+  void submit(Task task);
+
+  // Run one queued task on the calling thread, false if there was none
+  bool runPendingTask();
+
+  // Call fn(i) for every i in [0, count) and wait for all of them, helping
+  // with other tasks meanwhile. Can be nested.
+  void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+  // Fraction of the time since resetStats() each slot spent running tasks,
+  // slot 0 being the main thread
+  std::vector<float> utilization() const;
+  void resetStats();
+
+private:
+  struct Slot
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::atomic<uint64_t> busyNanoseconds{0};
+  };
+
+  void workerLoop(uint32_t slot);
+  uint32_t currentSlot() const;
+  bool popTask(uint32_t slot, Task &task);
+  void execute(uint32_t slot, Task &task);
+
+  std::vector<std::unique_ptr<Slot>> m_slots;
+  std::vector<std::thread> m_workers;
+
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wake;
+  std::atomic<size_t> m_pending{0};
+  bool m_stop = false;
+
+  std::chrono::steady_clock::time_point m_statsStart;
+};
@@ -0,0 +1,98 @@
+#include "WindField.hpp"
+
+#include <random>
+#include <stdexcept>
+
+WindField::WindField(uint32_t resolution, uint32_t seed) :
+    m_resolution(resolution), m_mask(resolution - 1), m_padded(resolution + 1)
+{
+  if (resolution < 8 || (resolution & (resolution - 1)) != 0) {
+    throw std::invalid_argument(
+        "Wind field resolution must be a power of two, at least 8");
+  }
+
+  const size_t count = size_t(resolution) * resolution * resolution;
+  const auto index = [&](uint32_t x, uint32_t y, uint32_t z) {
+    return (x & m_mask) +
+           resolution * ((y & m_mask) + resolution * (z & m_mask));
+  };
+
+  // Vector potential: octaves of value noise on lattices that divide the
+  // grid, smoothly interpolated so that every octave tiles
+  std::vector<glm::vec3> potential(count, glm::vec3(0.f));
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+  float amplitude = 1.f;
+  for (uint32_t period = resolution / 4; period >= 2;
+       period /= 2, amplitude *= 0.5f) {
+    const uint32_t lattice = resolution / period;
+    std::vector<glm::vec3> values(size_t(lattice) * lattice * lattice);
+    for (auto &value : values) {
+      value = glm::vec3(uniform(random), uniform(random), uniform(random));
+    }
+    const auto value = [&](uint32_t x, uint32_t y, uint32_t z) {
+      return values[x % lattice +
+                    lattice * (y % lattice + lattice * (z % lattice))];
+    };
+    const auto smooth = [](float t) { return t * t * (3.f - 2.f * t); };
+
+    for (uint32_t z = 0; z < resolution; ++z) {
+      for (uint32_t y = 0; y < resolution; ++y) {
+        for (uint32_t x = 0; x < resolution; ++x) {
+          const glm::uvec3 low = glm::uvec3(x, y, z) / period;
+          const glm::vec3 t(smooth(float(x % period) / period),
+              smooth(float(y % period) / period),
+              smooth(float(z % period) / period));
+          const glm::vec3 v = glm::mix(
+              glm::mix(glm::mix(value(low.x, low.y, low.z),
+                           value(low.x + 1, low.y, low.z), t.x),
+                  glm::mix(value(low.x, low.y + 1, low.z),
+                      value(low.x + 1, low.y + 1, low.z), t.x),
+                  t.y),
+              glm::mix(glm::mix(value(low.x, low.y, low.z + 1),
+                           value(low.x + 1, low.y, low.z + 1), t.x),
+                  glm::mix(value(low.x, low.y + 1, low.z + 1),
+                      value(low.x + 1, low.y + 1, low.z + 1), t.x),
+                  t.y),
+              t.z);
+          potential[index(x, y, z)] += amplitude * v;
+        }
+      }
+    }
+  }
+
+  // Curl by central differences, wrapping around
+  std::vector<glm::vec3> nodes(count);
+  float sum2 = 0.f;
+  for (uint32_t z = 0; z < resolution; ++z) {
+    for (uint32_t y = 0; y < resolution; ++y) {
+      for (uint32_t x = 0; x < resolution; ++x) {
+        const glm::vec3 dx =
+            potential[index(x + 1, y, z)] - potential[index(x - 1, y, z)];
+        const glm::vec3 dy =
+            potential[index(x, y + 1, z)] - potential[index(x, y - 1, z)];
+        const glm::vec3 dz =
+            potential[index(x, y, z + 1)] - potential[index(x, y, z - 1)];
+        const glm::vec3 curl(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+        nodes[index(x, y, z)] = 0.5f * curl;
+        sum2 += glm::dot(curl, curl) * 0.25f;
+      }
+    }
+  }
+
+  const float scale = sum2 > 0.f ? std::sqrt(float(count) / sum2) : 0.f;
+  for (auto &component : m_components) {
+    component.resize(size_t(m_padded) * m_padded * m_padded);
+  }
+  for (uint32_t z = 0; z < m_padded; ++z) {
+    for (uint32_t y = 0; y < m_padded; ++y) {
+      for (uint32_t x = 0; x < m_padded; ++x) {
+        const glm::vec3 node = scale * nodes[index(x, y, z)];
+        const size_t padded = x + m_padded * (y + size_t(m_padded) * z);
+        for (int c = 0; c < 3; ++c) {
+          m_components[c][padded] = node[c];
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "simd.hpp"
+
+// Tileable turbulence: the curl of a few octaves of smooth vector noise,
+// precomputed on a periodic grid of resolution^3 nodes and read back by
+// trilinear interpolation. The curl makes the flow divergence free, so it
+// swirls instead of pulsing, and it is scaled to a unit RMS speed.
+class WindField
+{
+public:
+  // resolution is a power of two, at least 8
+  explicit WindField(uint32_t resolution = 32, uint32_t seed = 1);
+
+  inline uint32_t resolution() const { return m_resolution; }
+
+  // Velocities at 4 points, in grid cells, wrapping around. The nodes around
+  // each point are gathered from the array of every component, two along x
+  // at a time, and interpolated across the points.
+  inline void sample4(const float4 &x, const float4 &y, const float4 &z,
+      float4 &vx, float4 &vy, float4 &vz) const
+  {
+    alignas(16) float p[3][4];
+    alignas(16) float t[3][4];
+    x.store(p[0]);
+    y.store(p[1]);
+    z.store(p[2]);
+    uint32_t base[4];
+    for (int lane = 0; lane < 4; ++lane) {
+      uint32_t index = 0;
+      for (int axis = 2; axis >= 0; --axis) {
+        // Truncation rounds negative values up, std::floor would be a call
+        int32_t cell = int32_t(p[axis][lane]);
+        cell -= p[axis][lane] < float(cell);
+        t[axis][lane] = p[axis][lane] - float(cell);
+        index = index * m_padded + (uint32_t(cell) & m_mask);
+      }
+      base[lane] = index;
+    }
+
+    const float4 tx = float4::load(t[0]);
+    const float4 ty = float4::load(t[1]);
+    const float4 tz = float4::load(t[2]);
+    const uint32_t dy = m_padded;
+    const uint32_t dz = m_padded * m_padded;
+    // Along x at the four corners of the cell in y and z, then across them
+    const auto component = [&](const std::vector<float> &nodes) {
+      const auto edge = [&](uint32_t offset) {
+        float4 low, high;
+        gatherPairs(nodes.data(), base, offset, low, high);
+        return lerp(low, high, tx);
+      };
+      return lerp(lerp(edge(0), edge(dy), ty),
+          lerp(edge(dz), edge(dz + dy), ty), tz);
+    };
+    vx = component(m_components[0]);
+    vy = component(m_components[1]);
+    vz = component(m_components[2]);
+  }
+
+  // Velocity at p, one point at a time
+  inline glm::vec3 sample(const glm::vec3 &p) const
+  {
+    glm::ivec3 cell(p);
+    cell -= glm::ivec3(glm::lessThan(p, glm::vec3(cell)));
+    const glm::vec3 t = p - glm::vec3(cell);
+    const glm::uvec3 wrapped = glm::uvec3(cell) & m_mask;
+    const uint32_t base =
+        wrapped.x + m_padded * (wrapped.y + m_padded * wrapped.z);
+    const uint32_t dy = m_padded;
+    const uint32_t dz = m_padded * m_padded;
+    glm::vec3 v;
+    for (int c = 0; c < 3; ++c) {
+      const float *n = m_components[c].data() + base;
+      const auto edge = [&](uint32_t offset) {
+        return glm::mix(n[offset], n[offset + 1], t.x);
+      };
+      v[c] = glm::mix(glm::mix(edge(0), edge(dy), t.y),
+          glm::mix(edge(dz), edge(dz + dy), t.y), t.z);
+    }
+    return v;
+  }
+
+private:
+  // nodes[base[lane] + offset] in low and the next node along x in high
+  static inline void gatherPairs(const float *nodes, const uint32_t base[4],
+      uint32_t offset, float4 &low, float4 &high)
+  {
+#ifdef CLOTH_USE_SSE
+    const auto pair = [&](int lane) {
+      return reinterpret_cast<const __m64 *>(nodes + base[lane] + offset);
+    };
+    const __m128 pairs01 =
+        _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), pair(0)), pair(1));
+    const __m128 pairs23 =
+        _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), pair(2)), pair(3));
+    low = _mm_shuffle_ps(pairs01, pairs23, _MM_SHUFFLE(2, 0, 2, 0));
+    high = _mm_shuffle_ps(pairs01, pairs23, _MM_SHUFFLE(3, 1, 3, 1));
+#else
+    const float *n = nodes + offset;
+    low = float4(n[base[0]], n[base[1]], n[base[2]], n[base[3]]);
+    high = float4(
+        n[base[0] + 1], n[base[1] + 1], n[base[2] + 1], n[base[3] + 1]);
+#endif
+  }
+
+  uint32_t m_resolution, m_mask;
+  // Every component apart, over resolution + 1 nodes along each axis, the
+  // last ones repeating the first so that no neighbour wraps:
+  // x + padded * (y + padded * z)
+  uint32_t m_padded;
+  std::vector<float> m_components[3];
+};
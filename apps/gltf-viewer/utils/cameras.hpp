@@ -137,12 +137,57 @@ public:
     return normalize ? glm::normalize(l) : l;
   }
 
+  // Ray through a point of the viewport in normalized device coordinates,
+  // from the near plane of projMatrix, the direction normalized
+  void ray(const glm::mat4 &projMatrix, const glm::vec2 &ndc,
+      glm::vec3 &origin, glm::vec3 &direction) const
+  {
+    const auto inverse = glm::inverse(projMatrix * getViewMatrix());
+    const auto nearPoint = inverse * glm::vec4(ndc, -1.f, 1.f);
+    const auto farPoint = inverse * glm::vec4(ndc, 1.f, 1.f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+  }
+
 private:
   glm::vec3 m_eye;
   glm::vec3 m_center;
   glm::vec3 m_up;
 };
 
+// Planes bounding what a projection times view (times model) matrix keeps,
+// normals inward, extracted from its rows as Gribb and Hartmann do
+class Frustum
+{
+public:
+  explicit Frustum(const glm::mat4 &clipMatrix)
+  {
+    const glm::mat4 rows = glm::transpose(clipMatrix);
+    for (int axis = 0; axis < 3; ++axis) {
+      m_planes[2 * axis] = rows[3] + rows[axis];
+      m_planes[2 * axis + 1] = rows[3] - rows[axis];
+    }
+  }
+
+  // False only when the box is wholly outside one of the planes, which
+  // keeps a few boxes near the corners of the frustum
+  bool intersects(const glm::vec3 &low, const glm::vec3 &high) const
+  {
+    for (const auto &plane : m_planes) {
+      // Corner furthest along the normal
+      const glm::vec3 corner(plane.x >= 0.f ? high.x : low.x,
+          plane.y >= 0.f ? high.y : low.y, plane.z >= 0.f ? high.z : low.z);
+      if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  glm::vec4 m_planes[6];
+};
+
 class CameraController
 {
 public:
@@ -0,0 +1,370 @@
+#include "gltf.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "json.hpp"
+
+namespace {
+
+const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+const int COMPONENT_UNSIGNED_BYTE = 5121;
+const int COMPONENT_UNSIGNED_SHORT = 5123;
+const int COMPONENT_UNSIGNED_INT = 5125;
+const int COMPONENT_FLOAT = 5126;
+
+const int MODE_TRIANGLES = 4;
+const int MODE_TRIANGLE_STRIP = 5;
+const int MODE_TRIANGLE_FAN = 6;
+
+std::vector<unsigned char> readFile(const fs::path &path)
+{
+  std::ifstream in(path.string(), std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Unable to open " + path.string());
+  }
+  return std::vector<unsigned char>(
+      std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+uint32_t readU32(const std::vector<unsigned char> &data, size_t offset)
+{
+  uint32_t value;
+  std::memcpy(&value, data.data() + offset, sizeof(value));
+  return value; // glTF is little endian, like every target of this app
+}
+
+std::vector<unsigned char> decodeBase64(const std::string &text)
+{
+  static const std::string alphabet =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::vector<unsigned char> out;
+  uint32_t bits = 0;
+  int count = 0;
+  for (const char c : text) {
+    const size_t value = alphabet.find(c);
+    if (value == std::string::npos) {
+      continue; // padding and line breaks
+    }
+    bits = (bits << 6) | uint32_t(value);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out.push_back((unsigned char)((bits >> count) & 0xFF));
+    }
+  }
+  return out;
+}
+
+class GltfReader
+{
+public:
+  GltfReader(const fs::path &path)
+  {
+    const std::vector<unsigned char> file = readFile(path);
+    std::vector<unsigned char> binChunk;
+    std::string json;
+
+    if (file.size() >= 12 && readU32(file, 0) == GLB_MAGIC) {
+      size_t offset = 12;
+      while (offset + 8 <= file.size()) {
+        const uint32_t length = readU32(file, offset);
+        const uint32_t type = readU32(file, offset + 4);
+        offset += 8;
+        if (offset + length > file.size()) {
+          throw std::runtime_error("Truncated GLB chunk in " + path.string());
+        }
+        if (type == GLB_CHUNK_JSON) {
+          json.assign(file.begin() + offset, file.begin() + offset + length);
+        } else if (type == GLB_CHUNK_BIN && binChunk.empty()) {
+          binChunk.assign(
+              file.begin() + offset, file.begin() + offset + length);
+        }
+        offset += length;
+      }
+    } else {
+      json.assign(file.begin(), file.end());
+    }
+
+    m_document = parseJson(json);
+
+    if (const JsonValue *buffers = m_document.find("buffers")) {
+      for (size_t b = 0; b < buffers->size(); ++b) {
+        const JsonValue *uri = (*buffers)[b].find("uri");
+        if (!uri) {
+          m_buffers.push_back(binChunk);
+          continue;
+        }
+        const std::string &text = uri->string();
+        if (text.compare(0, 5, "data:") == 0) {
+          const size_t comma = text.find(',');
+          if (comma == std::string::npos ||
+              text.rfind(";base64", comma) == std::string::npos) {
+            throw std::runtime_error(
+                "Unsupported data URI in " + path.string());
+          }
+          m_buffers.push_back(decodeBase64(text.substr(comma + 1)));
+        } else {
+          m_buffers.push_back(readFile(path.parent_path() / text));
+        }
+      }
+    }
+  }
+
+  TriangleMesh triangles() const
+  {
+    TriangleMesh mesh;
+    const JsonValue *nodes = m_document.find("nodes");
+    if (!nodes) {
+      return mesh;
+    }
+
+    std::vector<size_t> roots;
+    const JsonValue *scenes = m_document.find("scenes");
+    if (scenes && scenes->size() > 0) {
+      const size_t scene = size_t(m_document.numberOr("scene", 0));
+      if (const JsonValue *sceneNodes = (*scenes)[scene].find("nodes")) {
+        for (size_t n = 0; n < sceneNodes->size(); ++n) {
+          roots.push_back(size_t((*sceneNodes)[n].number()));
+        }
+      }
+    } else {
+      // No scene: every node without a parent
+      std::vector<bool> isChild(nodes->size(), false);
+      for (size_t n = 0; n < nodes->size(); ++n) {
+        if (const JsonValue *children = (*nodes)[n].find("children")) {
+          for (size_t c = 0; c < children->size(); ++c) {
+            isChild[size_t((*children)[c].number())] = true;
+          }
+        }
+      }
+      for (size_t n = 0; n < nodes->size(); ++n) {
+        if (!isChild[n]) {
+          roots.push_back(n);
+        }
+      }
+    }
+
+    for (const size_t root : roots) {
+      addNode(mesh, root, glm::mat4(1), 0);
+    }
+    return mesh;
+  }
+
+private:
+  static glm::mat4 localTransform(const JsonValue &node)
+  {
+    if (const JsonValue *matrix = node.find("matrix")) {
+      glm::mat4 m;
+      for (int k = 0; k < 16; ++k) {
+        glm::value_ptr(m)[k] = float((*matrix)[k].number()); // column major
+      }
+      return m;
+    }
+
+    glm::vec3 t(0), s(1);
+    glm::quat r(1, 0, 0, 0);
+    if (const JsonValue *translation = node.find("translation")) {
+      t = glm::vec3((*translation)[0].number(), (*translation)[1].number(),
+          (*translation)[2].number());
+    }
+    if (const JsonValue *rotation = node.find("rotation")) {
+      // glTF stores x, y, z, w
+      r = glm::quat(float((*rotation)[3].number()),
+          float((*rotation)[0].number()), float((*rotation)[1].number()),
+          float((*rotation)[2].number()));
+    }
+    if (const JsonValue *scale = node.find("scale")) {
+      s = glm::vec3(
+          (*scale)[0].number(), (*scale)[1].number(), (*scale)[2].number());
+    }
+    glm::mat4 m = glm::mat4_cast(r);
+    m[0] *= s.x;
+    m[1] *= s.y;
+    m[2] *= s.z;
+    m[3] = glm::vec4(t, 1);
+    return m;
+  }
+
+  void addNode(TriangleMesh &mesh, size_t index, const glm::mat4 &parent,
+      int depth) const
+  {
+    // glTF forbids cycles, a bound keeps a broken file from recursing forever
+    if (depth > 64) {
+      throw std::runtime_error("glTF node hierarchy too deep");
+    }
+    const JsonValue &node = m_document["nodes"][index];
+    const glm::mat4 transform = parent * localTransform(node);
+
+    if (const JsonValue *meshIndex = node.find("mesh")) {
+      addMesh(mesh, m_document["meshes"][size_t(meshIndex->number())],
+          transform);
+    }
+    if (const JsonValue *children = node.find("children")) {
+      for (size_t c = 0; c < children->size(); ++c) {
+        addNode(mesh, size_t((*children)[c].number()), transform, depth + 1);
+      }
+    }
+  }
+
+  void addMesh(TriangleMesh &mesh, const JsonValue &gltfMesh,
+      const glm::mat4 &transform) const
+  {
+    const JsonValue &primitives = gltfMesh["primitives"];
+    for (size_t p = 0; p < primitives.size(); ++p) {
+      const JsonValue &primitive = primitives[p];
+      const int mode = int(primitive.numberOr("mode", MODE_TRIANGLES));
+      if (mode != MODE_TRIANGLES && mode != MODE_TRIANGLE_STRIP &&
+          mode != MODE_TRIANGLE_FAN) {
+        continue; // points and lines don't collide
+      }
+
+      const JsonValue *position = primitive["attributes"].find("POSITION");
+      if (!position) {
+        continue;
+      }
+      const std::vector<glm::vec3> positions =
+          readPositions(size_t(position->number()));
+
+      std::vector<uint32_t> indices;
+      if (const JsonValue *accessor = primitive.find("indices")) {
+        indices = readIndices(size_t(accessor->number()));
+      } else {
+        for (uint32_t i = 0; i < positions.size(); ++i) {
+          indices.push_back(i);
+        }
+      }
+
+      const uint32_t base = uint32_t(mesh.positions.size());
+      for (const auto &p : positions) {
+        mesh.positions.push_back(glm::vec3(transform * glm::vec4(p, 1)));
+      }
+      const auto addTriangle = [&](uint32_t a, uint32_t b, uint32_t c) {
+        if (a >= positions.size() || b >= positions.size() ||
+            c >= positions.size()) {
+          throw std::runtime_error("glTF index out of range");
+        }
+        mesh.indices.insert(mesh.indices.end(), {base + a, base + b, base + c});
+      };
+
+      // A mirroring transform flips the winding
+      const bool flip = glm::determinant(glm::mat3(transform)) < 0.f;
+      for (size_t i = 0; i + 2 < indices.size();
+           i += (mode == MODE_TRIANGLES ? 3 : 1)) {
+        uint32_t a, b, c;
+        if (mode == MODE_TRIANGLES) {
+          a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        } else if (mode == MODE_TRIANGLE_STRIP) {
+          a = indices[i], b = indices[i + 1 + (i & 1)],
+          c = indices[i + 2 - (i & 1)];
+        } else {
+          a = indices[0], b = indices[i + 1], c = indices[i + 2];
+        }
+        if (flip) {
+          std::swap(b, c);
+        }
+        addTriangle(a, b, c);
+      }
+    }
+  }
+
+  // Start, element count and stride of an accessor
+  struct View
+  {
+    const unsigned char *data;
+    size_t count;
+    size_t stride;
+    int componentType;
+  };
+
+  View accessorView(size_t index, size_t elementSize) const
+  {
+    const JsonValue &accessor = m_document["accessors"][index];
+    if (accessor.find("sparse")) {
+      throw std::runtime_error("Sparse glTF accessors are not supported");
+    }
+    View view;
+    view.count = size_t(accessor["count"].number());
+    view.componentType = int(accessor["componentType"].number());
+
+    const JsonValue &bufferView =
+        m_document["bufferViews"][size_t(accessor["bufferView"].number())];
+    const std::vector<unsigned char> &buffer =
+        m_buffers.at(size_t(bufferView["buffer"].number()));
+    const size_t offset = size_t(bufferView.numberOr("byteOffset", 0)) +
+                          size_t(accessor.numberOr("byteOffset", 0));
+    view.stride = size_t(bufferView.numberOr("byteStride", 0));
+    if (view.stride == 0) {
+      view.stride = elementSize;
+    }
+    if (view.count > 0 &&
+        offset + (view.count - 1) * view.stride + elementSize > buffer.size()) {
+      throw std::runtime_error("glTF accessor out of its buffer");
+    }
+    view.data = buffer.data() + offset;
+    return view;
+  }
+
+  std::vector<glm::vec3> readPositions(size_t accessor) const
+  {
+    const View view = accessorView(accessor, sizeof(glm::vec3));
+    if (view.componentType != COMPONENT_FLOAT) {
+      throw std::runtime_error("Only float glTF positions are supported");
+    }
+    std::vector<glm::vec3> positions(view.count);
+    for (size_t i = 0; i < view.count; ++i) {
+      std::memcpy(
+          &positions[i], view.data + i * view.stride, sizeof(glm::vec3));
+    }
+    return positions;
+  }
+
+  std::vector<uint32_t> readIndices(size_t accessor) const
+  {
+    const int componentType =
+        int(m_document["accessors"][accessor]["componentType"].number());
+    const size_t size = componentType == COMPONENT_UNSIGNED_BYTE
+                            ? 1
+                            : componentType == COMPONENT_UNSIGNED_SHORT ? 2 : 4;
+    if (componentType != COMPONENT_UNSIGNED_BYTE &&
+        componentType != COMPONENT_UNSIGNED_SHORT &&
+        componentType != COMPONENT_UNSIGNED_INT) {
+      throw std::runtime_error("Invalid glTF index type");
+    }
+
+    const View view = accessorView(accessor, size);
+    std::vector<uint32_t> indices(view.count);
+    for (size_t i = 0; i < view.count; ++i) {
+      const unsigned char *p = view.data + i * view.stride;
+      if (size == 1) {
+        indices[i] = p[0];
+      } else if (size == 2) {
+        uint16_t value;
+        std::memcpy(&value, p, 2);
+        indices[i] = value;
+      } else {
+        std::memcpy(&indices[i], p, 4);
+      }
+    }
+    return indices;
+  }
+
+  JsonValue m_document;
+  std::vector<std::vector<unsigned char>> m_buffers;
+};
+
+} // namespace
+
+TriangleMesh loadGltfTriangles(const fs::path &path)
+{
+  return GltfReader(path).triangles();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "filesystem.hpp"
+
+struct TriangleMesh
+{
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices; // three per triangle
+};
+
+// Triangles of every mesh in the default scene of a .gltf or .glb file, with
+// the node transforms applied. Buffers may be embedded, in the GLB binary
+// chunk or in files next to the model. Only the geometry is read.
+// Throws std::runtime_error when the file can't be used.
+TriangleMesh loadGltfTriangles(const fs::path &path);
@@ -0,0 +1,343 @@
+#include "json.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+const char *typeName(JsonValue::Type type)
+{
+  switch (type) {
+  case JsonValue::Type::Null:
+    return "null";
+  case JsonValue::Type::Bool:
+    return "boolean";
+  case JsonValue::Type::Number:
+    return "number";
+  case JsonValue::Type::String:
+    return "string";
+  case JsonValue::Type::Array:
+    return "array";
+  case JsonValue::Type::Object:
+    return "object";
+  }
+  return "unknown";
+}
+
+void expectType(JsonValue::Type actual, JsonValue::Type expected)
+{
+  if (actual != expected) {
+    throw std::runtime_error(std::string("JSON: expected ") +
+                             typeName(expected) + ", got " + typeName(actual));
+  }
+}
+
+} // namespace
+
+bool JsonValue::boolean() const
+{
+  expectType(m_type, Type::Bool);
+  return m_bool;
+}
+
+double JsonValue::number() const
+{
+  expectType(m_type, Type::Number);
+  return m_number;
+}
+
+const std::string &JsonValue::string() const
+{
+  expectType(m_type, Type::String);
+  return m_string;
+}
+
+size_t JsonValue::size() const
+{
+  if (m_type == Type::Object) {
+    return m_object.size();
+  }
+  expectType(m_type, Type::Array);
+  return m_array.size();
+}
+
+const JsonValue &JsonValue::operator[](size_t index) const
+{
+  expectType(m_type, Type::Array);
+  if (index >= m_array.size()) {
+    throw std::runtime_error("JSON: index " + std::to_string(index) +
+                             " out of " + std::to_string(m_array.size()));
+  }
+  return m_array[index];
+}
+
+const JsonValue &JsonValue::operator[](const std::string &key) const
+{
+  const JsonValue *value = find(key);
+  if (!value) {
+    throw std::runtime_error("JSON: missing member " + key);
+  }
+  return *value;
+}
+
+const JsonValue *JsonValue::find(const std::string &key) const
+{
+  expectType(m_type, Type::Object);
+  for (const auto &member : m_object) {
+    if (member.first == key) {
+      return &member.second;
+    }
+  }
+  return nullptr;
+}
+
+double JsonValue::numberOr(const std::string &key, double fallback) const
+{
+  const JsonValue *value = find(key);
+  return value ? value->number() : fallback;
+}
+
+class JsonParser
+{
+public:
+  explicit JsonParser(const std::string &text) : m_text(text) {}
+
+  JsonValue parseDocument()
+  {
+    JsonValue value = parseValue();
+    skipSpaces();
+    if (m_position != m_text.size()) {
+      fail("trailing characters");
+    }
+    return value;
+  }
+
+private:
+  [[noreturn]] void fail(const std::string &message) const
+  {
+    throw std::runtime_error(
+        "JSON: " + message + " at offset " + std::to_string(m_position));
+  }
+
+  void skipSpaces()
+  {
+    while (m_position < m_text.size() &&
+           (m_text[m_position] == ' ' || m_text[m_position] == '\t' ||
+               m_text[m_position] == '\n' || m_text[m_position] == '\r')) {
+      ++m_position;
+    }
+  }
+
+  char peek()
+  {
+    skipSpaces();
+    if (m_position >= m_text.size()) {
+      fail("unexpected end");
+    }
+    return m_text[m_position];
+  }
+
+  void expect(char c)
+  {
+    if (peek() != c) {
+      fail(std::string("expected '") + c + "'");
+    }
+    ++m_position;
+  }
+
+  void expectWord(const char *word)
+  {
+    for (const char *c = word; *c; ++c, ++m_position) {
+      if (m_position >= m_text.size() || m_text[m_position] != *c) {
+        fail(std::string("expected ") + word);
+      }
+    }
+  }
+
+  JsonValue parseValue()
+  {
+    JsonValue value;
+    switch (peek()) {
+    case '{':
+      value.m_type = JsonValue::Type::Object;
+      ++m_position;
+      if (peek() == '}') {
+        ++m_position;
+        break;
+      }
+      do {
+        if (peek() != '"') {
+          fail("expected a member name");
+        }
+        std::string key = parseString();
+        expect(':');
+        value.m_object.emplace_back(std::move(key), parseValue());
+      } while (acceptComma());
+      expect('}');
+      break;
+    case '[':
+      value.m_type = JsonValue::Type::Array;
+      ++m_position;
+      if (peek() == ']') {
+        ++m_position;
+        break;
+      }
+      do {
+        value.m_array.push_back(parseValue());
+      } while (acceptComma());
+      expect(']');
+      break;
+    case '"':
+      value.m_type = JsonValue::Type::String;
+      value.m_string = parseString();
+      break;
+    case 't':
+      expectWord("true");
+      value.m_type = JsonValue::Type::Bool;
+      value.m_bool = true;
+      break;
+    case 'f':
+      expectWord("false");
+      value.m_type = JsonValue::Type::Bool;
+      break;
+    case 'n':
+      expectWord("null");
+      break;
+    default:
+      value.m_type = JsonValue::Type::Number;
+      value.m_number = parseNumber();
+      break;
+    }
+    return value;
+  }
+
+  bool acceptComma()
+  {
+    if (peek() == ',') {
+      ++m_position;
+      return true;
+    }
+    return false;
+  }
+
+  double parseNumber()
+  {
+    const char *begin = m_text.c_str() + m_position;
+    char *end = nullptr;
+    const double number = std::strtod(begin, &end);
+    if (end == begin) {
+      fail("expected a value");
+    }
+    m_position += size_t(end - begin);
+    return number;
+  }
+
+  uint32_t parseHex4()
+  {
+    if (m_position + 4 > m_text.size()) {
+      fail("truncated escape");
+    }
+    uint32_t code = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = m_text[m_position++];
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= uint32_t(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        code |= uint32_t(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        code |= uint32_t(c - 'A' + 10);
+      } else {
+        fail("invalid escape");
+      }
+    }
+    return code;
+  }
+
+  static void appendUtf8(std::string &out, uint32_t code)
+  {
+    if (code < 0x80) {
+      out += char(code);
+    } else if (code < 0x800) {
+      out += char(0xC0 | (code >> 6));
+      out += char(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      out += char(0xE0 | (code >> 12));
+      out += char(0x80 | ((code >> 6) & 0x3F));
+      out += char(0x80 | (code & 0x3F));
+    } else {
+      out += char(0xF0 | (code >> 18));
+      out += char(0x80 | ((code >> 12) & 0x3F));
+      out += char(0x80 | ((code >> 6) & 0x3F));
+      out += char(0x80 | (code & 0x3F));
+    }
+  }
+
+  std::string parseString()
+  {
+    expect('"');
+    std::string out;
+    while (true) {
+      if (m_position >= m_text.size()) {
+        fail("unterminated string");
+      }
+      const char c = m_text[m_position++];
+      if (c == '"') {
+        return out;
+      }
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (m_position >= m_text.size()) {
+        fail("unterminated string");
+      }
+      const char escape = m_text[m_position++];
+      switch (escape) {
+      case '"':
+      case '\\':
+      case '/':
+        out += escape;
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u': {
+        uint32_t code = parseHex4();
+        // Surrogate pair
+        if (code >= 0xD800 && code < 0xDC00 && m_position + 1 < m_text.size() &&
+            m_text[m_position] == '\\' && m_text[m_position + 1] == 'u') {
+          m_position += 2;
+          const uint32_t low = parseHex4();
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+        appendUtf8(out, code);
+        break;
+      }
+      default:
+        fail("invalid escape");
+      }
+    }
+  }
+
+  const std::string &m_text;
+  size_t m_position = 0;
+};
+
+JsonValue parseJson(const std::string &text)
+{
+  return JsonParser(text).parseDocument();
+}
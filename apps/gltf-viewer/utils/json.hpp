@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document, enough to read glTF files.
+// Accessors throw std::runtime_error on a type mismatch or a missing member.
+class JsonValue
+{
+public:
+  enum class Type
+  {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+  };
+
+  JsonValue() = default;
+
+  inline Type type() const { return m_type; }
+  inline bool isNull() const { return m_type == Type::Null; }
+  inline bool isNumber() const { return m_type == Type::Number; }
+  inline bool isString() const { return m_type == Type::String; }
+  inline bool isArray() const { return m_type == Type::Array; }
+  inline bool isObject() const { return m_type == Type::Object; }
+
+  bool boolean() const;
+  double number() const;
+  const std::string &string() const;
+
+  // Elements of an array or members of an object
+  size_t size() const;
+  const JsonValue &operator[](size_t index) const;
+  const JsonValue &operator[](const std::string &key) const;
+
+  // Member of an object, null when missing
+  const JsonValue *find(const std::string &key) const;
+  double numberOr(const std::string &key, double fallback) const;
+
+private:
+  friend class JsonParser;
+
+  Type m_type = Type::Null;
+  bool m_bool = false;
+  double m_number = 0.;
+  std::string m_string;
+  std::vector<JsonValue> m_array;
+  std::vector<std::pair<std::string, JsonValue>> m_object;
+};
+
+// Throws std::runtime_error with the offset of the first syntax error
+JsonValue parseJson(const std::string &text);
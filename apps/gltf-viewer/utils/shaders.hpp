@@ -93,16 +93,23 @@ GLShader compileShader(GLenum type, StringType &&src)
   return shader;
 }
 
-// Load and compile a shader according to the following naming convention:
+// Type of a shader according to the following naming convention, and its
+// name:
 // *.vs.glsl -> vertex shader
+// *.tcs.glsl -> tessellation control shader
+// *.tes.glsl -> tessellation evaluation shader
 // *.fs.glsl -> fragment shader
 // *.gs.glsl -> geometry shader
 // *.cs.glsl -> compute shader
-inline GLShader loadShader(const fs::path &shaderPath)
+inline const std::pair<GLenum, std::string> &shaderType(
+    const fs::path &shaderPath)
 {
   static auto extToShaderType =
       std::unordered_map<std::string, std::pair<GLenum, std::string>>(
           {{".vs", {GL_VERTEX_SHADER, "vertex"}},
+              {".tcs", {GL_TESS_CONTROL_SHADER, "tessellation control"}},
+              {".tes",
+                  {GL_TESS_EVALUATION_SHADER, "tessellation evaluation"}},
               {".fs", {GL_FRAGMENT_SHADER, "fragment"}},
               {".gs", {GL_GEOMETRY_SHADER, "geometry"}},
               {".cs", {GL_COMPUTE_SHADER, "compute"}}});
@@ -113,11 +120,18 @@ inline GLShader loadShader(const fs::path &shaderPath)
     std::cerr << "Unrecognized shader extension " << ext << std::endl;
     throw std::runtime_error("Unrecognized shader extension " + ext.string());
   }
+  return (*it).second;
+}
+
+// Load and compile a shader, its type given by shaderType()
+inline GLShader loadShader(const fs::path &shaderPath)
+{
+  const auto &type = shaderType(shaderPath);
 
-  std::clog << "Compiling " << (*it).second.second << " shader " << shaderPath
+  std::clog << "Compiling " << type.second << " shader " << shaderPath
             << "\n";
 
-  GLShader shader{(*it).second.first};
+  GLShader shader{type.first};
   shader.setSource(loadShaderSource(shaderPath));
   shader.compile();
   if (!shader.getCompileStatus()) {
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cmath>
+
+// SSE kernels are used when the target has it, scalar loops otherwise
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLOTH_USE_SSE 1
+#endif
+
+// Four floats processed together, with SSE when available.
+// Comparisons return masks to use with select() and any().
+struct float4
+{
+#ifdef CLOTH_USE_SSE
+  __m128 v;
+
+  float4() = default;
+  float4(__m128 value) : v(value) {}
+  explicit float4(float s) : v(_mm_set1_ps(s)) {}
+  float4(float a, float b, float c, float d) : v(_mm_set_ps(d, c, b, a)) {}
+
+  static inline float4 load(const float *in) { return _mm_loadu_ps(in); }
+  inline void store(float *out) const { _mm_storeu_ps(out, v); }
+
+  // x, y and z of a vec3, the last lane 0, without reading past it
+  static inline float4 load3(const float *in)
+  {
+    return _mm_movelh_ps(
+        _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(in)),
+        _mm_load_ss(in + 2));
+  }
+  inline void store3(float *out) const
+  {
+    _mm_storel_pi(reinterpret_cast<__m64 *>(out), v);
+    _mm_store_ss(out + 2, _mm_movehl_ps(v, v));
+  }
+#else
+  float v[4];
+
+  float4() = default;
+  explicit float4(float s) : v{s, s, s, s} {}
+  float4(float a, float b, float c, float d) : v{a, b, c, d} {}
+
+  static inline float4 load(const float *in)
+  {
+    return float4(in[0], in[1], in[2], in[3]);
+  }
+  inline void store(float *out) const
+  {
+    for (int i = 0; i < 4; ++i) {
+      out[i] = v[i];
+    }
+  }
+
+  static inline float4 load3(const float *in)
+  {
+    return float4(in[0], in[1], in[2], 0.f);
+  }
+  inline void store3(float *out) const
+  {
+    for (int i = 0; i < 3; ++i) {
+      out[i] = v[i];
+    }
+  }
+#endif
+};
+
+#ifdef CLOTH_USE_SSE
+
+inline float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+inline float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline float4 operator/(float4 a, float4 b) { return _mm_div_ps(a.v, b.v); }
+inline float4 min(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+inline float4 max(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+inline float4 sqrt(float4 a) { return _mm_sqrt_ps(a.v); }
+inline float4 abs(float4 a)
+{
+  return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v);
+}
+inline float4 operator<(float4 a, float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline float4 operator>(float4 a, float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline float4 operator>=(float4 a, float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline float4 operator&(float4 a, float4 b) { return _mm_and_ps(a.v, b.v); }
+inline float4 operator|(float4 a, float4 b) { return _mm_or_ps(a.v, b.v); }
+// mask ? a : b
+inline float4 select(float4 mask, float4 a, float4 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+inline bool any(float4 mask) { return _mm_movemask_ps(mask.v) != 0; }
+
+#else
+
+namespace simd_detail {
+template <typename F> inline float4 map(float4 a, float4 b, F f)
+{
+  float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = f(a.v[i], b.v[i]);
+  }
+  return r;
+}
+inline float maskOf(bool b) { return b ? -1.f : 0.f; }
+} // namespace simd_detail
+
+inline float4 operator+(float4 a, float4 b)
+{
+  return simd_detail::map(a, b, [](float x, float y) { return x + y; });
+}
+inline float4 operator-(float4 a, float4 b)
+{
+  return simd_detail::map(a, b, [](float x, float y) { return x - y; });
+}
+inline float4 operator*(float4 a, float4 b)
+{
+  return simd_detail::map(a, b, [](float x, float y) { return x * y; });
+}
+inline float4 operator/(float4 a, float4 b)
+{
+  return simd_detail::map(a, b, [](float x, float y) { return x / y; });
+}
+inline float4 min(float4 a, float4 b)
+{
+  return simd_detail::map(a, b, [](float x, float y) { return y < x ? y : x; });
+}
+inline float4 max(float4 a, float4 b)
+{
+  return simd_detail::map(a, b, [](float x, float y) { return x < y ? y : x; });
+}
+inline float4 sqrt(float4 a)
+{
+  return simd_detail::map(a, a, [](float x, float) { return std::sqrt(x); });
+}
+inline float4 abs(float4 a)
+{
+  return simd_detail::map(a, a, [](float x, float) { return std::abs(x); });
+}
+inline float4 operator<(float4 a, float4 b)
+{
+  return simd_detail::map(
+      a, b, [](float x, float y) { return simd_detail::maskOf(x < y); });
+}
+inline float4 operator>(float4 a, float4 b)
+{
+  return simd_detail::map(
+      a, b, [](float x, float y) { return simd_detail::maskOf(x > y); });
+}
+inline float4 operator>=(float4 a, float4 b)
+{
+  return simd_detail::map(
+      a, b, [](float x, float y) { return simd_detail::maskOf(x >= y); });
+}
+inline float4 operator&(float4 a, float4 b)
+{
+  return simd_detail::map(a, b,
+      [](float x, float y) { return simd_detail::maskOf(x != 0 && y != 0); });
+}
+inline float4 operator|(float4 a, float4 b)
+{
+  return simd_detail::map(a, b,
+      [](float x, float y) { return simd_detail::maskOf(x != 0 || y != 0); });
+}
+inline float4 select(float4 mask, float4 a, float4 b)
+{
+  float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i];
+  }
+  return r;
+}
+inline bool any(float4 mask)
+{
+  return mask.v[0] != 0 || mask.v[1] != 0 || mask.v[2] != 0 || mask.v[3] != 0;
+}
+
+#endif
+
+inline float4 clamp(float4 a, float4 low, float4 high)
+{
+  return min(max(a, low), high);
+}
+
+inline float4 lerp(float4 a, float4 b, float4 t) { return a + (b - a) * t; }